@@ -1,1643 +1,6066 @@
-// OS RACER - Multi-threaded Kernel Edition (Final Complete Version)
-// C++11 - Visual Studio / MSVC
-//
-// Level 1: Retro Digital Grid (Distinctive wireframe landscape).
-// Level 2: Cyber City (Standard).
-// Level 3: Pure Deep Space (Stars ONLY. No nebula, no mountains, no ground).
-
-#include <iostream>
-#include <vector>
-#include <string>
-#include <algorithm>
-#include <chrono>
-#include <cmath>
-#include <cwchar>
-#include <windows.h>
-#include <thread>
-#include <atomic>
-#include <mutex>
-#include <cstdio> // For swprintf_s
-#include <locale>
-#include <mmsystem.h>
-#include <stdio.h>
-#pragma comment(lib, "winmm.lib")
-using namespace std;
-
-// Audio file paths (place these files in the "audio" folder)
-const wchar_t* AUDIO_FOLDER = L"audio\\";
-const wchar_t* ENGINE_IDLE_FILE = L"engine_idle.mp3";  // Engine idle/running sound (when moving)
-const wchar_t* ENGINE_ACCEL_FILE = L"engine_accel.mp3"; // Engine acceleration sound (when accelerating)
-const wchar_t* BRAKE_SOUND_FILE = L"brake.mp3";     // Brake sound file (when steering)
-const wchar_t* CRASH_SOUND_FILE = L"crash.mp3";     // Crash sound file
-const wchar_t* GAMEOVER_SOUND_FILE = L"gameover.mp3"; // Game Over sound file
-const wchar_t* WIN_SOUND_FILE = L"victory.mp3";     // Victory sound file
-const wchar_t* BGM_FILE = L"bgm.mp3";               // Background music file
-
-// Helper function to get full audio file path
-wstring GetAudioPath(const wchar_t* filename) {
-    wstring path = AUDIO_FOLDER;
-    path += filename;
-    return path;
-}
-
-// ================================================================
-// OS RACER — Kernel Physics Parameter Table (KPT)
-// ================================================================
-const int nScreenWidth = 120; // Console width (columns)
-const int nScreenHeight = 30; // Console height (rows)
-const int FRAME_RATE = 60; // Render thread FPS
-const float PHYSICS_HZ = 240.0f; // Physics thread frequency
-const float DELTA_T = 1.0f / PHYSICS_HZ; // Physics fixed-step (s)
-
-// Road / Track Parameters
-const float ROAD_WIDTH_LIMIT = 1.0f; // Max absolute lane offset
-const float CAMERA_LAG_DISTANCE = 3.0f; // Third-person: camera looks back 3 units
-const float PLAYER_HALF_WIDTH = 0.18f; // Half of car width in normalized road coordinates
-
-// Vehicle Dynamics Parameters
-const float MAX_SPEED = 50.0f; // Top speed
-const float ACCELERATION = 17.0f; // Acceleration units/sec
-const float DECELERATION = 20.0f; // Deceleration units/sec
-const float FRICTION = 0.9999f; // Speed friction per physics tick
-
-// Steering / Lateral Control
-const float LATERAL_FACTOR = 0.0004f;
-const float STEER_COMPENSATION = 0.002f;
-
-// Heading Angle & Drift
-const float HEADING_TURN_SPEED = 0.4f;
-const float HEADING_DRIFT_FACTOR = 0.004f;
-
-// Rendering / Visual characters
-const wchar_t CHAR_FULL = L'█';
-const wchar_t CHAR_DARK = L'▓';
-const wchar_t CHAR_MED = L'▒';
-const wchar_t CHAR_LIGHT = L'░';
-const wchar_t CHAR_EMPTY = L' ';
-
-// Game state
-enum GameState { BOOT_MENU = 0, MAP_SELECT, KERNEL_RUNNING, GAME_WIN, GAME_OVER, SYSTEM_HALT };
-std::atomic<GameState> currentState(BOOT_MENU);
-
-// Global map ID for rendering context
-int g_currentMapId = 1;
-
-// -------------------------- Player State -------------------------
-struct PlayerPCB {
-    float fX_Register = 0.0f; // Lateral position on road (-1 ~ +1)
-    float fSpeed = 0.0f; // Forward speed
-    float fDistance = 0.0f; // Forward distance along track
-    float fCurvature = 0.0f; // Current track curvature
-    float fPlayerCurvature = 0.0f; // Accumulated curvature for background
-    float fHeadingAngle = 0.0f; // Visual steering angle
-    bool bCrashed = false;
-    int nSteerState = 0; // -1, 0, +1
-    void Reset() { *this = PlayerPCB(); }
-} player;
-
-std::mutex g_player_mutex;
-
-// --------------------------- Track Data --------------------------
-struct Obstacle {
-    float fSegDistance; // Distance inside the segment
-    float fOffsetX; // Lateral offset from center (-ROAD_WIDTH_LIMIT to ROAD_WIDTH_LIMIT)
-    float fWidth; // Obstacle width in normalized road coordinates
-};
-
-struct TrackSegment {
-    float fCurvature; // Curvature factor
-    float fDistance; // Segment length
-    vector<Obstacle> vecObstacles; // Obstacles inside this segment
-};
-
-vector<TrackSegment> vecTrack;
-float fTotalTrackLength = 0.0f;
-vector<pair<float, float>> vecMapPointsCurrent;
-vector<pair<float, float>> vecMapPreview[3];
-
-// --------------------------- Console -----------------------------
-HANDLE hConsole = NULL;
-vector<wchar_t> screenBuffer(nScreenWidth * nScreenHeight, CHAR_EMPTY);
-vector<WORD> colorBuffer(nScreenWidth * nScreenHeight, 0x07);
-std::mutex g_screen_mutex;
-
-// -------------------------- Thread Control -----------------------
-std::atomic<bool> running(true);
-
-// ------------------------- Input Atomics -------------------------
-std::atomic<int> input_steer(0); // -1, 0, +1
-std::atomic<bool> input_accel(false);
-std::atomic<bool> input_brake(false);
-std::atomic<bool> input_escape(false);
-
-// Edge-detect input (one-shot)
-std::atomic<bool> input_space_edge(false);
-std::atomic<bool> input_up_edge(false);
-std::atomic<bool> input_down_edge(false);
-std::atomic<bool> input_1_edge(false);
-std::atomic<bool> input_2_edge(false);
-std::atomic<bool> input_3_edge(false);
-
-// ----------------- Obstacle Warning (shared flags) ----------------
-std::atomic<bool> warnObstacle(false);
-std::atomic<float> warnObstacleDist(0.0f);
-std::atomic<float> warnObstacleOffsetX(0.0f);
-
-// ----------------- Sound System -----------------
-std::atomic<bool> sound_crash(false);
-std::atomic<bool> sound_gameover(false);
-std::atomic<bool> sound_win(false);
-std::atomic<bool> sound_brake(false);
-std::atomic<float> lastSpeed(0.0f);
-std::atomic<bool> sound_accel_active(false);
-std::atomic<float> engineRPM(0.0f); // Engine RPM for realistic sound
-std::atomic<bool> bgm_playing(false);
-std::atomic<bool> engine_idle_playing(false);
-std::atomic<bool> engine_accel_playing(false);
-std::atomic<bool> brake_sound_playing(false);
-
-// =================================================================
-// Sound System
-// =================================================================
-void PlayBeepSound(int frequency, int duration) {
-    Beep(frequency, duration);
-}
-
-// Play audio file using MCI (supports WAV, MP3, etc.)
-bool PlayAudioFile(const wchar_t* filename, bool loop = false) {
-    // Get full path with audio folder
-    wstring fullPath = GetAudioPath(filename);
-    
-    // First, ensure any existing instance is properly closed
-    wchar_t closeCmd[128];
-    swprintf_s(closeCmd, L"close audio_file");
-    mciSendStringW(closeCmd, NULL, 0, NULL); // Ignore errors if not open
-    Sleep(30); // Give system more time to release resources
-    
-    wchar_t cmd[512];
-    MCIERROR err = 0;
-    
-    // Check file extension to determine format
-    wstring filenameStr(filename);
-    size_t dotPos = filenameStr.find_last_of(L".");
-    bool isMP3 = false;
-    if (dotPos != wstring::npos) {
-        wstring ext = filenameStr.substr(dotPos + 1);
-        for (auto& c : ext) c = towlower(c);
-        isMP3 = (ext == L"mp3");
-    }
-    
-    // Try MP3 first if extension suggests MP3, otherwise try WAV first
-    if (isMP3) {
-        swprintf_s(cmd, L"open \"%s\" type mpegvideo alias audio_file", fullPath.c_str());
-        err = mciSendStringW(cmd, NULL, 0, NULL);
-        if (err != 0) {
-            // Try as WAV if MP3 fails
-            swprintf_s(cmd, L"open \"%s\" type waveaudio alias audio_file", fullPath.c_str());
-            err = mciSendStringW(cmd, NULL, 0, NULL);
-        }
-    } else {
-        // Try WAV first
-        swprintf_s(cmd, L"open \"%s\" type waveaudio alias audio_file", fullPath.c_str());
-        err = mciSendStringW(cmd, NULL, 0, NULL);
-        if (err != 0) {
-            // Try as MP3 if WAV fails
-            swprintf_s(cmd, L"open \"%s\" type mpegvideo alias audio_file", fullPath.c_str());
-            err = mciSendStringW(cmd, NULL, 0, NULL);
-        }
-    }
-    
-    if (err != 0) {
-        return false; // File not found or format not supported
-    }
-    
-    wchar_t playCmd[128];
-    if (loop) {
-        swprintf_s(playCmd, L"play audio_file repeat");
-    } else {
-        swprintf_s(playCmd, L"play audio_file");
-    }
-    
-    MCIERROR playErr = mciSendStringW(playCmd, NULL, 0, NULL);
-    if (playErr != 0) {
-        // If play fails, close the device to avoid resource leak
-        swprintf_s(cmd, L"close audio_file");
-        mciSendStringW(cmd, NULL, 0, NULL);
-        return false;
-    }
-    
-    return true;
-}
-
-// Stop audio file
-void StopAudioFile() {
-    mciSendStringW(L"stop audio_file", NULL, 0, NULL);
-    mciSendStringW(L"close audio_file", NULL, 0, NULL);
-}
-
-// Play audio file with custom alias (for multiple simultaneous sounds)
-bool PlayAudioFileWithAlias(const wchar_t* filename, const wchar_t* alias, bool loop = false) {
-    // Get full path with audio folder
-    wstring fullPath = GetAudioPath(filename);
-    
-    // First, ensure any existing instance is properly closed to avoid conflicts
-    wchar_t cmd[512];
-    
-    // Check if device is already open and stop/close it properly
-    wchar_t statusCmd[128];
-    wchar_t status[128];
-    swprintf_s(statusCmd, L"status %s mode", alias);
-    MCIERROR statusErr = mciSendStringW(statusCmd, status, 128, NULL);
-    
-    if (statusErr == 0) {
-        // Device exists, stop and close it first
-        swprintf_s(cmd, L"stop %s", alias);
-        mciSendStringW(cmd, NULL, 0, NULL);
-        swprintf_s(cmd, L"close %s", alias);
-        mciSendStringW(cmd, NULL, 0, NULL);
-        Sleep(20); // Give system time to release resources
-    }
-    
-    // Try MP3 first
-    swprintf_s(cmd, L"open \"%s\" type mpegvideo alias %s", fullPath.c_str(), alias);
-    MCIERROR err = mciSendStringW(cmd, NULL, 0, NULL);
-    
-    if (err != 0) {
-        // Try WAV format if MP3 fails
-        swprintf_s(cmd, L"open \"%s\" type waveaudio alias %s", fullPath.c_str(), alias);
-        err = mciSendStringW(cmd, NULL, 0, NULL);
-        if (err != 0) {
-            return false; // File not found or format not supported
-        }
-    }
-    
-    // Play the file
-    wchar_t playCmd[128];
-    if (loop) {
-        swprintf_s(playCmd, L"play %s repeat", alias);
-    } else {
-        swprintf_s(playCmd, L"play %s", alias);
-    }
-    
-    MCIERROR playErr = mciSendStringW(playCmd, NULL, 0, NULL);
-    if (playErr != 0) {
-        // If play fails, close the device to avoid resource leak
-        swprintf_s(cmd, L"close %s", alias);
-        mciSendStringW(cmd, NULL, 0, NULL);
-        return false;
-    }
-    
-    return true;
-}
-
-// Stop audio file with custom alias
-void StopAudioFileWithAlias(const wchar_t* alias) {
-    wchar_t cmd[128];
-    wchar_t statusCmd[128];
-    wchar_t status[128];
-    
-    // Check if device exists before trying to stop/close
-    swprintf_s(statusCmd, L"status %s mode", alias);
-    MCIERROR statusErr = mciSendStringW(statusCmd, status, 128, NULL);
-    
-    if (statusErr == 0) {
-        // Device exists, stop it first
-        swprintf_s(cmd, L"stop %s", alias);
-        mciSendStringW(cmd, NULL, 0, NULL);
-        
-        // Then close it
-        swprintf_s(cmd, L"close %s", alias);
-        MCIERROR closeErr = mciSendStringW(cmd, NULL, 0, NULL);
-        
-        // If close fails, try again after a short delay
-        if (closeErr != 0) {
-            Sleep(10);
-            swprintf_s(cmd, L"close %s", alias);
-            mciSendStringW(cmd, NULL, 0, NULL);
-        }
-    }
-}
-
-// Fade out audio file with custom alias (gradual volume decrease)
-void FadeOutAudioFileWithAlias(const wchar_t* alias, float fadeoutProgress) {
-    // fadeoutProgress: 0.0 = full volume, 1.0 = silent
-    int volume = (int)(1000 * (1.0f - fadeoutProgress)); // MCI volume: 0-1000
-    volume = max(0, min(1000, volume));
-    
-    wchar_t cmd[128];
-    swprintf_s(cmd, L"setaudio %s volume to %d", alias, volume);
-    mciSendStringW(cmd, NULL, 0, NULL);
-    
-    // If fully faded out, stop the sound
-    if (fadeoutProgress >= 1.0f) {
-        StopAudioFileWithAlias(alias);
-    }
-}
-
-void SoundThreadProc() {
-    float lastEngineRPM = 0.0f;
-    auto lastEngineTime = chrono::high_resolution_clock::now();
-    bool isAccelerating = false;
-    bool wasAccelerating = false; // Track previous state for edge detection
-    bool bgmStarted = false;
-    
-    while (running.load()) {
-        GameState state = currentState.load();
-        
-        // Background music - start only when entering the map (KERNEL_RUNNING)
-        if (state == KERNEL_RUNNING) {
-            if (!bgmStarted && !bgm_playing.load()) {
-                // Try to play background music with loop
-                if (PlayAudioFile(BGM_FILE, true)) {
-                    bgm_playing.store(true);
-                    bgmStarted = true;
-                }
-            } else if (bgm_playing.load()) {
-                // Ensure BGM keeps looping - check if it's still playing
-                // If it stopped, restart it
-                wchar_t statusCmd[128];
-                wchar_t status[128];
-                swprintf_s(statusCmd, L"status audio_file mode");
-                MCIERROR err = mciSendStringW(statusCmd, status, 128, NULL);
-                if (err == 0) {
-                    // Check if stopped (should be "playing" or "stopped")
-                    wstring statusStr(status);
-                    if (statusStr.find(L"stopped") != wstring::npos || statusStr.find(L"not ready") != wstring::npos) {
-                        // Restart BGM with loop
-                        PlayAudioFile(BGM_FILE, true);
-                    }
-                }
-            }
-        } else {
-            // Stop BGM when not in game (menu, game over, win, etc.)
-            if (bgm_playing.load()) {
-                StopAudioFile();
-                bgm_playing.store(false);
-                bgmStarted = false;
-            }
-        }
-        
-        if (state == KERNEL_RUNNING) {
-            float currentSpeed = 0.0f;
-            bool accelPressed = false;
-            {
-                std::lock_guard<std::mutex> lk(g_player_mutex);
-                currentSpeed = player.fSpeed;
-            }
-            accelPressed = input_accel.load();
-            int steerInput = input_steer.load();
-            
-            // Engine sound plays when moving (speed > 0)
-            // RPM is based on speed, higher when accelerating
-            isAccelerating = accelPressed && currentSpeed < MAX_SPEED;
-            
-            // Brake sound handling - stop immediately when key released
-            static int lastSteerInput = 0;
-            if (steerInput != 0) {
-                // Just started steering - trigger brake sound
-                if (lastSteerInput == 0 && currentSpeed > 0.1f) {
-                    sound_brake.store(true);
-                }
-                lastSteerInput = steerInput;
-            } else {
-                // Stop brake sound immediately when steering stops (steerInput == 0)
-                // Always check and stop if playing when steering is released
-                if (brake_sound_playing.load()) {
-                    // Force stop and close the audio file
-                    wchar_t cmd[128];
-                    swprintf_s(cmd, L"stop brake_sound");
-                    mciSendStringW(cmd, NULL, 0, NULL);
-                    swprintf_s(cmd, L"close brake_sound");
-                    mciSendStringW(cmd, NULL, 0, NULL);
-                    brake_sound_playing.store(false);
-                }
-                lastSteerInput = 0; // Reset to 0
-            }
-            
-            // Calculate engine RPM based on speed
-            // Base RPM from speed (idle at 800 RPM when moving, up to 4000 RPM at max speed)
-            float targetRPM = 0.0f;
-            if (currentSpeed > 0.1f) {
-                // Base RPM from speed: 800 RPM (idle) to 3500 RPM (max speed)
-                targetRPM = 800.0f + (currentSpeed / MAX_SPEED) * 2700.0f;
-                
-                // Add extra RPM when accelerating
-                if (isAccelerating) {
-                    targetRPM += 500.0f; // Higher RPM when accelerating (up to 4000 RPM)
-                }
-            } else {
-                // No RPM when stopped
-                targetRPM = 0.0f;
-            }
-            
-            // Smooth RPM transition
-            float rpmChangeRate = (currentSpeed > 0.1f) ? 0.3f : 0.5f; // Faster decay when stopping
-            float currentRPM = lastEngineRPM + (targetRPM - lastEngineRPM) * rpmChangeRate;
-            if (currentRPM < 50.0f) currentRPM = 0.0f; // Stop completely when low
-            lastEngineRPM = currentRPM;
-            engineRPM.store(currentRPM);
-            
-            // Play engine sounds when moving (speed > 0)
-            if (currentSpeed > 0.1f) {
-                // Play idle engine sound (always when moving) - ensure it keeps playing
-                if (!engine_idle_playing.load()) {
-                    if (!PlayAudioFileWithAlias(ENGINE_IDLE_FILE, L"engine_idle", true)) {
-                        // Fallback to beep-based engine sound
-                        engine_idle_playing.store(true);
-                    } else {
-                        engine_idle_playing.store(true);
-                        // Set full volume for idle sound
-                        wchar_t cmd[128];
-                        swprintf_s(cmd, L"setaudio engine_idle volume to 1000");
-                        mciSendStringW(cmd, NULL, 0, NULL);
-                    }
-                } else {
-                    // Ensure idle sound keeps playing and is at full volume (prevent fadeout)
-                    wchar_t cmd[128];
-                    swprintf_s(cmd, L"setaudio engine_idle volume to 1000");
-                    mciSendStringW(cmd, NULL, 0, NULL);
-                }
-                
-                // Play acceleration sound when accelerating
-                // Restart acceleration sound each time acceleration key is pressed (edge detection)
-                if (isAccelerating) {
-                    // If just started accelerating (edge detection), restart the sound
-                    if (!wasAccelerating) {
-                        // Stop and restart acceleration sound to reset playback
-                        // Always close existing first to avoid conflicts
-                        if (engine_accel_playing.load()) {
-                            // Use proper stop function to ensure cleanup
-                            StopAudioFileWithAlias(L"engine_accel");
-                            engine_accel_playing.store(false);
-                            Sleep(30); // Longer delay to ensure system releases resources
-                        }
-                        // Start playing acceleration sound (will overlay with idle sound)
-                        if (PlayAudioFileWithAlias(ENGINE_ACCEL_FILE, L"engine_accel", true)) {
-                            engine_accel_playing.store(true);
-                        } else {
-                            // File not found or resource error, reset state
-                            engine_accel_playing.store(false);
-                        }
-                    }
-                    // If already accelerating, verify it's still playing
-                    else if (engine_accel_playing.load()) {
-                        // Check if sound is actually playing, restart if needed
-                        wchar_t statusCmd[128];
-                        wchar_t status[128];
-                        swprintf_s(statusCmd, L"status engine_accel mode");
-                        MCIERROR err = mciSendStringW(statusCmd, status, 128, NULL);
-                        if (err != 0) {
-                            // Device not found or error, restart it
-                            if (PlayAudioFileWithAlias(ENGINE_ACCEL_FILE, L"engine_accel", true)) {
-                                engine_accel_playing.store(true);
-                            } else {
-                                engine_accel_playing.store(false);
-                            }
-                        } else {
-                            wstring statusStr(status);
-                            if (statusStr.find(L"stopped") != wstring::npos) {
-                                // Restart if stopped
-                                wchar_t playCmd[128];
-                                swprintf_s(playCmd, L"play engine_accel repeat");
-                                mciSendStringW(playCmd, NULL, 0, NULL);
-                            }
-                        }
-                    }
-                } else {
-                    // Stop acceleration sound immediately when not accelerating (key released)
-                    if (engine_accel_playing.load()) {
-                        // Use proper stop function
-                        StopAudioFileWithAlias(L"engine_accel");
-                        engine_accel_playing.store(false);
-                    }
-                }
-                
-                // Update previous state for next frame
-                wasAccelerating = isAccelerating;
-                
-                // If using beep fallback, play beep sound based on RPM
-                if (engine_idle_playing.load() || engine_accel_playing.load()) {
-                    auto now = chrono::high_resolution_clock::now();
-                    auto elapsed = chrono::duration_cast<chrono::milliseconds>(now - lastEngineTime).count();
-                    
-                    if (currentRPM > 100.0f && elapsed > 80) {
-                        lastEngineTime = now;
-                        
-                        // Base frequency from RPM
-                        int baseFreq = (int)(currentRPM / 120.0f);
-                        baseFreq = max(80, min(baseFreq, 600));
-                        
-                        // Play engine sound - louder/higher when accelerating
-                        std::thread([baseFreq, currentRPM, isAccelerating]() {
-                            int duration = isAccelerating ? 70 : 50; // Longer when accelerating
-                            Beep(baseFreq, duration);
-                            Sleep(5);
-                            Beep(baseFreq * 2, isAccelerating ? 50 : 35);
-                            if (currentRPM > 2000) {
-                                Sleep(5);
-                                Beep((int)(baseFreq * 1.5f), isAccelerating ? 40 : 25);
-                            }
-                        }).detach();
-                    }
-                }
-            } else {
-                // Stop all engine sounds when stopped (speed = 0)
-                if (engine_idle_playing.load()) {
-                    StopAudioFileWithAlias(L"engine_idle");
-                    engine_idle_playing.store(false);
-                }
-                if (engine_accel_playing.load()) {
-                    StopAudioFileWithAlias(L"engine_accel");
-                    engine_accel_playing.store(false);
-                }
-            }
-            
-            lastSpeed.store(currentSpeed);
-        } else {
-            // Stop all engine sounds when not in game
-            if (engine_idle_playing.load()) {
-                StopAudioFileWithAlias(L"engine_idle");
-                engine_idle_playing.store(false);
-            }
-            if (engine_accel_playing.load()) {
-                StopAudioFileWithAlias(L"engine_accel");
-                engine_accel_playing.store(false);
-            }
-            if (brake_sound_playing.load()) {
-                // Force stop and close the audio file
-                wchar_t cmd[128];
-                swprintf_s(cmd, L"stop brake_sound");
-                mciSendStringW(cmd, NULL, 0, NULL);
-                swprintf_s(cmd, L"close brake_sound");
-                mciSendStringW(cmd, NULL, 0, NULL);
-                brake_sound_playing.store(false);
-            }
-        }
-        
-        // Brake sound - try file first, fallback to beep
-        if (sound_brake.exchange(false)) {
-            // Stop any existing brake sound first (synchronously)
-            if (brake_sound_playing.load()) {
-                wchar_t cmd[128];
-                swprintf_s(cmd, L"stop brake_sound");
-                mciSendStringW(cmd, NULL, 0, NULL);
-                swprintf_s(cmd, L"close brake_sound");
-                mciSendStringW(cmd, NULL, 0, NULL);
-                brake_sound_playing.store(false);
-            }
-            // Play brake sound without loop (play once)
-            if (!PlayAudioFileWithAlias(BRAKE_SOUND_FILE, L"brake_sound", false)) {
-                // Fallback to beep - short brake sound
-                Beep(300, 50);
-                Sleep(10);
-                Beep(250, 40);
-                brake_sound_playing.store(false);
-            } else {
-                brake_sound_playing.store(true);
-            }
-        }
-        
-        // Crash sound - try file first, fallback to beep
-        if (sound_crash.exchange(false)) {
-            std::thread([]() {
-                if (!PlayAudioFile(CRASH_SOUND_FILE, false)) {
-                    // Fallback to beep
-                    Beep(150, 200);
-                    Sleep(50);
-                    Beep(100, 300);
-                }
-            }).detach();
-        }
-        
-        // Game Over sound - try file first, fallback to beep
-        if (sound_gameover.exchange(false)) {
-            std::thread([]() {
-                // Stop background music when game over
-                if (bgm_playing.load()) {
-                    StopAudioFile();
-                    bgm_playing.store(false);
-                }
-                
-                // Play game over sound
-                if (!PlayAudioFile(GAMEOVER_SOUND_FILE, false)) {
-                    // Fallback to beep - dramatic game over sound
-                    Beep(200, 300);
-                    Sleep(100);
-                    Beep(150, 400);
-                    Sleep(100);
-                    Beep(100, 500);
-                }
-            }).detach();
-        }
-        
-        // Victory sound - try file first, fallback to beep
-        if (sound_win.exchange(false)) {
-            // Stop BGM when victory
-            if (bgm_playing.load()) {
-                StopAudioFile();
-                bgm_playing.store(false);
-                bgmStarted = false;
-            }
-            // Stop all engine sounds
-            if (engine_idle_playing.load()) {
-                StopAudioFileWithAlias(L"engine_idle");
-                engine_idle_playing.store(false);
-            }
-            if (engine_accel_playing.load()) {
-                StopAudioFileWithAlias(L"engine_accel");
-                engine_accel_playing.store(false);
-            }
-            // Give system time to stop all sounds
-            Sleep(50);
-            
-            // Play victory sound (synchronously to ensure it plays)
-            // Try MP3 first, then WAV
-            bool played = false;
-            if (!PlayAudioFile(WIN_SOUND_FILE, false)) {
-                // Try WAV version if MP3 fails
-                const wchar_t* winWav = L"victory.wav";
-                if (!PlayAudioFile(winWav, false)) {
-                    // Fallback to beep fanfare
-                    Beep(523, 200);
-                    Sleep(50);
-                    Beep(659, 200);
-                    Sleep(50);
-                    Beep(784, 200);
-                    Sleep(50);
-                    Beep(1047, 400);
-                } else {
-                    played = true;
-                }
-            } else {
-                played = true;
-            }
-        }
-        
-        Sleep(50); // Check every 50ms
-    }
-    
-    // Cleanup on exit
-    if (bgm_playing.load()) {
-        StopAudioFile();
-    }
-    if (engine_idle_playing.load()) {
-        StopAudioFileWithAlias(L"engine_idle");
-    }
-    if (engine_accel_playing.load()) {
-        StopAudioFileWithAlias(L"engine_accel");
-    }
-}
-
-// =================================================================
-// Utility Draw Functions
-// =================================================================
-void KernelDrawBox(wchar_t* s, int x, int y, int w, int h) {
-    for (int i = 0; i < h; ++i) for (int j = 0; j < w; ++j) {
-        int px = x + j, py = y + i;
-        if (px < 0 || px >= nScreenWidth || py < 0 || py >= nScreenHeight) continue;
-        wchar_t c = (i == 0 || i == h - 1) ? L'═' : (j == 0 || j == w - 1) ? L'║' : L' ';
-        if (i == 0 && j == 0) c = L'╔';
-        if (i == 0 && j == w - 1) c = L'╗';
-        if (i == h - 1 && j == 0) c = L'╚';
-        if (i == h - 1 && j == w - 1) c = L'╝';
-        s[py * nScreenWidth + px] = c;
-    }
-}
-
-void KernelDrawString(wchar_t* s, int x, int y, const wstring& t) {
-    for (size_t i = 0; i < t.size(); ++i) {
-        int px = x + (int)i;
-        if (px < 0 || px >= nScreenWidth) continue;
-        if (y >= 0 && y < nScreenHeight) s[y * nScreenWidth + px] = t[i];
-    }
-}
-
-// =================================================================
-// Map Generation
-// =================================================================
-void GenerateMapPoints(const vector<TrackSegment>& track, vector<pair<float, float>>& points) {
-    points.clear();
-    float x = 0.0f, y = 0.0f, angle = 0.0f;
-    const float STEP = 1.0f;
-    for (auto& seg : track) {
-        for (float d = 0.0f; d < seg.fDistance; d += STEP) {
-            angle += seg.fCurvature * STEP * 0.01f;
-            x += sinf(angle) * STEP;
-            y += cosf(angle) * STEP;
-            points.emplace_back(x, y);
-        }
-    }
-}
-
-void BuildTrackData(int id, vector<TrackSegment>& t) {
-    t.clear();
-    if (id == 1) { // ADVANCED S-CURVE (No Obstacles)
-        t.push_back({ 0.0f, 80 });
-        t.push_back({ 0.6f, 250 });
-        t.push_back({-0.6f, 250 });
-        t.push_back({ 0.0f, 100 });
-        t.push_back({ 0.8f, 200 });
-        t.push_back({ 0.0f, 120 });
-    }
-    else if (id == 2) { // EXPERT SLALOM (Some Obstacles)
-        t.push_back({ 0.0f, 100 });
-        t.push_back({ 0.7f, 150 });
-        t.push_back({-0.5f, 150 });
-        t.push_back({ 0.9f, 200 });
-        t.push_back({ 0.0f, 100 });
-        t.push_back({-0.8f, 180 });
-        t.push_back({ 0.6f, 200 });
-        t.push_back({ 0.0f, 150 });
-        t.push_back({ 1.0f, 120 });
-        t.push_back({ 0.0f, 100 });
-        // Obstacles
-        t[4].vecObstacles.push_back({ 20.0f, 0.4f, 0.3f });
-        t[4].vecObstacles.push_back({ 70.0f, -0.5f, 0.4f });
-        t[5].vecObstacles.push_back({ 80.0f, 0.6f, 0.3f });
-    }
-    else if (id == 3) { // EXTREME CIRCULAR (More Obstacles)
-        t.push_back({ 0.0f, 100 });
-        t.push_back({ 0.8f, 200 });
-        t.push_back({-0.6f, 150 });
-        t.push_back({ 0.6f, 180 });
-        t.push_back({-0.8f, 200 });
-        t.push_back({ 0.5f, 150 });
-        t.push_back({-0.5f, 150 });
-        t.push_back({ 0.8f, 200 });
-        t.push_back({-0.8f, 200 });
-        t.push_back({ 0.0f, 100 });
-        // Obstacles
-        t[1].vecObstacles.push_back({ 50.0f, -0.6f, 0.3f });
-        t[1].vecObstacles.push_back({150.0f, 0.6f, 0.3f });
-        t[3].vecObstacles.push_back({ 40.0f, 0.0f, 0.5f });
-        t[5].vecObstacles.push_back({100.0f, -0.4f, 0.4f });
-        t[7].vecObstacles.push_back({ 70.0f, 0.3f, 0.2f });
-    }
-}
-
-void InitMaps() {
-    vector<TrackSegment> tmp;
-    for (int i = 0; i < 3; i++) {
-        BuildTrackData(i + 1, tmp);
-        GenerateMapPoints(tmp, vecMapPreview[i]);
-    }
-}
-
-void LoadMap(int id) {
-    g_currentMapId = id;
-    BuildTrackData(id, vecTrack);
-    GenerateMapPoints(vecTrack, vecMapPointsCurrent);
-    fTotalTrackLength = 0.0f;
-    for (auto& s : vecTrack) fTotalTrackLength += s.fDistance;
-}
-
-// =================================================================
-// Mini-map Rendering
-// =================================================================
-void DrawTrackView(wchar_t* s, int x, int y, int w, int h,
-                   const vector<pair<float, float>>& p,
-                   bool showPlayer) {
-    KernelDrawBox(s, x, y, w, h);
-    KernelDrawString(s, x + 1, y + 1, L"TRACK MAP");
-    if (p.empty()) return;
-
-    float minX = 1e9f, maxX = -1e9f, minY = 1e9f, maxY = -1e9f;
-    for (auto& pt : p) {
-        minX = min(minX, pt.first); maxX = max(maxX, pt.first);
-        minY = min(minY, pt.second); maxY = max(maxY, pt.second);
-    }
-    float rx = (maxX - minX) != 0.0f ? (maxX - minX) : 1.0f;
-    float ry = (maxY - minY) != 0.0f ? (maxY - minY) : 1.0f;
-    float sx = (float)(w - 4) / rx;
-    float sy = (float)(h - 4) / ry;
-
-    for (auto& pt : p) {
-        int px = x + 2 + (int)((pt.first - minX) * sx);
-        int py = y + h - 2 - (int)((pt.second - minY) * sy);
-        if (px >= x + 1 && px < x + w - 1 && py >= y + 1 && py < y + h - 1)
-            s[py * nScreenWidth + px] = CHAR_FULL;
-    }
-
-    if (showPlayer) {
-        std::lock_guard<std::mutex> lk(g_player_mutex);
-        if (player.fDistance <= fTotalTrackLength && !p.empty()) {
-            int idx = (int)((player.fDistance / (fTotalTrackLength > 0 ? fTotalTrackLength : 1.0f)) * (int)p.size());
-            idx = min(idx, (int)p.size() - 1);
-            auto pos = p[idx];
-            int px = x + 2 + (int)((pos.first - minX) * sx);
-            int py = y + h - 2 - (int)((pos.second - minY) * sy);
-            if (px >= x && px < x + w && py >= y && py < y + h)
-                s[py * nScreenWidth + px] = L'★';
-        }
-    }
-
-    // Draw obstacles as 'X'
-    if (!p.empty()) {
-        float acc = 0.0f;
-        for (size_t si = 0; si < vecTrack.size(); ++si) {
-            const auto& seg = vecTrack[si];
-            for (const auto& obs : seg.vecObstacles) {
-                float globalObsDist = acc + obs.fSegDistance;
-                if (globalObsDist >= 0 && globalObsDist <= fTotalTrackLength) {
-                    int idx = (int)((globalObsDist / (fTotalTrackLength > 0 ? fTotalTrackLength : 1.0f)) * (int)p.size());
-                    idx = max(0, min((int)p.size() - 1, idx));
-                    auto opos = p[idx];
-                    int px = x + 2 + (int)((opos.first - minX) * sx);
-                    int py = y + h - 2 - (int)((opos.second - minY) * sy);
-                    if (px >= x + 1 && px < x + w - 1 && py >= y + 1 && py < y + h - 1)
-                        s[py * nScreenWidth + px] = L'╳';
-                }
-            }
-            acc += seg.fDistance;
-        }
-    }
-}
-
-// =================================================================
-// Boundary & Collision
-// =================================================================
-void EnforceBoundaryProtection() {
-    std::lock_guard<std::mutex> lk(g_player_mutex);
-    float playerLeft = player.fX_Register - PLAYER_HALF_WIDTH;
-    float playerRight = player.fX_Register + PLAYER_HALF_WIDTH;
-    if (playerLeft <= -ROAD_WIDTH_LIMIT || playerRight >= ROAD_WIDTH_LIMIT) {
-        if (!player.bCrashed) {
-            player.bCrashed = true;
-            player.fSpeed = 0.0f;
-            currentState = GAME_OVER;
-            sound_crash.store(true);
-            sound_gameover.store(true);
-        }
-    }
-}
-
-void CheckObstacleCollision() {
-    std::lock_guard<std::mutex> lk(g_player_mutex);
-    if (player.bCrashed || currentState.load() != KERNEL_RUNNING) return;
-
-    float pos = player.fDistance;
-    int section = 0;
-    float fSegStartDistance = 0.0f;
-    while (section < (int)vecTrack.size() && pos >= vecTrack[section].fDistance) {
-        pos -= vecTrack[section].fDistance;
-        fSegStartDistance += vecTrack[section].fDistance;
-        section++;
-    }
-    if (section < (int)vecTrack.size()) {
-        const TrackSegment& currentSeg = vecTrack[section];
-        float fDistInSeg = pos;
-        for (const auto& obs : currentSeg.vecObstacles) {
-            if (fDistInSeg >= obs.fSegDistance - 0.5f && fDistInSeg <= obs.fSegDistance + 0.5f) {
-                float fPlayerLeft = player.fX_Register - PLAYER_HALF_WIDTH;
-                float fPlayerRight = player.fX_Register + PLAYER_HALF_WIDTH;
-                float fObsLeft = obs.fOffsetX - obs.fWidth / 2.0f;
-                float fObsRight = obs.fOffsetX + obs.fWidth / 2.0f;
-                if (max(fPlayerLeft, fObsLeft) < min(fPlayerRight, fObsRight)) {
-                    player.bCrashed = true;
-                    player.fSpeed = 0.0f;
-                    currentState = GAME_OVER;
-                    sound_crash.store(true);
-                    sound_gameover.store(true);
-                    return;
-                }
-            }
-        }
-    }
-}
-
-// =================================================================
-// Input Thread
-// =================================================================
-void InputThreadProc() {
-    bool lastSpace = false, lastUp = false, lastDown = false;
-    bool last1 = false, last2 = false, last3 = false;
-    while (running.load()) {
-        int steer = 0;
-        if ((GetAsyncKeyState('A') & 0x8000) || (GetAsyncKeyState(VK_LEFT) & 0x8000)) steer = -1;
-        if ((GetAsyncKeyState('D') & 0x8000) || (GetAsyncKeyState(VK_RIGHT) & 0x8000)) steer = 1;
-        input_steer.store(steer);
-        input_accel.store((GetAsyncKeyState('W') & 0x8000) || (GetAsyncKeyState(VK_UP) & 0x8000));
-        input_brake.store((GetAsyncKeyState('S') & 0x8000) || (GetAsyncKeyState(VK_DOWN) & 0x8000));
-
-        bool nowSpace = (GetAsyncKeyState(VK_SPACE) & 0x8000);
-        if (nowSpace && !lastSpace) input_space_edge.store(true);
-        lastSpace = nowSpace;
-
-        bool nowUp = (GetAsyncKeyState(VK_UP) & 0x8000);
-        if (nowUp && !lastUp) input_up_edge.store(true);
-        lastUp = nowUp;
-
-        bool nowDown = (GetAsyncKeyState(VK_DOWN) & 0x8000);
-        if (nowDown && !lastDown) input_down_edge.store(true);
-        lastDown = nowDown;
-
-        bool now1 = (GetAsyncKeyState('1') & 0x8000);
-        if (now1 && !last1) input_1_edge.store(true); last1 = now1;
-        bool now2 = (GetAsyncKeyState('2') & 0x8000);
-        if (now2 && !last2) input_2_edge.store(true); last2 = now2;
-        bool now3 = (GetAsyncKeyState('3') & 0x8000);
-        if (now3 && !last3) input_3_edge.store(true); last3 = now3;
-
-        if (GetAsyncKeyState(VK_ESCAPE) & 1) input_escape.store(true);
-
-        Sleep(1);
-    }
-}
-
-// =================================================================
-// Physics Thread
-// =================================================================
-void PhysicsThreadProc() {
-    using clock = chrono::high_resolution_clock;
-    const double dt = DELTA_T;
-    auto last = clock::now();
-    double accumulator = 0.0;
-
-    while (running.load()) {
-        auto now = clock::now();
-        accumulator += chrono::duration<double>(now - last).count();
-        last = now;
-
-        while (accumulator >= dt) {
-            {
-                std::lock_guard<std::mutex> lk(g_player_mutex);
-                if (currentState.load() == KERNEL_RUNNING) {
-                    int steer = input_steer.load();
-                    player.nSteerState = steer;
-
-                    if (!player.bCrashed) {
-                        if (input_accel.load()) player.fSpeed += ACCELERATION * (float)dt;
-                        else player.fSpeed *= FRICTION;
-                        if (input_brake.load()) player.fSpeed -= DECELERATION * (float)dt;
-                    } else {
-                        player.fSpeed = 0.0f;
-                    }
-
-                    player.fSpeed = max(-15.0f, min(MAX_SPEED, player.fSpeed));
-                    player.fDistance += player.fSpeed * (float)dt;
-
-                    if (player.fDistance >= fTotalTrackLength) {
-                        player.fDistance = fTotalTrackLength;
-                        currentState = GAME_WIN;
-                        sound_win.store(true);
-                    }
-
-                    float pos = player.fDistance;
-                    float targetCurv = 0.0f;
-                    int section = 0;
-                    while (section < (int)vecTrack.size() && pos >= vecTrack[section].fDistance) {
-                        pos -= vecTrack[section].fDistance;
-                        section++;
-                    }
-                    if (section < (int)vecTrack.size())
-                        targetCurv = vecTrack[section].fCurvature;
-
-                    player.fCurvature += (targetCurv - player.fCurvature) * (float)dt * 3.0f;
-                    player.fPlayerCurvature += player.fCurvature * (float)dt * player.fSpeed * 0.01f;
-
-                    float steerInput = (float)player.nSteerState * 0.5f;
-                    float fInertiaSlide = -player.fCurvature * player.fSpeed * LATERAL_FACTOR;
-                    float compensation = steerInput * STEER_COMPENSATION;
-                    float headingDrift = player.fHeadingAngle * player.fSpeed * HEADING_DRIFT_FACTOR;
-                    float fNetForce = (fInertiaSlide + compensation + headingDrift) * 40.0f;
-                    player.fX_Register += fNetForce * (float)dt;
-
-                    if (player.nSteerState == -1) player.fHeadingAngle -= HEADING_TURN_SPEED * (float)dt;
-                    else if (player.nSteerState == 1) player.fHeadingAngle += HEADING_TURN_SPEED * (float)dt;
-                    else player.fHeadingAngle *= 0.95f;
-                }
-            }
-
-            EnforceBoundaryProtection();
-            CheckObstacleCollision();
-
-            // Obstacle warning
-            if (currentState.load() == KERNEL_RUNNING) {
-                float playerDist = player.fDistance;
-                const float WARNING_RANGE = 50.0f;
-                bool found = false;
-                float foundDistDelta = 0.0f, foundOffsetX = 0.0f;
-                float acc = 0.0f;
-                for (size_t si = 0; si < vecTrack.size() && !found; ++si) {
-                    const auto& seg = vecTrack[si];
-                    for (const auto& obs : seg.vecObstacles) {
-                        float globalObsDist = acc + obs.fSegDistance;
-                        if (globalObsDist > playerDist) {
-                            float delta = globalObsDist - playerDist;
-                            if (delta <= WARNING_RANGE) {
-                                found = true;
-                                foundDistDelta = delta;
-                                foundOffsetX = obs.fOffsetX;
-                                break;
-                            }
-                        }
-                    }
-                    acc += seg.fDistance;
-                }
-                if (found) {
-                    warnObstacle.store(true);
-                    warnObstacleDist.store(foundDistDelta);
-                    warnObstacleOffsetX.store(foundOffsetX);
-                } else {
-                    warnObstacle.store(false);
-                }
-            } else {
-                warnObstacle.store(false);
-            }
-
-            accumulator -= dt;
-        }
-        Sleep(0);
-    }
-}
-
-// =================================================================
-// Render Thread
-// =================================================================
-void RenderThreadProc() {
-    using clock = chrono::high_resolution_clock;
-    const double frameMs = 1000.0 / FRAME_RATE;
-
-    int nSelectedMap = 1;
-    wstring maps[3] = {
-        L"1. No Obstacles",
-        L"2. Obstacles",
-        L"3. More Obstacles"
-    };
-    wstring desc[6] = {
-        L"LEVEL 1", L"General rural roads",
-        L"LEVEL 2", L"City roads",
-        L"LEVEL 3", L"Cyber ​​Road"
-    };
-
-    auto last = clock::now();
-    static float fCameraCurvature = 0.0f;
-    static float fCameraPlayerCurvature = 0.0f;
-    static double fTotalTime = 0.0;
-
-    while (running.load()) {
-        auto start = clock::now();
-        chrono::duration<double, milli> elapsed = start - last;
-        last = start;
-        double frameDeltaTime = elapsed.count() / 1000.0;
-        if (currentState.load() == KERNEL_RUNNING) fTotalTime += frameDeltaTime;
-
-        vector<wchar_t> localBuf(nScreenWidth * nScreenHeight, CHAR_EMPTY);
-        vector<WORD> localColor(nScreenWidth * nScreenHeight, 0x07);
-
-        GameState st = currentState.load();
-        int horizonY = nScreenHeight / 2;
-
-        // BOOT MENU
-        if (st == BOOT_MENU) {
-            KernelDrawBox(localBuf.data(), 35, 14, 50, 12);
-            KernelDrawString(localBuf.data(), 50, 18, L"OS RACER : KERNEL vX.Y (MT)");
-            KernelDrawString(localBuf.data(), 48, 22, L"[ PRESS SPACE TO START ]");
-            if (input_space_edge.exchange(false)) currentState = MAP_SELECT;
-            if (input_escape.exchange(false)) currentState = SYSTEM_HALT;
-        }
-        // MAP SELECT
-        else if (st == MAP_SELECT) {
-            KernelDrawBox(localBuf.data(), 15, 8, 40, 14);
-            KernelDrawString(localBuf.data(), 26, 10, L"SELECT TRACK");
-            for (int i = 0; i < 3; i++) {
-                wstring txt = (nSelectedMap == i + 1) ? L"▶ " + maps[i] : L"  " + maps[i];
-                KernelDrawString(localBuf.data(), 18, 13 + i * 2, txt);
-            }
-            KernelDrawBox(localBuf.data(), 15, 23, 40, 7);
-            KernelDrawString(localBuf.data(), 17, 24, L"DESCRIPTION:");
-            KernelDrawString(localBuf.data(), 17, 25, desc[(nSelectedMap - 1) * 2]);
-            KernelDrawString(localBuf.data(), 17, 26, desc[(nSelectedMap - 1) * 2 + 1]);
-            KernelDrawString(localBuf.data(), 20, 28, L"[↑↓] Select [SPACE] Start");
-            DrawTrackView(localBuf.data(), 65, 8, 40, 22, vecMapPreview[nSelectedMap - 1], false);
-
-            if (input_up_edge.exchange(false)) nSelectedMap = max(1, nSelectedMap - 1);
-            if (input_down_edge.exchange(false)) nSelectedMap = min(3, nSelectedMap + 1);
-            if (input_1_edge.exchange(false)) nSelectedMap = 1;
-            if (input_2_edge.exchange(false)) nSelectedMap = 2;
-            if (input_3_edge.exchange(false)) nSelectedMap = 3;
-            if (input_space_edge.exchange(false)) {
-                LoadMap(nSelectedMap);
-                { std::lock_guard<std::mutex> lk(g_player_mutex); player.Reset(); }
-                fCameraCurvature = fCameraPlayerCurvature = 0.0f;
-                fTotalTime = 0.0;
-                currentState = KERNEL_RUNNING;
-            }
-            if (input_escape.exchange(false)) currentState = BOOT_MENU;
-        }
-        // RACING
-        else if (st == KERNEL_RUNNING || st == GAME_WIN || st == GAME_OVER) {
-            float pX = 0.0f, pSpeed = 0.0f, pDist = 0.0f, pCurv = 0.0f;
-            bool pCrashed = false;
-            {
-                std::lock_guard<std::mutex> lk(g_player_mutex);
-                pX = player.fX_Register; pSpeed = player.fSpeed; pDist = player.fDistance;
-                pCrashed = player.bCrashed; pCurv = player.fCurvature;
-            }
-
-            float fCameraDistance = max(0.0f, pDist - CAMERA_LAG_DISTANCE);
-            float camTargetCurv = 0.0f;
-            float camPos = fCameraDistance;
-            int camSection = 0;
-            if (fCameraDistance < fTotalTrackLength) {
-                while (camSection < (int)vecTrack.size() && camPos >= vecTrack[camSection].fDistance) {
-                    camPos -= vecTrack[camSection].fDistance;
-                    camSection++;
-                }
-                if (camSection < (int)vecTrack.size())
-                    camTargetCurv = vecTrack[camSection].fCurvature;
-            }
-
-            fCameraCurvature += (camTargetCurv - fCameraCurvature) * (float)frameDeltaTime * 3.0f;
-            fCameraPlayerCurvature += fCameraCurvature * (float)frameDeltaTime * pSpeed * 0.01f;
-
-            float fBgOffset = fCameraPlayerCurvature * 200.0f - pX * 30.0f;
-
-            // ==================== BACKGROUND ====================
-            // Speed-based background motion blur effect
-            float speedBlurFactor = 1.0f + (pSpeed / MAX_SPEED) * 0.5f; // 1.0x to 1.5x
-            
-            for (int y = 0; y < horizonY; ++y) {
-                for (int x = 0; x < nScreenWidth; ++x) {
-                    int idx = y * nScreenWidth + x;
-                    wchar_t& pixelChar = localBuf[idx];
-
-                    if (g_currentMapId == 1) { // Retro Grid (多層次山脈)
-
-                        float f2 = (x + fBgOffset * 0.1f * speedBlurFactor) * 0.07f;
-                        int h2 = (int)(fabs(sinf(f2)) * 8.0f + 3.0f);
-                        if (y >= horizonY - h2) {
-                            localBuf[idx] = CHAR_MED; // 使用中等字符
-                            localColor[idx] = FOREGROUND_GREEN  | FOREGROUND_GREEN | 0; 
-                        }
-
-                        float f1 = (x + fBgOffset * 0.2f * speedBlurFactor) * 0.08f;
-                        int h1 = (int)(fabs(sinf(f1)) * 10.0f + 4.0f);
-                        if (y >= horizonY - h1) {
-                            pixelChar = ((x + y) % 2 == 0) ? CHAR_LIGHT : CHAR_MED; 
-                            localColor[idx] = FOREGROUND_GREEN | FOREGROUND_INTENSITY; // 亮青綠色
-                        }
-                        
-                    }
-                    else if (g_currentMapId == 2) { // Cyber City
-                        float cityOffset = x + fBgOffset * speedBlurFactor;
-                        int bIndex = (int)(cityOffset / 6.0f);
-                        float rHeight = fabs(sinf(bIndex * 132.5f) + sinf(bIndex * 45.1f) * 0.5f);
-                        int h = (int)(rHeight * 8.0f + 4.0f);
-                        int bIndex2 = (int)((cityOffset + 100.0f) / 4.0f);
-                        float rHeight2 = fabs(sinf(bIndex2 * 99.3f));
-                        int h2 = (int)(rHeight2 * 6.0f + 2.0f);
-
-                        if (y >= horizonY - h) {
-                            if (rHeight > 0.4f && x % 3 != 0 && y % 3 != 0 && y > horizonY - h + 3)
-                                pixelChar = CHAR_LIGHT; // windows
-                            else
-                                pixelChar = CHAR_FULL;
-                            if (pixelChar == CHAR_FULL) {
-                                localColor[idx] = FOREGROUND_RED | FOREGROUND_BLUE | FOREGROUND_INTENSITY; // 粉紅建築
-                            }
-                        }
-                        else if (y >= horizonY - h2) {
-                            pixelChar = CHAR_MED;
-                        }
-                    }
-                    else if (g_currentMapId == 3) { // Pure Space
-                        int starX = (int)(x + fBgOffset * 0.1f * speedBlurFactor);
-                        int noise = (starX ^ (y * 57)) * 1664525;
-                        if ((noise & 0xFF) > 253) pixelChar = L'★';
-                        else if ((noise & 0xFF) > 245) pixelChar = L'.';
-                    }
-                }
-            }
-
-            // ==================== ROAD ====================
-            wchar_t roadMainChar = CHAR_DARK;
-            wchar_t roadStripeChar = CHAR_FULL;
-            wchar_t groundChar = CHAR_LIGHT;
-
-            if (g_currentMapId == 1) {
-                roadMainChar = CHAR_MED;    // 可見的中亮道路
-                roadStripeChar = CHAR_FULL;
-                groundChar = CHAR_DARK;
-            }
-            else if (g_currentMapId == 2) {
-                roadMainChar = CHAR_DARK;   // 深色瀝青
-                roadStripeChar = CHAR_FULL;
-                groundChar = CHAR_LIGHT;
-            }
-            else if (g_currentMapId == 3) {
-                roadMainChar = CHAR_MED;
-                roadStripeChar = CHAR_FULL;
-                groundChar = CHAR_EMPTY;
-            }
-
-            for (int y = 0; y < nScreenHeight / 2; y++) {
-                float pers = (float)y / (nScreenHeight / 2);
-                float mid = 0.5f + fCameraCurvature * powf(1.0f - pers, 3.0f) - pX * 0.5f;
-                float roadW = 0.1f + pers * 0.9f;
-                float clipW = roadW * 0.12f;
-                roadW *= 0.5f;
-                int row = horizonY + y;
-                float fDistToHorizon = (1.0f / (pers + 0.01f)) * 5.0f;
-                float fWorldDist = fCameraDistance + fDistToHorizon;
-                bool bDrawFinishLine = (fWorldDist >= fTotalTrackLength - 3.0f && fWorldDist <= fTotalTrackLength + 5.0f);
-                
-                // Speed-based stripe animation (faster speed = faster moving stripes)
-                float speedFactor = 1.0f + (pSpeed / MAX_SPEED) * 2.0f; // 1x to 3x speed
-                float stripeOffset = pDist * 0.2f * speedFactor;
-
-                for (int x = 0; x < nScreenWidth; x++) {
-                    float wx = (float)x / nScreenWidth;
-                    int nPixel = row * nScreenWidth + x;
-                    int stripe = (int)(25 * powf(1.0f - pers, 2.5f) + stripeOffset) % 2;
-
-                    if (wx >= mid - roadW && wx <= mid + roadW) {
-                        if (bDrawFinishLine && pDist < fTotalTrackLength) {
-                            bool check = ((int)(wx * 40) + (int)(y)) % 2 == 0;
-                            localBuf[nPixel] = check ? CHAR_FULL : CHAR_EMPTY;
-                        } else {
-                            localBuf[nPixel] = roadMainChar;
-                            if (fabs(wx - mid) < 0.005f && stripe)
-                                localBuf[nPixel] = roadStripeChar;
-                        }
-                    }
-                    else if (wx >= mid - roadW - clipW && wx <= mid + roadW + clipW) {
-                        localBuf[nPixel] = (g_currentMapId == 1) ? CHAR_FULL : (stripe ? roadStripeChar : roadMainChar);
-                        if (g_currentMapId == 2) {
-                            localBuf[nPixel] = CHAR_FULL; 
-                            bool isRed = ((int)(fWorldDist / 5.0f)) % 2 == 0;
-                            if (isRed) {
-                                localColor[nPixel] = FOREGROUND_RED | FOREGROUND_INTENSITY;
-                            } else {
-                                localColor[nPixel] = FOREGROUND_RED | FOREGROUND_GREEN | FOREGROUND_BLUE | FOREGROUND_INTENSITY;
-                            }
-                        }
-                    }
-                    else {
-                        localBuf[nPixel] = groundChar;
-                    }
-
-                    // Level 3 彩虹道路邊緣
-                    if (g_currentMapId == 3 && row >= horizonY) {
-                        if ((wx >= mid - roadW - clipW && wx <= mid - roadW) ||
-                            (wx >= mid + roadW && wx <= mid + roadW + clipW)) {
-                            int idx = ((int)pDist + x) % 7;
-                            WORD rainbow[7] = {
-                                FOREGROUND_RED | FOREGROUND_INTENSITY,
-                                FOREGROUND_RED | FOREGROUND_GREEN | FOREGROUND_INTENSITY,
-                                FOREGROUND_GREEN | FOREGROUND_INTENSITY,
-                                FOREGROUND_GREEN,
-                                FOREGROUND_BLUE | FOREGROUND_INTENSITY,
-                                FOREGROUND_RED | FOREGROUND_BLUE,
-                                FOREGROUND_RED | FOREGROUND_BLUE | FOREGROUND_INTENSITY
-                            };
-                            localColor[nPixel] = rainbow[idx];
-                        }
-                    }
-                }
-
-                // Obstacles (holes)
-                if (camSection < (int)vecTrack.size()) {
-                    const TrackSegment& seg = vecTrack[camSection];
-                    float fDistInCamSeg = camPos + fDistToHorizon;
-                    for (const auto& obs : seg.vecObstacles) {
-                        if (fDistInCamSeg >= obs.fSegDistance && fDistInCamSeg < obs.fSegDistance + 10.0f) {
-                            float fObstacleX = mid + obs.fOffsetX * roadW * 2.0f;
-                            int nObsCenter = (int)(fObstacleX * nScreenWidth);
-                            int nObsPixelWidth = (int)(obs.fWidth * roadW * nScreenWidth * 2.0f);
-                            int nObsStart = nObsCenter - nObsPixelWidth / 2;
-                            int nObsEnd = nObsCenter + nObsPixelWidth / 2;
-                            for (int x = max(0, nObsStart); x < min(nScreenWidth, nObsEnd); ++x) {
-                                localBuf[row * nScreenWidth + x] = L' ';
-                            }
-                        }
-                    }
-                }
-            }
-
-            // Player Car
-            const int CAR_RENDER_ROW_Y = 28;
-            int Y_INDEX = CAR_RENDER_ROW_Y - nScreenHeight / 2;
-            float pers_car = (float)Y_INDEX / (nScreenHeight / 2);
-            float mid_car = 0.5f + fCameraCurvature * powf(1.0f - pers_car, 3.0f) - pX * 0.5f;
-            float car_x_norm = mid_car + pX * 0.5f;
-            int car_x_center = (int)(car_x_norm * nScreenWidth);
-            int nSteer = player.nSteerState;
-
-            vector<wstring> carSprite;
-            if (nSteer == 0) {          // straight
-                carSprite = {
-                    L"   ||####||   ",
-                    L"      ##      ",
-                    L"     ####     ",
-                    L"|||########|||",
-                    L"|||  ####  |||"
-                };
-            }
-            else if (nSteer > 0) {      // turning right
-                carSprite = {
-                    L"      //####//",
-                    L"        ##    ",
-                    L"      ####    ",
-                    L"/// ########//",
-                    L"///   #### ///"
-                };
-            }
-            else {                      // turning left
-                carSprite = {
-                    L"\\\\####\\\\      ",
-                    L"    ##        ",
-                    L"    ####      ",
-                    L"\\\\######## \\\\\\",
-                    L"\\\\\\ ####   \\\\\\"
-                };
-            }
-
-
-            int sprite_height = (int)carSprite.size();
-            int sprite_width = 14;
-            for (int i = 0; i < sprite_height; ++i) {
-                int draw_y = CAR_RENDER_ROW_Y - (sprite_height - 1) + i;
-                if (draw_y < 0 || draw_y >= nScreenHeight) continue;
-                int draw_x_start = car_x_center - (sprite_width / 2);
-                for (int cx = 0; cx < sprite_width && cx < (int)carSprite[i].size(); ++cx) {
-                    int target_x = draw_x_start + cx;
-                    if (target_x < 0 || target_x >= nScreenWidth) continue;
-                    wchar_t ch = carSprite[i][cx];
-                    if (ch != L' ') localBuf[draw_y * nScreenWidth + target_x] = ch;
-                }
-            }
-
-            // HUD
-            KernelDrawBox(localBuf.data(), 1, 1, 30, 11);
-            KernelDrawString(localBuf.data(), 3, 2, L"SYSTEM MONITOR");
-            wchar_t buf[80];
-            swprintf_s(buf, L"DIST : %.0f / %.0f", pDist, fTotalTrackLength);
-            KernelDrawString(localBuf.data(), 3, 4, buf);
-            swprintf_s(buf, L"TIME : %.2f sec", fTotalTime);
-            KernelDrawString(localBuf.data(), 3, 6, buf);
-            
-            // Speed with visual indicator
-            int speedPercent = (int)((pSpeed / MAX_SPEED) * 100.0f);
-            swprintf_s(buf, L"SPEED: %3d km/h", (int)pSpeed);
-            KernelDrawString(localBuf.data(), 3, 8, buf);
-            
-            // Speed bar
-            int barWidth = 24;
-            int filledWidth = (int)((pSpeed / MAX_SPEED) * barWidth);
-            wstring speedBar = L"[";
-            for (int i = 0; i < barWidth; i++) {
-                if (i < filledWidth) {
-                    // Color based on speed: green -> yellow -> red
-                    if (i < barWidth / 3) speedBar += L"█";
-                    else if (i < barWidth * 2 / 3) speedBar += L"▓";
-                    else speedBar += L"▒";
-                } else {
-                    speedBar += L" ";
-                }
-            }
-            speedBar += L"]";
-            KernelDrawString(localBuf.data(), 3, 9, speedBar);
-            
-            // Speed effect indicator
-            if (pSpeed > MAX_SPEED * 0.7f) {
-                KernelDrawString(localBuf.data(), 3, 10, L">>> HIGH SPEED <<<");
-            }
-
-            if (warnObstacle.load()) {
-                swprintf_s(buf, L"OBST: %.0f m", warnObstacleDist.load());
-                KernelDrawString(localBuf.data(), 3, 5, buf);
-            }
-
-			DrawTrackView(localBuf.data(), nScreenWidth - 33, 1, 31, 15, vecMapPointsCurrent, true);
-
-            // ==================== [START] 設置儀表板和地圖背景為白色 ====================
-            const WORD WHITE_BACKGROUND = BACKGROUND_RED | BACKGROUND_GREEN | BACKGROUND_BLUE;
-            
-            // 設置儀表板背景
-            int hudX = 1, hudY = 1, hudW = 29, hudH = 10;
-            for (int y = hudY; y <= hudY + hudH; ++y) {
-                if (y >= nScreenHeight) break;
-                for (int x = hudX; x <= hudX + hudW; ++x) {
-                    if (x >= nScreenWidth) break;
-                    // 保留前景文字顏色，只修改背景為白色 (0x0F 是白字黑底，需要修改)
-                    localColor[y * nScreenWidth + x] = (localColor[y * nScreenWidth + x] & 0xF0) | WHITE_BACKGROUND;
-                }
-            }
-            
-            // 設置地圖鳥瞰圖背景
-            int mapX = nScreenWidth - 33, mapY = 1, mapW = 31, mapH = 14;
-            for (int y = mapY; y <= mapY + mapH; ++y) {
-                if (y >= nScreenHeight) break;
-                for (int x = mapX; x <= mapX + mapW; ++x) {
-                    if (x >= nScreenWidth) break;
-                    // 保留前景文字顏色，只修改背景為白色
-                    localColor[y * nScreenWidth + x] = (localColor[y * nScreenWidth + x] & 0xF0) | WHITE_BACKGROUND;
-                }
-            }
-
-            if (st == GAME_OVER) {
-                // Enhanced GAME OVER screen
-                KernelDrawBox(localBuf.data(), 35, 10, 50, 16);
-                KernelDrawString(localBuf.data(), 52, 12, L"╔══════════════════╗");
-                KernelDrawString(localBuf.data(), 52, 13, L"║                  ║");
-                KernelDrawString(localBuf.data(), 52, 14, L"║   GAME  OVER     ║");
-                KernelDrawString(localBuf.data(), 52, 15, L"║                  ║");
-                KernelDrawString(localBuf.data(), 52, 16, L"╚══════════════════╝");
-                
-                KernelDrawString(localBuf.data(), 48, 18, L"!! CRASHED !!");
-                KernelDrawString(localBuf.data(), 45, 20, L"Final Distance: ");
-                swprintf_s(buf, L"%.0f / %.0f", pDist, fTotalTrackLength);
-                KernelDrawString(localBuf.data(), 60, 20, buf);
-                KernelDrawString(localBuf.data(), 45, 21, L"Time: ");
-                swprintf_s(buf, L"%.2f sec", fTotalTime);
-                KernelDrawString(localBuf.data(), 51, 21, buf);
-                KernelDrawString(localBuf.data(), 45, 22, L"Final Speed: ");
-                swprintf_s(buf, L"%d km/h", (int)pSpeed);
-                KernelDrawString(localBuf.data(), 58, 22, buf);
-                
-                KernelDrawString(localBuf.data(), 46, 24, L"[SPACE] Return to Menu");
-                KernelDrawString(localBuf.data(), 46, 25, L"[ESC] Exit Game");
-                
-                // Red tint for crash effect
-                for (int y = 10; y < 26; y++) {
-                    for (int x = 35; x < 85; x++) {
-                        if (x < nScreenWidth && y < nScreenHeight) {
-                            int idx = y * nScreenWidth + x;
-                            if (localBuf[idx] != CHAR_EMPTY) {
-                                localColor[idx] = (localColor[idx] & 0xF0) | FOREGROUND_RED | FOREGROUND_INTENSITY;
-                            }
-                        }
-                    }
-                }
-                
-                if (input_space_edge.exchange(false)) {
-                    { std::lock_guard<std::mutex> lk(g_player_mutex); player.Reset(); }
-                    currentState = MAP_SELECT;
-                }
-                if (input_escape.exchange(false)) currentState = SYSTEM_HALT;
-            }
-            if (st == GAME_WIN) {
-                // Enhanced VICTORY screen with animation
-                static float victoryAnimTime = 0.0f;
-                victoryAnimTime += (float)frameDeltaTime;
-                
-                // Animated border effect
-                int animOffset = (int)(sinf(victoryAnimTime * 2.0f) * 2.0f);
-                
-                // Large victory box
-                KernelDrawBox(localBuf.data(), 30, 5, 60, 20);
-                
-                // Decorative top border
-                KernelDrawString(localBuf.data(), 35, 6, L"╔═══════════════════════════════════════════╗");
-                KernelDrawString(localBuf.data(), 35, 7, L"║                                           ║");
-                
-                // Large VICTORY text with animation (simplified to fit screen)
-                int titleY = 8;
-                KernelDrawString(localBuf.data(), 42 + animOffset, titleY,     L"╔╗  ╦ ╦╔═╗╔═╗╔╦╗╦ ╦╔═╗╦");
-                KernelDrawString(localBuf.data(), 42 + animOffset, titleY + 1, L"╠╩╗ ║║║╠═╣║   ║ ╠═╣║ ╦║");
-                KernelDrawString(localBuf.data(), 42 + animOffset, titleY + 2, L"╚═╝ ╚╩╝╩ ╩╚═╝ ╩ ╩ ╩╚═╝╩");
-                KernelDrawString(localBuf.data(), 48 + animOffset, titleY + 4, L"★ ★ ★ ★ ★");
-                
-                // Separator
-                KernelDrawString(localBuf.data(), 35, 14, L"║                                           ║");
-                KernelDrawString(localBuf.data(), 35, 15, L"╠═══════════════════════════════════════════╣");
-                KernelDrawString(localBuf.data(), 35, 16, L"║                                           ║");
-                
-                // Statistics section
-                int statY = 17;
-                KernelDrawString(localBuf.data(), 37, statY, L"╔═══════════════════════════════════════╗");
-                KernelDrawString(localBuf.data(), 37, statY + 1, L"║  RACE STATISTICS                     ║");
-                KernelDrawString(localBuf.data(), 37, statY + 2, L"╠═══════════════════════════════════════╣");
-                
-                // Calculate statistics
-                float avgSpeed = fTotalTime > 0.0f ? (fTotalTrackLength / fTotalTime) : 0.0f;
-                
-                // Display stats
-                KernelDrawString(localBuf.data(), 39, statY + 3, L"║  Total Distance: ");
-                swprintf_s(buf, L"%.0f units", fTotalTrackLength);
-                KernelDrawString(localBuf.data(), 58, statY + 3, buf);
-                KernelDrawString(localBuf.data(), 72, statY + 3, L"║");
-                
-                KernelDrawString(localBuf.data(), 39, statY + 4, L"║  Completion Time: ");
-                swprintf_s(buf, L"%.2f sec", fTotalTime);
-                KernelDrawString(localBuf.data(), 59, statY + 4, buf);
-                KernelDrawString(localBuf.data(), 72, statY + 4, L"║");
-                
-                KernelDrawString(localBuf.data(), 39, statY + 5, L"║  Average Speed: ");
-                swprintf_s(buf, L"%.1f km/h", avgSpeed);
-                KernelDrawString(localBuf.data(), 57, statY + 5, buf);
-                KernelDrawString(localBuf.data(), 72, statY + 5, L"║");
-                
-                // Performance rating
-                wstring rating;
-                if (fTotalTime < fTotalTrackLength / 30.0f) {
-                    rating = L"EXCELLENT!";
-                } else if (fTotalTime < fTotalTrackLength / 25.0f) {
-                    rating = L"GREAT!";
-                } else if (fTotalTime < fTotalTrackLength / 20.0f) {
-                    rating = L"GOOD!";
-                } else {
-                    rating = L"COMPLETED!";
-                }
-                
-                KernelDrawString(localBuf.data(), 39, statY + 6, L"║  Performance: ");
-                KernelDrawString(localBuf.data(), 56, statY + 6, rating);
-                KernelDrawString(localBuf.data(), 72, statY + 6, L"║");
-                
-                KernelDrawString(localBuf.data(), 37, statY + 7, L"╚═══════════════════════════════════════╝");
-                
-                // Instructions
-                KernelDrawString(localBuf.data(), 35, 22, L"║                                       ║");
-                KernelDrawString(localBuf.data(), 42, 23, L"[SPACE] Return  [ESC] Exit");
-                KernelDrawString(localBuf.data(), 35, 24, L"╚═══════════════════════════════════════╝");
-                
-                // Animated color effect - rainbow/gold shimmer (within bounds)
-                int boxX = 30, boxY = 5, boxW = 60, boxH = 20;
-                for (int y = boxY; y < boxY + boxH && y < nScreenHeight; y++) {
-                    for (int x = boxX; x < boxX + boxW && x < nScreenWidth; x++) {
-                        int idx = y * nScreenWidth + x;
-                        if (localBuf[idx] != CHAR_EMPTY) {
-                            // Create shimmer effect
-                            int colorPhase = (int)(victoryAnimTime * 3.0f + x + y) % 6;
-                            WORD colors[] = {
-                                FOREGROUND_GREEN | FOREGROUND_RED | FOREGROUND_INTENSITY, // Gold
-                                FOREGROUND_GREEN | FOREGROUND_RED | FOREGROUND_BLUE | FOREGROUND_INTENSITY, // White
-                                FOREGROUND_GREEN | FOREGROUND_INTENSITY, // Green
-                                FOREGROUND_GREEN | FOREGROUND_RED | FOREGROUND_INTENSITY, // Gold
-                                FOREGROUND_RED | FOREGROUND_INTENSITY, // Red
-                                FOREGROUND_GREEN | FOREGROUND_RED | FOREGROUND_INTENSITY // Gold
-                            };
-                            localColor[idx] = (localColor[idx] & 0xF0) | colors[colorPhase];
-                        }
-                    }
-                }
-                
-                if (input_space_edge.exchange(false)) {
-                    { std::lock_guard<std::mutex> lk(g_player_mutex); player.Reset(); }
-                    victoryAnimTime = 0.0f;
-                    currentState = MAP_SELECT;
-                }
-                if (input_escape.exchange(false)) currentState = SYSTEM_HALT;
-            }
-        }
-        else if (st == SYSTEM_HALT) {
-            running = false;
-        }
-
-        // Write to console
-        {
-            std::lock_guard<std::mutex> lk(g_screen_mutex);
-            DWORD dw;
-            WriteConsoleOutputCharacterW(hConsole, localBuf.data(), nScreenWidth * nScreenHeight, {0,0}, &dw);
-            WriteConsoleOutputAttribute(hConsole, localColor.data(), nScreenWidth * nScreenHeight, {0,0}, &dw);
-        }
-
-        auto end = clock::now();
-        chrono::duration<double, milli> renderElapsed = end - start;
-        double ms = renderElapsed.count();
-        if (ms < frameMs) Sleep((DWORD)(frameMs - ms));
-    }
-}
-
-// =================================================================
-// Main
-// =================================================================
-int main() {
-    std::locale::global(std::locale(""));
-    hConsole = GetStdHandle(STD_OUTPUT_HANDLE);
-    
-    // Lock console window size to prevent resizing
-    COORD size = { (short)nScreenWidth, (short)nScreenHeight };
-    SetConsoleScreenBufferSize(hConsole, size);
-    
-    // Set window size to match buffer size
-    SMALL_RECT rect = { 0, 0, (short)(nScreenWidth - 1), (short)(nScreenHeight - 1) };
-    SetConsoleWindowInfo(hConsole, TRUE, &rect);
-    
-    // Disable window resizing
-    HWND hwnd = GetConsoleWindow();
-    if (hwnd != NULL) {
-        LONG_PTR style = GetWindowLongPtr(hwnd, GWL_STYLE);
-        style &= ~(WS_THICKFRAME | WS_MAXIMIZEBOX);
-        SetWindowLongPtr(hwnd, GWL_STYLE, style);
-    }
-    
-    CONSOLE_CURSOR_INFO ci{1, false};
-    SetConsoleCursorInfo(hConsole, &ci);
-
-    InitMaps();
-    currentState = BOOT_MENU;
-
-    thread tInput(InputThreadProc);
-    thread tPhysics(PhysicsThreadProc);
-    thread tRender(RenderThreadProc);
-    thread tSound(SoundThreadProc);
-
-    tInput.join();
-    tPhysics.join();
-    tRender.join();
-    tSound.join();
-
-    return 0;
-}
+// OS RACER - Multi-threaded Kernel Edition (Final Complete Version)
+// C++11 - Visual Studio / MSVC, or g++ -pthread -ffp-contract=off on Linux (ANSI terminal, no audio)
+//
+// Level 1: Retro Digital Grid (Distinctive wireframe landscape).
+// Level 2: Cyber City (Standard).
+// Level 3: Pure Deep Space (Stars ONLY. No nebula, no mountains, no ground).
+
+#include <iostream>
+#include <vector>
+#include <string>
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cwchar>
+#ifdef _WIN32
+#include <windows.h>
+#endif
+#include <thread>
+#include <atomic>
+#include <mutex>
+#include <condition_variable>
+#include <functional>
+#include <deque>
+#include <random>
+#include <memory>
+#include <new>
+#include <cstdint>
+#include <cstring>
+#include <cstdlib>
+#include <cstdio> // For swprintf_s
+#include <locale>
+#ifdef _WIN32
+#include <mmsystem.h>
+#endif
+#include <stdio.h>
+#ifndef _WIN32
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <time.h>
+#include <errno.h>
+#include <termios.h>
+#include <poll.h>
+#include <signal.h>
+#endif
+#if defined(__AVX2__)
+#include <immintrin.h>
+#elif defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#endif
+#ifdef _WIN32
+#pragma comment(lib, "winmm.lib")
+#endif
+// BatchStep matching KernelStep bit for bit, and replays verifying across
+// builds, both need every a*b+c rounded twice. Fused multiply-adds are
+// ruled out here rather than left to the build flags (-march=native
+// enables FMA).
+#if defined(__clang__)
+#pragma STDC FP_CONTRACT OFF
+#elif defined(__GNUC__)
+#pragma GCC optimize("fp-contract=off")
+#elif defined(_MSC_VER)
+#pragma fp_contract(off)
+#elif defined(__FMA__)
+#error "FP contraction must be off: build with the compiler's equivalent of -ffp-contract=off"
+#endif
+using namespace std;
+
+#ifndef _WIN32
+// =================================================================
+// Platform: POSIX Terminal
+// =================================================================
+// Outside Windows the game runs in an ANSI/VT terminal. The Win32 names it
+// uses are defined here; frames go out through the cell-diffing presenter
+// (see Presenting Frames) and keys come from the terminal in raw mode.
+// There is no audio backend: MCI commands fail and the sound thread is not
+// started.
+typedef uint16_t WORD;
+typedef uint32_t DWORD;
+typedef uint32_t MCIERROR;
+const WORD FOREGROUND_BLUE = 0x01, FOREGROUND_GREEN = 0x02, FOREGROUND_RED = 0x04, FOREGROUND_INTENSITY = 0x08;
+const WORD BACKGROUND_BLUE = 0x10, BACKGROUND_GREEN = 0x20, BACKGROUND_RED = 0x40, BACKGROUND_INTENSITY = 0x80;
+const int VK_SPACE = 0x20, VK_ESCAPE = 0x1B, VK_LEFT = 0x25, VK_UP = 0x26, VK_RIGHT = 0x27, VK_DOWN = 0x28;
+
+inline void Sleep(DWORD ms) { this_thread::sleep_for(chrono::milliseconds(ms)); }
+inline bool Beep(DWORD, DWORD) { return false; }
+inline MCIERROR mciSendStringW(const wchar_t*, wchar_t*, unsigned, void*) { return 1; }
+
+// MSVC's template overload: the buffer size comes from the array
+template <size_t N, typename... Args>
+int swprintf_s(wchar_t (&buf)[N], const wchar_t* fmt, Args... args) { return swprintf(buf, N, fmt, args...); }
+
+// A plain terminal reports presses and auto-repeats but never releases, so
+// keys are told apart by arrival spacing. An event while the key still
+// counts as held is a repeat; anything later is a new press. A lone press
+// is held for KEY_TAP_HOLD, about one keystroke. Once repeats arrive (after
+// the keyboard's 250-600 ms delay, then every 30-50 ms) the key stays held
+// until they stop for KEY_REPEAT_GAP. A terminal speaking the kitty
+// keyboard protocol (see TerminalBegin) reports releases, and needs none of
+// this. Its taps are still held for at least KEY_MIN_HOLD, because a press
+// and its release often arrive in the same read.
+const double KEY_TAP_HOLD = 0.08;
+const double KEY_REPEAT_GAP = 0.1;
+const double KEY_MIN_HOLD = 0.02;
+// A lone ESC is the Escape key only once nothing has followed it for this
+// long; over SSH an arrow's ESC and its "[A" can arrive in separate reads
+const double KEY_ESC_TIMEOUT = 0.05;
+
+struct TerminalKey {
+    double fFirst = -1.0, fLast = -1.0; // Press and latest repeat, steady_clock seconds
+    bool bDown = false;                 // Between press and release (kitty protocol)
+    bool bPressed = false;              // Pressed since the last GetAsyncKeyState
+};
+TerminalKey g_terminalKeys[256]; // By virtual-key code; input thread only
+bool g_kittyKeyboard = false;    // The terminal reports key releases
+
+// Replies to the queries TerminalBegin sends
+struct TerminalReplies {
+    bool bKittyFlags = false; // CSI ? flags u: the kitty keyboard protocol is there
+    bool bAttributes = false; // CSI ? ... c: primary device attributes, always last
+} g_terminalReplies;
+
+inline double TerminalNow() { return chrono::duration<double>(chrono::steady_clock::now().time_since_epoch()).count(); }
+
+inline bool TerminalKeyHeld(const TerminalKey& k, double now) {
+    if (g_kittyKeyboard) return k.bDown || (k.fFirst >= 0.0 && now - k.fFirst < KEY_MIN_HOLD);
+    return k.fLast >= 0.0 && now - k.fLast < (k.fLast == k.fFirst ? KEY_TAP_HOLD : KEY_REPEAT_GAP);
+}
+
+// kind is the kitty protocol's event type: 1 press, 2 repeat, 3 release
+void TerminalKeyEvent(int vk, double now, int kind = 1) {
+    TerminalKey& k = g_terminalKeys[vk & 0xFF];
+    if (kind == 3) { k.bDown = false; return; }
+    bool bRepeat = kind == 2 || (!g_kittyKeyboard && TerminalKeyHeld(k, now));
+    if (!bRepeat) {
+        k.fFirst = now;
+        k.bPressed = true;
+    }
+    k.fLast = now;
+    k.bDown = true;
+}
+
+// Turns terminal input into key events. Plain bytes are keys, and arrows
+// arrive as ESC [ A..D or ESC O A..D. Kitty key events look like
+// CSI code[:alt];mods[:kind] u, with arrows as CSI 1;mods[:kind] A..D.
+// Returns the bytes used; an ESC or CSI sequence cut off at the end is
+// left for the next read (PollTerminalKeys times out a lone ESC).
+size_t TerminalParse(const unsigned char* in, size_t n, double now) {
+    size_t i = 0;
+    for (; i < n; ++i) {
+        unsigned char c = in[i];
+        if (c != 0x1B) {
+            if (c >= 'a' && c <= 'z') TerminalKeyEvent(c - 'a' + 'A', now);
+            else if (c < 0x80) TerminalKeyEvent(c, now);
+            continue;
+        }
+        if (i + 1 >= n) return i;
+        if (in[i + 1] != '[' && in[i + 1] != 'O') { TerminalKeyEvent(VK_ESCAPE, now); continue; }
+        // Parameters up to the final byte: fields split by ';', subfields by ':'
+        size_t j = i + 2;
+        while (j < n && (in[j] < 0x40 || in[j] > 0x7E)) j++;
+        if (j >= n) return i;
+        bool bPrivate = j > i + 2 && in[i + 2] == '?';
+        int v[3][3] = {};
+        int field = 0, sub = 0;
+        for (size_t k = i + 2; k < j; ++k) {
+            if (in[k] == ';') { field++; sub = 0; }
+            else if (in[k] == ':') sub++;
+            else if (in[k] >= '0' && in[k] <= '9' && field < 3 && sub < 3) v[field][sub] = v[field][sub] * 10 + (in[k] - '0');
+        }
+        int mods = max(1, v[1][0]) - 1, kind = v[1][1] ? v[1][1] : 1;
+        switch (in[j]) {
+        case 'A': TerminalKeyEvent(VK_UP, now, kind); break;
+        case 'B': TerminalKeyEvent(VK_DOWN, now, kind); break;
+        case 'C': TerminalKeyEvent(VK_RIGHT, now, kind); break;
+        case 'D': TerminalKeyEvent(VK_LEFT, now, kind); break;
+        case 'c': if (bPrivate) g_terminalReplies.bAttributes = true; break;
+        case 'u':
+            if (bPrivate) { g_terminalReplies.bKittyFlags = true; break; }
+            // The protocol reports Ctrl+C as a key, so the terminal no longer sends SIGINT
+            if (v[0][0] == 'c' && (mods & 4) && kind == 1) raise(SIGINT);
+            if (v[0][0] >= 'a' && v[0][0] <= 'z') TerminalKeyEvent(v[0][0] - 'a' + 'A', now, kind);
+            else if (v[0][0] > 0 && v[0][0] < 0x80) TerminalKeyEvent(v[0][0], now, kind);
+            break;
+        }
+        i = j;
+    }
+    return i;
+}
+
+// Drains pending terminal input into g_terminalKeys without blocking
+void PollTerminalKeys() {
+    static unsigned char in[256];
+    static size_t have = 0;          // Bytes of an unfinished sequence kept from the last read
+    static double fLastArrival = 0.0; // When the last of them came in
+    double now = TerminalNow();
+    pollfd pfd = { STDIN_FILENO, POLLIN, 0 };
+    ssize_t n;
+    while (poll(&pfd, 1, 0) > 0 && (pfd.revents & POLLIN) && (n = read(STDIN_FILENO, in + have, sizeof(in) - have)) > 0) {
+        have += (size_t)n;
+        fLastArrival = now;
+        size_t used = TerminalParse(in, have, now);
+        if (used == 0 && have == sizeof(in)) used = have; // No sequence is that long
+        memmove(in, in + used, have - used);
+        have -= used;
+    }
+    // Nothing completed the sequence: a lone ESC was the key, anything longer is dropped
+    if (have > 0 && now - fLastArrival >= KEY_ESC_TIMEOUT) {
+        if (have == 1) TerminalKeyEvent(VK_ESCAPE, fLastArrival);
+        have = 0;
+    }
+}
+
+// Same bits as Win32: 0x8000 while held, 1 if pressed since the last call
+short GetAsyncKeyState(int vk) {
+    TerminalKey& k = g_terminalKeys[vk & 0xFF];
+    short state = (short)((TerminalKeyHeld(k, TerminalNow()) ? 0x8000 : 0) | (k.bPressed ? 1 : 0));
+    k.bPressed = false;
+    return state;
+}
+#endif
+
+// Audio file paths (place these files in the "audio" folder)
+const wchar_t* AUDIO_FOLDER = L"audio\\";
+const wchar_t* ENGINE_IDLE_FILE = L"engine_idle.mp3";  // Engine idle/running sound (when moving)
+const wchar_t* ENGINE_ACCEL_FILE = L"engine_accel.mp3"; // Engine acceleration sound (when accelerating)
+const wchar_t* BRAKE_SOUND_FILE = L"brake.mp3";     // Brake sound file (when steering)
+const wchar_t* CRASH_SOUND_FILE = L"crash.mp3";     // Crash sound file
+const wchar_t* GAMEOVER_SOUND_FILE = L"gameover.mp3"; // Game Over sound file
+const wchar_t* WIN_SOUND_FILE = L"victory.mp3";     // Victory sound file
+const wchar_t* BGM_FILE = L"bgm.mp3";               // Background music file
+
+// Helper function to get full audio file path
+wstring GetAudioPath(const wchar_t* filename) {
+    wstring path = AUDIO_FOLDER;
+    path += filename;
+    return path;
+}
+
+// Heap allocations made by the calling thread. Every global new goes through
+// here, so a loop can check it allocates nothing by reading it before and after.
+thread_local uint64_t t_nHeapAllocs = 0;
+
+// Kept out of line: GCC otherwise sees malloc() and free() through the
+// inlined bodies and warns that new-expressions and deletes do not match
+#if defined(__GNUC__)
+#define HEAP_HOOK __attribute__((noinline))
+#else
+#define HEAP_HOOK
+#endif
+
+HEAP_HOOK void* operator new(size_t n) {
+    ++t_nHeapAllocs;
+    if (void* p = malloc(n ? n : 1)) return p;
+    throw std::bad_alloc();
+}
+HEAP_HOOK void* operator new[](size_t n) { return operator new(n); }
+HEAP_HOOK void operator delete(void* p) noexcept { free(p); }
+HEAP_HOOK void operator delete[](void* p) noexcept { free(p); }
+
+// ================================================================
+// OS RACER — Kernel Physics Parameter Table (KPT)
+// ================================================================
+const int nScreenWidth = 120; // Console width (columns)
+const int nScreenHeight = 30; // Console height (rows)
+const int FRAME_RATE = 60; // Render thread FPS
+const float PHYSICS_HZ = 240.0f; // Physics thread frequency
+const float DELTA_T = 1.0f / PHYSICS_HZ; // Physics fixed-step (s)
+
+// Road / Track Parameters
+const float ROAD_WIDTH_LIMIT = 1.0f; // Max absolute lane offset
+const float CAMERA_LAG_DISTANCE = 3.0f; // Third-person: camera looks back 3 units
+const float PLAYER_HALF_WIDTH = 0.18f; // Half of car width in normalized road coordinates
+
+// Vehicle Dynamics Parameters
+const float MAX_SPEED = 50.0f; // Top speed
+const float ACCELERATION = 17.0f; // Acceleration units/sec
+const float DECELERATION = 20.0f; // Deceleration units/sec
+const float FRICTION = 0.9999f; // Speed friction per physics tick
+
+// Steering / Lateral Control
+const float LATERAL_FACTOR = 0.0004f;
+const float STEER_COMPENSATION = 0.002f;
+
+// Heading Angle & Drift
+const float HEADING_TURN_SPEED = 0.4f;
+const float HEADING_DRIFT_FACTOR = 0.004f;
+
+// Rendering / Visual characters
+const wchar_t CHAR_FULL = L'█';
+const wchar_t CHAR_DARK = L'▓';
+const wchar_t CHAR_MED = L'▒';
+const wchar_t CHAR_LIGHT = L'░';
+const wchar_t CHAR_EMPTY = L' ';
+
+// Game state
+enum GameState { BOOT_MENU = 0, MAP_SELECT, KERNEL_RUNNING, GAME_WIN, GAME_OVER, SYSTEM_HALT };
+std::atomic<GameState> currentState(BOOT_MENU);
+
+// Global map ID for rendering context
+int g_currentMapId = 1;
+
+// AI cars per race (a.exe --opponents N)
+int g_opponentCount = 0;
+
+// ----------------------- Fixed-Point Physics ---------------------
+// Optional integer kernel (a.exe --fixed, or build with OSR_FIXED_PHYSICS):
+// state in Q16.16, distance in a 64-bit Q16 so long tracks keep their
+// resolution. Integer math gives the same trajectory on every compiler,
+// optimization level and CPU, with no fp-contract or fast-math caveats.
+#ifdef OSR_FIXED_PHYSICS
+bool g_fixedPhysics = true;
+#else
+bool g_fixedPhysics = false;
+#endif
+
+const int Q_SHIFT = 16;
+const int32_t Q_ONE = 1 << Q_SHIFT;
+
+inline int32_t ToQ16(double v) { return (int32_t)llround(v * Q_ONE); }
+inline int64_t ToQ16Wide(double v) { return (int64_t)llround(v * Q_ONE); }
+inline float FromQ16(int64_t q) { return (float)((double)q / Q_ONE); }
+// Q0.32 factor for QScale
+inline int64_t ToQ32(double v) { return (int64_t)llround(v * 4294967296.0); }
+
+// Q16 * Q16, rounded to nearest
+inline int32_t QMul(int32_t a, int32_t b) { return (int32_t)(((int64_t)a * b + (1 << (Q_SHIFT - 1))) >> Q_SHIFT); }
+// Q16 * Q0.32 constant, rounded to nearest
+inline int32_t QScale(int32_t a, int64_t k32) { return (int32_t)(((int64_t)a * k32 + (1LL << 31)) >> 32); }
+
+struct FixedState {
+    int64_t nDistance = 0;
+    int32_t nX = 0;
+    int32_t nSpeed = 0;
+    int32_t nCurvature = 0;
+    int32_t nPlayerCurvature = 0;
+    int32_t nHeading = 0;
+};
+
+// -------------------------- Player State -------------------------
+// Float distances are local to a per-car origin on the exact Q16 track
+// axis. Once a car is 2 * DISTANCE_REBASE past its origin, whole multiples of
+// DISTANCE_REBASE move into the origin, so a car a million units down the
+// road rounds its per-tick steps exactly like one on a short map. Tracks
+// shorter than 2 * DISTANCE_REBASE never rebase.
+const float DISTANCE_REBASE = 4096.0f; // Power of two, so every shift is exact
+const int64_t DISTANCE_REBASE_Q = (int64_t)4096 << Q_SHIFT;
+
+// Track position q as a float distance from originQ
+inline float LocalQ(int64_t q, int64_t originQ) { return (float)(q - originQ) * (1.0f / Q_ONE); }
+// Largest Q16 position not beyond `local`: a table entry a satisfies
+// a <= FloorQ16(local, o) exactly when a - o <= local
+inline int64_t FloorQ16(float local, int64_t originQ) { return originQ + (int64_t)floor((double)local * Q_ONE); }
+// Absolute distance, for display and logs only
+inline double TrackPosition(int64_t originQ, float local) { return (double)originQ / Q_ONE + local; }
+
+// Moves whole DISTANCE_REBASE steps of fDistance into nOriginQ, leaving it
+// in [DISTANCE_REBASE, 2 * DISTANCE_REBASE) (or below, near the start)
+inline void RebaseDistance(float& fDistance, int64_t& nOriginQ) {
+    if (fDistance < 2.0f * DISTANCE_REBASE && (fDistance >= 0.0f || nOriginQ == 0)) return;
+    float shift = floorf(fDistance / DISTANCE_REBASE) * DISTANCE_REBASE - DISTANCE_REBASE;
+    int64_t shiftQ = max((int64_t)shift * Q_ONE, -nOriginQ);
+    fDistance -= LocalQ(shiftQ, 0);
+    nOriginQ += shiftQ;
+}
+
+// Same frame for an exact Q16 position (the fixed-point kernel's mirror)
+inline void RebaseOriginQ(int64_t positionQ, int64_t& nOriginQ) {
+    int64_t local = positionQ - nOriginQ;
+    if (local < 2 * DISTANCE_REBASE_Q && (local >= 0 || nOriginQ == 0)) return;
+    nOriginQ = max<int64_t>(0, (positionQ / DISTANCE_REBASE_Q - 1) * DISTANCE_REBASE_Q);
+}
+
+struct PlayerPCB {
+    float fX_Register = 0.0f; // Lateral position on road (-1 ~ +1)
+    float fSpeed = 0.0f; // Forward speed
+    float fDistance = 0.0f; // Forward distance along track, from nOriginQ
+    int64_t nOriginQ = 0; // Track position of fDistance == 0
+    float fCurvature = 0.0f; // Current track curvature
+    float fPlayerCurvature = 0.0f; // Accumulated curvature for background
+    float fHeadingAngle = 0.0f; // Visual steering angle
+    bool bCrashed = false;
+    float fImpactTime = -1.0f; // Fraction of the crash tick at which the car hit
+    int nSteerState = 0; // -1, 0, +1
+    FixedState q; // Authoritative state in fixed-point mode; the floats above mirror it
+    void Reset() { *this = PlayerPCB(); }
+} player;
+
+// ----------------------- Snapshot Publication --------------------
+// Single-writer seqlock. The payload is kept in relaxed atomic words, so a
+// read that overlaps a write is caught by the sequence check instead of
+// being a data race. The writer never waits; readers retry on a torn copy.
+template <typename T>
+class SeqLock {
+    static const size_t WORDS = (sizeof(T) + 3) / 4;
+    std::atomic<uint32_t> seq;
+    std::atomic<uint32_t> words[WORDS];
+
+public:
+    SeqLock() : seq(0) {
+        for (size_t i = 0; i < WORDS; ++i) words[i].store(0, std::memory_order_relaxed);
+        Publish(T());
+    }
+
+    void Publish(const T& v) {
+        uint32_t buf[WORDS] = {};
+        memcpy(buf, &v, sizeof(T));
+        uint32_t s = seq.load(std::memory_order_relaxed);
+        seq.store(s + 1, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_release);
+        for (size_t i = 0; i < WORDS; ++i) words[i].store(buf[i], std::memory_order_relaxed);
+        seq.store(s + 2, std::memory_order_release);
+    }
+
+    T Read() const {
+        uint32_t buf[WORDS];
+        uint32_t s0, s1;
+        do {
+            s0 = seq.load(std::memory_order_acquire);
+            for (size_t i = 0; i < WORDS; ++i) buf[i] = words[i].load(std::memory_order_relaxed);
+            std::atomic_thread_fence(std::memory_order_acquire);
+            s1 = seq.load(std::memory_order_relaxed);
+        } while ((s0 & 1) || s0 != s1);
+        T v;
+        memcpy(&v, buf, sizeof(T));
+        return v;
+    }
+};
+
+// `player` belongs to the physics thread. Everyone else reads the copy it
+// publishes after every tick, and asks for a reset through the flag below.
+SeqLock<PlayerPCB> g_playerSnapshot;
+std::atomic<bool> g_playerResetRequest(false);
+
+void RequestPlayerReset() { g_playerResetRequest.store(true); }
+
+// Camera follow state, stepped by physics alongside the player so it
+// advances at the tick rate instead of the frame rate.
+struct CameraState {
+    float fCurvature = 0.0f; // Eased curvature at the camera's distance
+    float fPlayerCurvature = 0.0f; // Accumulated curvature for background
+};
+
+// The last two physics states for the renderer, which draws
+// lerp(prev, cur, alpha) with alpha = (now - fTickTime) * PHYSICS_HZ.
+struct RenderFrame {
+    PlayerPCB prev, cur;
+    CameraState camPrev, camCur;
+    uint64_t nTick = 0;
+    double fTickTime = 0.0; // steady_clock seconds at which `cur` was due
+};
+SeqLock<RenderFrame> g_renderFrame;
+
+// --------------------------- Track Data --------------------------
+struct Obstacle {
+    float fSegDistance; // Distance inside the segment
+    float fOffsetX; // Lateral offset from center (-ROAD_WIDTH_LIMIT to ROAD_WIDTH_LIMIT)
+    float fWidth; // Obstacle width in normalized road coordinates
+};
+
+struct TrackSegment {
+    float fCurvature; // Curvature factor
+    float fDistance; // Segment length
+    vector<Obstacle> vecObstacles; // Obstacles inside this segment
+};
+
+// Read-only view of a contiguous array. A ring view (mask != ~0) wraps
+// ever-growing positions onto its slots; begin/end/back are meaningless there.
+template <typename T>
+struct ArrayView {
+    const T* p = nullptr;
+    size_t n = 0;
+    size_t mask = ~(size_t)0;
+    ArrayView() {}
+    ArrayView(const T* data, size_t count) : p(data), n(count) {}
+    ArrayView(const vector<T>& v) : p(v.data()), n(v.size()) {}
+    size_t size() const { return n; }
+    bool empty() const { return n == 0; }
+    const T* data() const { return p; }
+    const T* begin() const { return p; }
+    const T* end() const { return p + n; }
+    const T& operator[](size_t i) const { return p[i & mask]; }
+    const T& back() const { return p[n - 1]; }
+};
+
+// Table of the loaded track: either owns its elements (tracks built in
+// memory), shares a cached table, or points straight into a mapped
+// compiled track file.
+template <typename T>
+class TrackArray : public ArrayView<T> {
+    vector<T> own;
+    shared_ptr<const vector<T>> shared;
+public:
+    TrackArray() {}
+    TrackArray(const TrackArray&) = delete;
+    TrackArray& operator=(const TrackArray&) = delete;
+    void Assign(vector<T>&& v) {
+        own.swap(v);
+        vector<T>().swap(v);
+        shared.reset();
+        this->p = own.data();
+        this->n = own.size();
+        this->mask = ~(size_t)0;
+    }
+    void View(const T* data, size_t count) {
+        vector<T>().swap(own);
+        shared.reset();
+        this->p = data;
+        this->n = count;
+        this->mask = ~(size_t)0;
+    }
+    // Ring of `capacity` slots (a power of two) owned by a streamed track
+    void Ring(const T* data, size_t capacity) {
+        View(data, capacity);
+        this->mask = capacity - 1;
+    }
+    // Keeps `v` alive for as long as the table reads it
+    void Share(shared_ptr<const vector<T>> v) {
+        View(v->data(), v->size());
+        shared = move(v);
+    }
+};
+
+// Minimap outline vertex. The track's 1-unit walk (GenerateMapPoints) is
+// simplified to what a minimap box can show and each axis is quantized over
+// the walk's bounding box to [0, MAP_QUANT_MAX]; nUnit is the walk point the
+// vertex was taken from, i.e. its distance along the track in MAP_STEPs.
+struct MapVertex {
+    int16_t x, y;
+    uint32_t nUnit;
+};
+const int MAP_QUANT_MAX = 32767;
+
+// Source form of a track. Tracks loaded from a compiled file leave it
+// empty; everything at run time reads the tables below.
+vector<TrackSegment> vecTrack;
+float fTotalTrackLength = 0.0f;
+TrackArray<MapVertex> vecMapPointsCurrent;
+shared_ptr<const vector<MapVertex>> vecMapPreview[3]; // Menu previews, shared with the map cache
+// Bumped whenever an outline is built or vecMapPointsCurrent is repointed.
+// Caches derived from an outline check it, as a freed outline's address
+// can come back holding another track.
+std::atomic<uint32_t> g_mapPointsVersion(0);
+
+// --------------------------- Track Index -------------------------
+// Cumulative distance table built by LoadMap, in exact Q16 (the sums of the
+// Q16 segment lengths) so positions keep full resolution on any length of
+// track: vecSegStartQ[i] = where segment i begins, vecSegStartQ[n] = track
+// length. Float readers take positions relative to their origin (LocalQ).
+TrackArray<int64_t> vecSegStartQ;
+TrackArray<float> vecSegCurvature; // One per segment; its size is the segment count
+TrackArray<int32_t> vecSegCurvatureQ; // The same in Q16, for the integer kernel
+
+// Live part of a streamed track (see Endless Track): segments
+// [nSegTail, nSegHead) and obstacles [nObsTail, nObsHead) are valid, and the
+// tables above are rings indexed by absolute position. A negative head means
+// the whole loaded track is valid.
+struct TrackWindow {
+    atomic<int> nSegTail, nSegHead, nObsTail, nObsHead;
+    TrackWindow() : nSegTail(0), nSegHead(-1), nObsTail(0), nObsHead(-1) {}
+    bool Streaming() const { return nSegHead.load(memory_order_relaxed) >= 0; }
+} g_trackWindow;
+
+// Segments readable right now; KernelStep and friends treat the index
+// returned here like the end of a fixed track
+inline int TrackSegmentCount() {
+    int head = g_trackWindow.nSegHead.load(memory_order_acquire);
+    return head >= 0 ? head : (int)vecSegCurvature.size();
+}
+
+// Q16 length of the loaded track; a streamed track has no finish line
+inline int64_t TrackLengthQ() {
+    if (g_trackWindow.Streaming()) return INT64_MAX;
+    return vecSegStartQ.empty() ? 0 : vecSegStartQ.back();
+}
+
+// Cached segment lookup. Each reader (physics, camera) keeps its own cursor;
+// consecutive lookups move it a few segments at most, a far jump falls back
+// to a binary search over vecSegStartQ.
+struct TrackCursor {
+    int nSection = 0;
+    void Reset() { nSection = 0; }
+};
+
+const int TRACK_CURSOR_MAX_STEPS = 4; // Linear steps before switching to binary search
+
+// Index of the first element > v in the ascending array a[0..n), searched
+// outward from `hint` and falling back to a binary search on far jumps.
+template <typename T>
+int SeekSorted(const T* a, int n, int hint, T v) {
+    int i = max(0, min(n, hint));
+    for (int step = 0; step < TRACK_CURSOR_MAX_STEPS; ++step) {
+        if (i < n && a[i] <= v) i++;
+        else if (i > 0 && a[i - 1] > v) i--;
+        else return i;
+    }
+    return (int)(upper_bound(a, a + n, v) - a);
+}
+
+// SeekSorted over positions [lo, hi) of a possibly ring-backed table
+template <typename T>
+int SeekRange(const ArrayView<T>& a, int lo, int hi, int hint, T v) {
+    int i = max(lo, min(hi, hint));
+    for (int step = 0; step < TRACK_CURSOR_MAX_STEPS; ++step) {
+        if (i < hi && a[i] <= v) i++;
+        else if (i > lo && a[i - 1] > v) i--;
+        else return i;
+    }
+    while (lo < hi) {
+        int mid = lo + (hi - lo) / 2;
+        if (a[mid] <= v) lo = mid + 1;
+        else hi = mid;
+    }
+    return lo;
+}
+
+// Returns the segment containing Q16 position `dist`, or vecTrack.size() past
+// the finish line (same result as walking vecTrack from segment 0). On a
+// streamed track the result is clamped to the live segments, head meaning
+// "not generated yet".
+int TrackSeekQ(TrackCursor& c, int64_t dist) {
+    if (g_trackWindow.Streaming()) {
+        int head = g_trackWindow.nSegHead.load(memory_order_acquire);
+        int tail = g_trackWindow.nSegTail.load(memory_order_relaxed);
+        c.nSection = SeekRange(vecSegStartQ, tail + 1, head + 1, c.nSection + 1, dist) - 1;
+        return c.nSection;
+    }
+    int n = (int)vecSegStartQ.size() - 1;
+    if (n <= 0) return 0;
+    // Number of segment end points <= dist
+    c.nSection = SeekSorted(vecSegStartQ.data() + 1, n, c.nSection, dist);
+    return c.nSection;
+}
+
+// The same for a float distance from originQ
+int TrackSeek(TrackCursor& c, float dist, int64_t originQ) {
+    return TrackSeekQ(c, FloorQ16(dist, originQ));
+}
+
+
+// ------------------------- Obstacle Index ------------------------
+// Every obstacle of the loaded track in one distance-sorted SoA table,
+// built by LoadMap. Obstacles of segment i occupy [nSegBegin[i], nSegBegin[i + 1]).
+// Positions are exact Q16 only; float readers take them from their origin.
+// The broadphase grid splits the track into fixed-length distance buckets so
+// a cursor that jumps far only searches the one bucket it lands in; every
+// lookup costs the same on a 100-obstacle track and a 100k one.
+const int OBSTACLE_BUCKET_SHIFT = 4; // Buckets span 16 distance units
+
+struct ObstacleIndex {
+    TrackArray<int64_t> nDistQ; // Track position
+    TrackArray<float> fOffsetX; // Lateral offset from center
+    TrackArray<float> fWidth;   // Width in normalized road coordinates
+    TrackArray<int> nSegBegin;  // Per-segment start index (size = segments + 1)
+    TrackArray<int32_t> nOffsetXQ; // Fixed-point offset and half width
+    TrackArray<int32_t> nHalfWidthQ;
+    // Obstacles of bucket k occupy [nBucketBeginQ[k], nBucketBeginQ[k + 1])
+    TrackArray<int> nBucketBeginQ;
+    uint32_t nVersion = 0; // Bumped on every rebuild, for caches derived from the table
+    // Live obstacles are [First(), Size()); First() is 0 unless streaming
+    int First() const { return g_trackWindow.nObsTail.load(memory_order_relaxed); }
+    int Size() const {
+        int head = g_trackWindow.nObsHead.load(memory_order_acquire);
+        return head >= 0 ? head : (int)nDistQ.size();
+    }
+    float Dist(int i, int64_t originQ) const { return LocalQ(nDistQ[i], originQ); }
+} obstacleIndex;
+
+struct ObstacleCursor {
+    int nNext = 0; // First obstacle beyond the last queried distance
+    void Reset() { nNext = 0; }
+};
+
+// SeekSorted over a bucketed array: a far jump binary-searches bucket k only
+template <typename T>
+int BucketSeek(const T* a, const ArrayView<int>& buckets, int hint, T v, int64_t k) {
+    int n = buckets.back();
+    int i = max(0, min(n, hint));
+    for (int step = 0; step < TRACK_CURSOR_MAX_STEPS; ++step) {
+        if (i < n && a[i] <= v) i++;
+        else if (i > 0 && a[i - 1] > v) i--;
+        else return i;
+    }
+    int last = (int)buckets.size() - 2;
+    int b = (int)max<int64_t>(0, min<int64_t>(last, k));
+    return (int)(upper_bound(a + buckets[b], a + buckets[b + 1], v) - a);
+}
+
+// Returns the first obstacle lying strictly beyond Q16 position `dist`.
+int ObstacleSeekQ(ObstacleCursor& c, int64_t dist) {
+    const ObstacleIndex& oi = obstacleIndex;
+    if (g_trackWindow.Streaming()) { // No bucket grid over a ring
+        c.nNext = SeekRange(oi.nDistQ, oi.First(), oi.Size(), c.nNext, dist);
+        return c.nNext;
+    }
+    c.nNext = BucketSeek(oi.nDistQ.data(), oi.nBucketBeginQ, c.nNext, dist, dist >> (Q_SHIFT + OBSTACLE_BUCKET_SHIFT));
+    return c.nNext;
+}
+
+// The same for a float distance from originQ
+int ObstacleSeek(ObstacleCursor& c, float dist, int64_t originQ) {
+    return ObstacleSeekQ(c, FloorQ16(dist, originQ));
+}
+
+// Calls fn(i) for every obstacle of segment `section` whose 10-unit hole
+// covers `segDist` into that segment, as the road renderer draws them.
+template <typename Fn>
+void ForEachRoadHole(int section, float segDist, ObstacleCursor& c, Fn fn) {
+    const ObstacleIndex& oi = obstacleIndex;
+    int64_t segStartQ = vecSegStartQ[section]; // Segment-relative: exact anywhere on the track
+    // Candidates from a window one unit wider than the hole on each side;
+    // the segment-relative test below decides, exactly as before
+    int i = max(oi.nSegBegin[section], ObstacleSeek(c, segDist - 11.0f, segStartQ));
+    int end = oi.nSegBegin[section + 1];
+    for (; i < end && oi.Dist(i, segStartQ) <= segDist + 1.0f; ++i) {
+        float fObsSegDist = oi.Dist(i, segStartQ);
+        if (segDist >= fObsSegDist && segDist < fObsSegDist + 10.0f) fn(i);
+    }
+}
+
+// Fills buckets[k] with the first element of a[0..n) at or past bucket k's
+// start; shift converts a value to its bucket number.
+template <typename T>
+void BuildBuckets(const vector<T>& a, int shift, vector<int>& buckets) {
+    int64_t nb = a.empty() ? 1 : max<int64_t>(1, ((int64_t)a.back() >> shift) + 1);
+    buckets.assign((size_t)nb + 1, (int)a.size());
+    size_t i = 0;
+    for (int64_t k = 0; k < nb; ++k) {
+        while (i < a.size() && ((int64_t)a[i] >> shift) < k) i++;
+        buckets[(size_t)k] = (int)i;
+    }
+}
+
+
+void BuildObstacleIndex(const vector<TrackSegment>& track, ObstacleIndex& idx) {
+    vector<float> offsetX, width;
+    vector<int> segBegin(1, 0), bucketsQ;
+    vector<int64_t> distQ;
+    vector<int32_t> offsetXQ, halfWidthQ;
+    int64_t segStartQ = 0;
+    vector<Obstacle> sorted;
+    for (auto& seg : track) {
+        sorted = seg.vecObstacles;
+        stable_sort(sorted.begin(), sorted.end(),
+                    [](const Obstacle& a, const Obstacle& b) { return a.fSegDistance < b.fSegDistance; });
+        for (auto& obs : sorted) {
+            offsetX.push_back(obs.fOffsetX);
+            width.push_back(obs.fWidth);
+            distQ.push_back(segStartQ + ToQ16Wide(obs.fSegDistance));
+            offsetXQ.push_back(ToQ16(obs.fOffsetX));
+            halfWidthQ.push_back(ToQ16(obs.fWidth * 0.5));
+        }
+        segBegin.push_back((int)distQ.size());
+        segStartQ += ToQ16Wide(seg.fDistance);
+    }
+    // Q16 buckets are a plain shift of the position
+    BuildBuckets(distQ, Q_SHIFT + OBSTACLE_BUCKET_SHIFT, bucketsQ);
+
+    idx.nDistQ.Assign(move(distQ)); idx.fOffsetX.Assign(move(offsetX)); idx.fWidth.Assign(move(width));
+    idx.nSegBegin.Assign(move(segBegin));
+    idx.nOffsetXQ.Assign(move(offsetXQ)); idx.nHalfWidthQ.Assign(move(halfWidthQ));
+    idx.nBucketBeginQ.Assign(move(bucketsQ));
+    idx.nVersion++;
+}
+
+// --------------------------- Console -----------------------------
+#ifdef _WIN32
+HANDLE hConsole = NULL;
+#endif
+vector<wchar_t> screenBuffer(nScreenWidth * nScreenHeight, CHAR_EMPTY);
+vector<WORD> colorBuffer(nScreenWidth * nScreenHeight, 0x07);
+std::mutex g_screen_mutex;
+
+// -------------------------- Thread Control -----------------------
+std::atomic<bool> running(true);
+
+// ------------------------- Input Atomics -------------------------
+std::atomic<int> input_steer(0); // -1, 0, +1
+std::atomic<bool> input_accel(false);
+std::atomic<bool> input_brake(false);
+std::atomic<bool> input_escape(false);
+
+// Edge-detect input (one-shot)
+std::atomic<bool> input_space_edge(false);
+std::atomic<bool> input_up_edge(false);
+std::atomic<bool> input_down_edge(false);
+std::atomic<bool> input_1_edge(false);
+std::atomic<bool> input_2_edge(false);
+std::atomic<bool> input_3_edge(false);
+
+// Autopilot (P in game, or a.exe --autopilot). While on, the physics thread
+// writes the autopilot's choice into the atomics above each tick and the
+// input thread leaves them alone, so a tick consumes it exactly like keys.
+std::atomic<bool> g_autopilot(false);
+
+// ----------------- Obstacle Warning (shared flags) ----------------
+std::atomic<bool> warnObstacle(false);
+std::atomic<float> warnObstacleDist(0.0f);
+std::atomic<float> warnObstacleOffsetX(0.0f);
+
+// ------------------------- Game Event Ring -----------------------
+// Discrete game events in the order physics raised them, stamped with the
+// physics tick. One writer (the physics thread), any number of readers:
+// each reader keeps its own cursor and sees every event, and the writer
+// never waits on them. A reader that falls more than GAME_EVENT_CAPACITY
+// events behind skips to the oldest event still held and is told how many
+// it missed. Slots use the same word-wise seqlock as SeqLock.
+enum GameEventType : uint32_t {
+    GEV_RACE_START,
+    GEV_BRAKE,     // Steering began at speed (tyre squeal)
+    GEV_CRASH,
+    GEV_GAME_OVER,
+    GEV_WIN,
+};
+
+const wchar_t* GameEventName(uint32_t type) {
+    switch (type) {
+    case GEV_RACE_START: return L"START";
+    case GEV_BRAKE: return L"BRAKE";
+    case GEV_CRASH: return L"CRASH";
+    case GEV_GAME_OVER: return L"OVER";
+    case GEV_WIN: return L"WIN";
+    }
+    return L"?";
+}
+
+struct GameEvent {
+    uint32_t nType = GEV_RACE_START;
+    int32_t nMapId = 0;
+    uint64_t nTick = 0;    // Physics tick counter, monotonic for the whole run
+    double fTime = 0.0;    // steady_clock seconds at which that tick was due
+    float fDistance = 0.0f, fX = 0.0f, fSpeed = 0.0f; // Player state after the tick
+};
+
+const int GAME_EVENT_CAPACITY = 256; // Power of two
+
+class GameEventRing {
+    static const size_t WORDS = (sizeof(GameEvent) + 3) / 4;
+    struct Slot {
+        std::atomic<uint64_t> stamp; // 2n+1 while event n is written, 2n+2 once complete
+        std::atomic<uint32_t> words[WORDS];
+    };
+    Slot slots[GAME_EVENT_CAPACITY];
+    std::atomic<uint64_t> head; // Events published so far
+    std::mutex waitMutex;
+    std::condition_variable waitCv;
+
+public:
+    GameEventRing() : head(0) {
+        for (auto& s : slots) {
+            s.stamp.store(0, std::memory_order_relaxed);
+            for (auto& w : s.words) w.store(0, std::memory_order_relaxed);
+        }
+    }
+
+    // Writer only. Sleeping readers are woken without taking their mutex, so
+    // a reader that races the wakeup waits out its timeout at worst.
+    void Push(const GameEvent& e) {
+        uint32_t buf[WORDS] = {};
+        memcpy(buf, &e, sizeof(GameEvent));
+        uint64_t n = head.load(std::memory_order_relaxed);
+        Slot& s = slots[n & (GAME_EVENT_CAPACITY - 1)];
+        s.stamp.store(2 * n + 1, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_release);
+        for (size_t i = 0; i < WORDS; ++i) s.words[i].store(buf[i], std::memory_order_relaxed);
+        s.stamp.store(2 * n + 2, std::memory_order_release);
+        head.store(n + 1, std::memory_order_release);
+        waitCv.notify_all();
+    }
+
+    // Cursor for a reader that only wants events raised from now on
+    uint64_t Head() const { return head.load(std::memory_order_acquire); }
+
+    // Copies the event at `cursor` and advances it; false when none is pending.
+    // Events overwritten before the reader got to them are added to *pLost.
+    bool Poll(uint64_t& cursor, GameEvent& e, uint64_t* pLost = nullptr) const {
+        for (;;) {
+            uint64_t h = head.load(std::memory_order_acquire);
+            if (cursor >= h) return false;
+            if (h - cursor > GAME_EVENT_CAPACITY) {
+                if (pLost) *pLost += h - GAME_EVENT_CAPACITY - cursor;
+                cursor = h - GAME_EVENT_CAPACITY;
+            }
+            const Slot& s = slots[cursor & (GAME_EVENT_CAPACITY - 1)];
+            uint32_t buf[WORDS];
+            uint64_t s0 = s.stamp.load(std::memory_order_acquire);
+            for (size_t i = 0; i < WORDS; ++i) buf[i] = s.words[i].load(std::memory_order_relaxed);
+            std::atomic_thread_fence(std::memory_order_acquire);
+            uint64_t s1 = s.stamp.load(std::memory_order_relaxed);
+            if (s0 == s1 && s0 == 2 * cursor + 2) {
+                memcpy(&e, buf, sizeof(GameEvent));
+                cursor++;
+                return true;
+            }
+            // The writer lapped this reader mid-copy; go again from the new head
+        }
+    }
+
+    // Sleeps until an event past `cursor` exists or `timeoutMs` has passed
+    void Wait(uint64_t cursor, int timeoutMs) {
+        std::unique_lock<std::mutex> lk(waitMutex);
+        waitCv.wait_for(lk, chrono::milliseconds(timeoutMs), [&] { return Head() > cursor; });
+    }
+} g_events;
+
+// ----------------- Sound System -----------------
+std::atomic<float> lastSpeed(0.0f);
+std::atomic<bool> sound_accel_active(false);
+std::atomic<float> engineRPM(0.0f); // Engine RPM for realistic sound
+std::atomic<bool> bgm_playing(false);
+std::atomic<bool> engine_idle_playing(false);
+std::atomic<bool> engine_accel_playing(false);
+std::atomic<bool> brake_sound_playing(false);
+
+// =================================================================
+// Sound System
+// =================================================================
+void PlayBeepSound(int frequency, int duration) {
+    Beep(frequency, duration);
+}
+
+// Play audio file using MCI (supports WAV, MP3, etc.)
+bool PlayAudioFile(const wchar_t* filename, bool loop = false) {
+    // Get full path with audio folder
+    wstring fullPath = GetAudioPath(filename);
+    
+    // First, ensure any existing instance is properly closed
+    wchar_t closeCmd[128];
+    swprintf_s(closeCmd, L"close audio_file");
+    mciSendStringW(closeCmd, NULL, 0, NULL); // Ignore errors if not open
+    Sleep(30); // Give system more time to release resources
+    
+    wchar_t cmd[512];
+    MCIERROR err = 0;
+    
+    // Check file extension to determine format
+    wstring filenameStr(filename);
+    size_t dotPos = filenameStr.find_last_of(L".");
+    bool isMP3 = false;
+    if (dotPos != wstring::npos) {
+        wstring ext = filenameStr.substr(dotPos + 1);
+        for (auto& c : ext) c = towlower(c);
+        isMP3 = (ext == L"mp3");
+    }
+    
+    // Try MP3 first if extension suggests MP3, otherwise try WAV first
+    if (isMP3) {
+        swprintf_s(cmd, L"open \"%s\" type mpegvideo alias audio_file", fullPath.c_str());
+        err = mciSendStringW(cmd, NULL, 0, NULL);
+        if (err != 0) {
+            // Try as WAV if MP3 fails
+            swprintf_s(cmd, L"open \"%s\" type waveaudio alias audio_file", fullPath.c_str());
+            err = mciSendStringW(cmd, NULL, 0, NULL);
+        }
+    } else {
+        // Try WAV first
+        swprintf_s(cmd, L"open \"%s\" type waveaudio alias audio_file", fullPath.c_str());
+        err = mciSendStringW(cmd, NULL, 0, NULL);
+        if (err != 0) {
+            // Try as MP3 if WAV fails
+            swprintf_s(cmd, L"open \"%s\" type mpegvideo alias audio_file", fullPath.c_str());
+            err = mciSendStringW(cmd, NULL, 0, NULL);
+        }
+    }
+    
+    if (err != 0) {
+        return false; // File not found or format not supported
+    }
+    
+    wchar_t playCmd[128];
+    if (loop) {
+        swprintf_s(playCmd, L"play audio_file repeat");
+    } else {
+        swprintf_s(playCmd, L"play audio_file");
+    }
+    
+    MCIERROR playErr = mciSendStringW(playCmd, NULL, 0, NULL);
+    if (playErr != 0) {
+        // If play fails, close the device to avoid resource leak
+        swprintf_s(cmd, L"close audio_file");
+        mciSendStringW(cmd, NULL, 0, NULL);
+        return false;
+    }
+    
+    return true;
+}
+
+// Stop audio file
+void StopAudioFile() {
+    mciSendStringW(L"stop audio_file", NULL, 0, NULL);
+    mciSendStringW(L"close audio_file", NULL, 0, NULL);
+}
+
+// Play audio file with custom alias (for multiple simultaneous sounds)
+bool PlayAudioFileWithAlias(const wchar_t* filename, const wchar_t* alias, bool loop = false) {
+    // Get full path with audio folder
+    wstring fullPath = GetAudioPath(filename);
+    
+    // First, ensure any existing instance is properly closed to avoid conflicts
+    wchar_t cmd[512];
+    
+    // Check if device is already open and stop/close it properly
+    wchar_t statusCmd[128];
+    wchar_t status[128];
+    swprintf_s(statusCmd, L"status %s mode", alias);
+    MCIERROR statusErr = mciSendStringW(statusCmd, status, 128, NULL);
+    
+    if (statusErr == 0) {
+        // Device exists, stop and close it first
+        swprintf_s(cmd, L"stop %s", alias);
+        mciSendStringW(cmd, NULL, 0, NULL);
+        swprintf_s(cmd, L"close %s", alias);
+        mciSendStringW(cmd, NULL, 0, NULL);
+        Sleep(20); // Give system time to release resources
+    }
+    
+    // Try MP3 first
+    swprintf_s(cmd, L"open \"%s\" type mpegvideo alias %s", fullPath.c_str(), alias);
+    MCIERROR err = mciSendStringW(cmd, NULL, 0, NULL);
+    
+    if (err != 0) {
+        // Try WAV format if MP3 fails
+        swprintf_s(cmd, L"open \"%s\" type waveaudio alias %s", fullPath.c_str(), alias);
+        err = mciSendStringW(cmd, NULL, 0, NULL);
+        if (err != 0) {
+            return false; // File not found or format not supported
+        }
+    }
+    
+    // Play the file
+    wchar_t playCmd[128];
+    if (loop) {
+        swprintf_s(playCmd, L"play %s repeat", alias);
+    } else {
+        swprintf_s(playCmd, L"play %s", alias);
+    }
+    
+    MCIERROR playErr = mciSendStringW(playCmd, NULL, 0, NULL);
+    if (playErr != 0) {
+        // If play fails, close the device to avoid resource leak
+        swprintf_s(cmd, L"close %s", alias);
+        mciSendStringW(cmd, NULL, 0, NULL);
+        return false;
+    }
+    
+    return true;
+}
+
+// Stop audio file with custom alias
+void StopAudioFileWithAlias(const wchar_t* alias) {
+    wchar_t cmd[128];
+    wchar_t statusCmd[128];
+    wchar_t status[128];
+    
+    // Check if device exists before trying to stop/close
+    swprintf_s(statusCmd, L"status %s mode", alias);
+    MCIERROR statusErr = mciSendStringW(statusCmd, status, 128, NULL);
+    
+    if (statusErr == 0) {
+        // Device exists, stop it first
+        swprintf_s(cmd, L"stop %s", alias);
+        mciSendStringW(cmd, NULL, 0, NULL);
+        
+        // Then close it
+        swprintf_s(cmd, L"close %s", alias);
+        MCIERROR closeErr = mciSendStringW(cmd, NULL, 0, NULL);
+        
+        // If close fails, try again after a short delay
+        if (closeErr != 0) {
+            Sleep(10);
+            swprintf_s(cmd, L"close %s", alias);
+            mciSendStringW(cmd, NULL, 0, NULL);
+        }
+    }
+}
+
+// Fade out audio file with custom alias (gradual volume decrease)
+void FadeOutAudioFileWithAlias(const wchar_t* alias, float fadeoutProgress) {
+    // fadeoutProgress: 0.0 = full volume, 1.0 = silent
+    int volume = (int)(1000 * (1.0f - fadeoutProgress)); // MCI volume: 0-1000
+    volume = max(0, min(1000, volume));
+    
+    wchar_t cmd[128];
+    swprintf_s(cmd, L"setaudio %s volume to %d", alias, volume);
+    mciSendStringW(cmd, NULL, 0, NULL);
+    
+    // If fully faded out, stop the sound
+    if (fadeoutProgress >= 1.0f) {
+        StopAudioFileWithAlias(alias);
+    }
+}
+
+void SoundThreadProc() {
+    float lastEngineRPM = 0.0f;
+    auto lastEngineTime = chrono::high_resolution_clock::now();
+    bool isAccelerating = false;
+    bool wasAccelerating = false; // Track previous state for edge detection
+    bool bgmStarted = false;
+    uint64_t eventCursor = g_events.Head();
+    
+    while (running.load()) {
+        GameState state = currentState.load();
+        
+        // Background music - start only when entering the map (KERNEL_RUNNING)
+        if (state == KERNEL_RUNNING) {
+            if (!bgmStarted && !bgm_playing.load()) {
+                // Try to play background music with loop
+                if (PlayAudioFile(BGM_FILE, true)) {
+                    bgm_playing.store(true);
+                    bgmStarted = true;
+                }
+            } else if (bgm_playing.load()) {
+                // Ensure BGM keeps looping - check if it's still playing
+                // If it stopped, restart it
+                wchar_t statusCmd[128];
+                wchar_t status[128];
+                swprintf_s(statusCmd, L"status audio_file mode");
+                MCIERROR err = mciSendStringW(statusCmd, status, 128, NULL);
+                if (err == 0) {
+                    // Check if stopped (should be "playing" or "stopped")
+                    wstring statusStr(status);
+                    if (statusStr.find(L"stopped") != wstring::npos || statusStr.find(L"not ready") != wstring::npos) {
+                        // Restart BGM with loop
+                        PlayAudioFile(BGM_FILE, true);
+                    }
+                }
+            }
+        } else {
+            // Stop BGM when not in game (menu, game over, win, etc.)
+            if (bgm_playing.load()) {
+                StopAudioFile();
+                bgm_playing.store(false);
+                bgmStarted = false;
+            }
+        }
+        
+        if (state == KERNEL_RUNNING) {
+            float currentSpeed = 0.0f;
+            bool accelPressed = false;
+            currentSpeed = g_playerSnapshot.Read().fSpeed;
+            accelPressed = input_accel.load();
+            int steerInput = input_steer.load();
+            
+            // Engine sound plays when moving (speed > 0)
+            // RPM is based on speed, higher when accelerating
+            isAccelerating = accelPressed && currentSpeed < MAX_SPEED;
+            
+            // Brake sound handling - physics raises GEV_BRAKE when steering
+            // starts; stop immediately when key released
+            if (steerInput == 0) {
+                // Stop brake sound immediately when steering stops (steerInput == 0)
+                // Always check and stop if playing when steering is released
+                if (brake_sound_playing.load()) {
+                    // Force stop and close the audio file
+                    wchar_t cmd[128];
+                    swprintf_s(cmd, L"stop brake_sound");
+                    mciSendStringW(cmd, NULL, 0, NULL);
+                    swprintf_s(cmd, L"close brake_sound");
+                    mciSendStringW(cmd, NULL, 0, NULL);
+                    brake_sound_playing.store(false);
+                }
+            }
+            
+            // Calculate engine RPM based on speed
+            // Base RPM from speed (idle at 800 RPM when moving, up to 4000 RPM at max speed)
+            float targetRPM = 0.0f;
+            if (currentSpeed > 0.1f) {
+                // Base RPM from speed: 800 RPM (idle) to 3500 RPM (max speed)
+                targetRPM = 800.0f + (currentSpeed / MAX_SPEED) * 2700.0f;
+                
+                // Add extra RPM when accelerating
+                if (isAccelerating) {
+                    targetRPM += 500.0f; // Higher RPM when accelerating (up to 4000 RPM)
+                }
+            } else {
+                // No RPM when stopped
+                targetRPM = 0.0f;
+            }
+            
+            // Smooth RPM transition
+            float rpmChangeRate = (currentSpeed > 0.1f) ? 0.3f : 0.5f; // Faster decay when stopping
+            float currentRPM = lastEngineRPM + (targetRPM - lastEngineRPM) * rpmChangeRate;
+            if (currentRPM < 50.0f) currentRPM = 0.0f; // Stop completely when low
+            lastEngineRPM = currentRPM;
+            engineRPM.store(currentRPM);
+            
+            // Play engine sounds when moving (speed > 0)
+            if (currentSpeed > 0.1f) {
+                // Play idle engine sound (always when moving) - ensure it keeps playing
+                if (!engine_idle_playing.load()) {
+                    if (!PlayAudioFileWithAlias(ENGINE_IDLE_FILE, L"engine_idle", true)) {
+                        // Fallback to beep-based engine sound
+                        engine_idle_playing.store(true);
+                    } else {
+                        engine_idle_playing.store(true);
+                        // Set full volume for idle sound
+                        wchar_t cmd[128];
+                        swprintf_s(cmd, L"setaudio engine_idle volume to 1000");
+                        mciSendStringW(cmd, NULL, 0, NULL);
+                    }
+                } else {
+                    // Ensure idle sound keeps playing and is at full volume (prevent fadeout)
+                    wchar_t cmd[128];
+                    swprintf_s(cmd, L"setaudio engine_idle volume to 1000");
+                    mciSendStringW(cmd, NULL, 0, NULL);
+                }
+                
+                // Play acceleration sound when accelerating
+                // Restart acceleration sound each time acceleration key is pressed (edge detection)
+                if (isAccelerating) {
+                    // If just started accelerating (edge detection), restart the sound
+                    if (!wasAccelerating) {
+                        // Stop and restart acceleration sound to reset playback
+                        // Always close existing first to avoid conflicts
+                        if (engine_accel_playing.load()) {
+                            // Use proper stop function to ensure cleanup
+                            StopAudioFileWithAlias(L"engine_accel");
+                            engine_accel_playing.store(false);
+                            Sleep(30); // Longer delay to ensure system releases resources
+                        }
+                        // Start playing acceleration sound (will overlay with idle sound)
+                        if (PlayAudioFileWithAlias(ENGINE_ACCEL_FILE, L"engine_accel", true)) {
+                            engine_accel_playing.store(true);
+                        } else {
+                            // File not found or resource error, reset state
+                            engine_accel_playing.store(false);
+                        }
+                    }
+                    // If already accelerating, verify it's still playing
+                    else if (engine_accel_playing.load()) {
+                        // Check if sound is actually playing, restart if needed
+                        wchar_t statusCmd[128];
+                        wchar_t status[128];
+                        swprintf_s(statusCmd, L"status engine_accel mode");
+                        MCIERROR err = mciSendStringW(statusCmd, status, 128, NULL);
+                        if (err != 0) {
+                            // Device not found or error, restart it
+                            if (PlayAudioFileWithAlias(ENGINE_ACCEL_FILE, L"engine_accel", true)) {
+                                engine_accel_playing.store(true);
+                            } else {
+                                engine_accel_playing.store(false);
+                            }
+                        } else {
+                            wstring statusStr(status);
+                            if (statusStr.find(L"stopped") != wstring::npos) {
+                                // Restart if stopped
+                                wchar_t playCmd[128];
+                                swprintf_s(playCmd, L"play engine_accel repeat");
+                                mciSendStringW(playCmd, NULL, 0, NULL);
+                            }
+                        }
+                    }
+                } else {
+                    // Stop acceleration sound immediately when not accelerating (key released)
+                    if (engine_accel_playing.load()) {
+                        // Use proper stop function
+                        StopAudioFileWithAlias(L"engine_accel");
+                        engine_accel_playing.store(false);
+                    }
+                }
+                
+                // Update previous state for next frame
+                wasAccelerating = isAccelerating;
+                
+                // If using beep fallback, play beep sound based on RPM
+                if (engine_idle_playing.load() || engine_accel_playing.load()) {
+                    auto now = chrono::high_resolution_clock::now();
+                    auto elapsed = chrono::duration_cast<chrono::milliseconds>(now - lastEngineTime).count();
+                    
+                    if (currentRPM > 100.0f && elapsed > 80) {
+                        lastEngineTime = now;
+                        
+                        // Base frequency from RPM
+                        int baseFreq = (int)(currentRPM / 120.0f);
+                        baseFreq = max(80, min(baseFreq, 600));
+                        
+                        // Play engine sound - louder/higher when accelerating
+                        std::thread([baseFreq, currentRPM, isAccelerating]() {
+                            int duration = isAccelerating ? 70 : 50; // Longer when accelerating
+                            Beep(baseFreq, duration);
+                            Sleep(5);
+                            Beep(baseFreq * 2, isAccelerating ? 50 : 35);
+                            if (currentRPM > 2000) {
+                                Sleep(5);
+                                Beep((int)(baseFreq * 1.5f), isAccelerating ? 40 : 25);
+                            }
+                        }).detach();
+                    }
+                }
+            } else {
+                // Stop all engine sounds when stopped (speed = 0)
+                if (engine_idle_playing.load()) {
+                    StopAudioFileWithAlias(L"engine_idle");
+                    engine_idle_playing.store(false);
+                }
+                if (engine_accel_playing.load()) {
+                    StopAudioFileWithAlias(L"engine_accel");
+                    engine_accel_playing.store(false);
+                }
+            }
+            
+            lastSpeed.store(currentSpeed);
+        } else {
+            // Stop all engine sounds when not in game
+            if (engine_idle_playing.load()) {
+                StopAudioFileWithAlias(L"engine_idle");
+                engine_idle_playing.store(false);
+            }
+            if (engine_accel_playing.load()) {
+                StopAudioFileWithAlias(L"engine_accel");
+                engine_accel_playing.store(false);
+            }
+            if (brake_sound_playing.load()) {
+                // Force stop and close the audio file
+                wchar_t cmd[128];
+                swprintf_s(cmd, L"stop brake_sound");
+                mciSendStringW(cmd, NULL, 0, NULL);
+                swprintf_s(cmd, L"close brake_sound");
+                mciSendStringW(cmd, NULL, 0, NULL);
+                brake_sound_playing.store(false);
+            }
+        }
+        
+        GameEvent ev;
+        while (g_events.Poll(eventCursor, ev)) {
+            // Brake sound - try file first, fallback to beep
+            if (ev.nType == GEV_BRAKE) {
+                // Stop any existing brake sound first (synchronously)
+                if (brake_sound_playing.load()) {
+                    wchar_t cmd[128];
+                    swprintf_s(cmd, L"stop brake_sound");
+                    mciSendStringW(cmd, NULL, 0, NULL);
+                    swprintf_s(cmd, L"close brake_sound");
+                    mciSendStringW(cmd, NULL, 0, NULL);
+                    brake_sound_playing.store(false);
+                }
+                // Play brake sound without loop (play once)
+                if (!PlayAudioFileWithAlias(BRAKE_SOUND_FILE, L"brake_sound", false)) {
+                    // Fallback to beep - short brake sound
+                    Beep(300, 50);
+                    Sleep(10);
+                    Beep(250, 40);
+                    brake_sound_playing.store(false);
+                } else {
+                    brake_sound_playing.store(true);
+                }
+            }
+        
+            // Crash sound - try file first, fallback to beep
+            if (ev.nType == GEV_CRASH) {
+                std::thread([]() {
+                    if (!PlayAudioFile(CRASH_SOUND_FILE, false)) {
+                        // Fallback to beep
+                        Beep(150, 200);
+                        Sleep(50);
+                        Beep(100, 300);
+                    }
+                }).detach();
+            }
+        
+            // Game Over sound - try file first, fallback to beep
+            if (ev.nType == GEV_GAME_OVER) {
+                std::thread([]() {
+                    // Stop background music when game over
+                    if (bgm_playing.load()) {
+                        StopAudioFile();
+                        bgm_playing.store(false);
+                    }
+                
+                    // Play game over sound
+                    if (!PlayAudioFile(GAMEOVER_SOUND_FILE, false)) {
+                        // Fallback to beep - dramatic game over sound
+                        Beep(200, 300);
+                        Sleep(100);
+                        Beep(150, 400);
+                        Sleep(100);
+                        Beep(100, 500);
+                    }
+                }).detach();
+            }
+        
+            // Victory sound - try file first, fallback to beep
+            if (ev.nType == GEV_WIN) {
+                // Stop BGM when victory
+                if (bgm_playing.load()) {
+                    StopAudioFile();
+                    bgm_playing.store(false);
+                    bgmStarted = false;
+                }
+                // Stop all engine sounds
+                if (engine_idle_playing.load()) {
+                    StopAudioFileWithAlias(L"engine_idle");
+                    engine_idle_playing.store(false);
+                }
+                if (engine_accel_playing.load()) {
+                    StopAudioFileWithAlias(L"engine_accel");
+                    engine_accel_playing.store(false);
+                }
+                // Give system time to stop all sounds
+                Sleep(50);
+            
+                // Play victory sound (synchronously to ensure it plays)
+                // Try MP3 first, then WAV
+                bool played = false;
+                if (!PlayAudioFile(WIN_SOUND_FILE, false)) {
+                    // Try WAV version if MP3 fails
+                    const wchar_t* winWav = L"victory.wav";
+                    if (!PlayAudioFile(winWav, false)) {
+                        // Fallback to beep fanfare
+                        Beep(523, 200);
+                        Sleep(50);
+                        Beep(659, 200);
+                        Sleep(50);
+                        Beep(784, 200);
+                        Sleep(50);
+                        Beep(1047, 400);
+                    } else {
+                        played = true;
+                    }
+                } else {
+                    played = true;
+                }
+            }
+        }
+        
+        // Wake early for events; engine and BGM state is still checked every 50ms
+        g_events.Wait(eventCursor, 50);
+    }
+    
+    // Cleanup on exit
+    if (bgm_playing.load()) {
+        StopAudioFile();
+    }
+    if (engine_idle_playing.load()) {
+        StopAudioFileWithAlias(L"engine_idle");
+    }
+    if (engine_accel_playing.load()) {
+        StopAudioFileWithAlias(L"engine_accel");
+    }
+}
+
+// =================================================================
+// Telemetry
+// =================================================================
+// a.exe --telemetry <file>: appends every game event as a TSV row, with the
+// delay between the tick being due and this reader receiving it.
+const char* g_telemetryPath = nullptr;
+
+void TelemetryThreadProc() {
+    FILE* f = fopen(g_telemetryPath, "a");
+    if (!f) return;
+    fprintf(f, "tick\ttime\tmap\tevent\tdist\tx\tspeed\tlatency_ms\tlost\n");
+    uint64_t cursor = g_events.Head(), lost = 0;
+    while (running.load()) {
+        g_events.Wait(cursor, 100);
+        double now = chrono::duration<double>(chrono::steady_clock::now().time_since_epoch()).count();
+        GameEvent e;
+        bool any = false;
+        while (g_events.Poll(cursor, e, &lost)) {
+            fprintf(f, "%llu\t%.6f\t%d\t%ls\t%.3f\t%.4f\t%.3f\t%.3f\t%llu\n", (unsigned long long)e.nTick, e.fTime,
+                    e.nMapId, GameEventName(e.nType), e.fDistance, e.fX, e.fSpeed, (now - e.fTime) * 1000.0,
+                    (unsigned long long)lost);
+            any = true;
+        }
+        if (any) fflush(f);
+    }
+    fclose(f);
+}
+
+// =================================================================
+// Utility Draw Functions
+// =================================================================
+void KernelDrawBox(wchar_t* s, int x, int y, int w, int h) {
+    for (int i = 0; i < h; ++i) for (int j = 0; j < w; ++j) {
+        int px = x + j, py = y + i;
+        if (px < 0 || px >= nScreenWidth || py < 0 || py >= nScreenHeight) continue;
+        wchar_t c = (i == 0 || i == h - 1) ? L'═' : (j == 0 || j == w - 1) ? L'║' : L' ';
+        if (i == 0 && j == 0) c = L'╔';
+        if (i == 0 && j == w - 1) c = L'╗';
+        if (i == h - 1 && j == 0) c = L'╚';
+        if (i == h - 1 && j == w - 1) c = L'╝';
+        s[py * nScreenWidth + px] = c;
+    }
+}
+
+// Takes a plain string so literals draw without building a wstring
+void KernelDrawString(wchar_t* s, int x, int y, const wchar_t* t) {
+    for (size_t i = 0; t[i]; ++i) {
+        int px = x + (int)i;
+        if (px < 0 || px >= nScreenWidth) continue;
+        if (y >= 0 && y < nScreenHeight) s[y * nScreenWidth + px] = t[i];
+    }
+}
+
+// =================================================================
+// Worker Pool
+// =================================================================
+// Fixed set of threads for data-parallel loops. The caller takes part in
+// every ParallelFor, so a pool built with 0 workers runs inline.
+class WorkerPool {
+public:
+    explicit WorkerPool(int threads) {
+        for (int i = 0; i < threads; ++i) workers.emplace_back([this]() { WorkerLoop(); });
+    }
+
+    ~WorkerPool() {
+        {
+            std::lock_guard<std::mutex> lk(m);
+            bStop = true;
+        }
+        cvWork.notify_all();
+        for (auto& t : workers) t.join();
+    }
+
+    int Size() const { return (int)workers.size() + 1; }
+
+    // Runs fn(i) for every i in [0, n); returns once all calls have finished.
+    // Callers on different threads take turns.
+    void ParallelFor(int n, const std::function<void(int)>& fn) {
+        if (n <= 0) return;
+        if (workers.empty() || n == 1) {
+            for (int i = 0; i < n; ++i) fn(i);
+            return;
+        }
+        std::lock_guard<std::mutex> caller(callMutex);
+        {
+            std::lock_guard<std::mutex> lk(m);
+            job = &fn;
+            nJobs = n;
+            nNext.store(0);
+            nBusy = (int)workers.size();
+            generation++;
+        }
+        cvWork.notify_all();
+        Drain();
+        std::unique_lock<std::mutex> lk(m);
+        cvDone.wait(lk, [this]() { return nBusy == 0; });
+        job = nullptr;
+    }
+
+private:
+    vector<thread> workers;
+    std::mutex callMutex; // Held for a whole ParallelFor
+    std::mutex m;
+    std::condition_variable cvWork, cvDone;
+    const std::function<void(int)>* job = nullptr;
+    int nJobs = 0;
+    std::atomic<int> nNext{0};
+    int nBusy = 0;
+    uint64_t generation = 0;
+    bool bStop = false;
+
+    void Drain() {
+        for (int i; (i = nNext.fetch_add(1)) < nJobs;) (*job)(i);
+    }
+
+    void WorkerLoop() {
+        uint64_t seen = 0;
+        for (;;) {
+            std::unique_lock<std::mutex> lk(m);
+            cvWork.wait(lk, [&]() { return bStop || generation != seen; });
+            if (bStop) return;
+            seen = generation;
+            lk.unlock();
+            Drain();
+            lk.lock();
+            if (--nBusy == 0) cvDone.notify_one();
+        }
+    }
+};
+
+// Work stealing for batches of independent jobs of uneven length (whole
+// simulated races). Jobs are dealt round-robin into one deque per thread;
+// a thread pops its newest job and, once its deque is empty, steals the
+// oldest job of another. No job spawns jobs, so all-empty means done.
+class StealingPool {
+public:
+    explicit StealingPool(int threads) : nThreads(max(1, threads)) {}
+
+    int Threads() const { return nThreads; }
+
+    // Runs job(i) for every i in [0, n); returns the number of steals
+    uint64_t Run(int n, const std::function<void(int)>& job) {
+        vector<unique_ptr<Queue>> queues;
+        for (int t = 0; t < nThreads; ++t) queues.emplace_back(new Queue());
+        for (int i = 0; i < n; ++i) queues[i % nThreads]->jobs.push_back(i);
+
+        std::atomic<uint64_t> steals(0);
+        auto worker = [&](int self) {
+            int i;
+            while (PopOwn(*queues[self], i) || Steal(queues, self, i, steals)) job(i);
+        };
+        vector<thread> pool;
+        for (int t = 1; t < nThreads; ++t) pool.emplace_back(worker, t);
+        worker(0);
+        for (auto& t : pool) t.join();
+        return steals.load();
+    }
+
+private:
+    struct Queue {
+        std::mutex m;
+        std::deque<int> jobs;
+    };
+    int nThreads;
+
+    static bool PopOwn(Queue& q, int& i) {
+        std::lock_guard<std::mutex> lk(q.m);
+        if (q.jobs.empty()) return false;
+        i = q.jobs.back();
+        q.jobs.pop_back();
+        return true;
+    }
+
+    static bool Steal(vector<unique_ptr<Queue>>& queues, int self, int& i, std::atomic<uint64_t>& steals) {
+        int n = (int)queues.size();
+        for (int k = 1; k < n; ++k) {
+            Queue& q = *queues[(self + k) % n];
+            std::lock_guard<std::mutex> lk(q.m);
+            if (q.jobs.empty()) continue;
+            i = q.jobs.front();
+            q.jobs.pop_front();
+            steals.fetch_add(1, std::memory_order_relaxed);
+            return true;
+        }
+        return false;
+    }
+};
+
+// Process-wide pool sized to the spare cores
+WorkerPool& SharedPool() {
+    static WorkerPool pool((int)max(1u, thread::hardware_concurrency()) - 1);
+    return pool;
+}
+
+// =================================================================
+// Map Generation
+// =================================================================
+// The minimap walks a track in MAP_STEP steps, turning by curvature * 0.01
+// per unit before each step. Inside a segment the turn k is constant, so the
+// walk is an arc and its j-th point is a closed-form sum (h = k / 2):
+//   sum_{m=1..j} sin(a + m k) = (cos(a + h) - cos(a + (2j + 1) h)) / (2 sin h)
+//   sum_{m=1..j} cos(a + m k) = (sin(a + (2j + 1) h) - sin(a + h)) / (2 sin h)
+// Segments depend on each other only through their start heading and
+// position, which are prefix sums, so long tracks are laid out in parallel.
+const float MAP_STEP = 1.0f;
+const int MAP_CHUNK_SEGMENTS = 256; // Segments per parallel task
+const int MAP_EXACT_EVERY = 64;     // Points between exact evaluations in ArcPoints
+
+inline int MapPointCount(float length) { return length > 0.0f ? (int)ceilf(length / MAP_STEP) : 0; }
+inline double MapTurn(float curvature) { return (double)(curvature * MAP_STEP * 0.01f); }
+
+// Offset of point j (1-based) of an arc that starts at heading `angle` and
+// turns by k per step
+inline void ArcOffset(double angle, double k, int j, double& dx, double& dy) {
+    double h = 0.5 * k;
+    if (fabs(h) < 1e-9) { // Straight for all practical purposes
+        dx = j * sin(angle + (j + 1) * h) * MAP_STEP;
+        dy = j * cos(angle + (j + 1) * h) * MAP_STEP;
+        return;
+    }
+    double scale = MAP_STEP / (2.0 * sin(h)), a = angle + h, b = angle + (2 * j + 1) * h;
+    dx = (cos(a) - cos(b)) * scale;
+    dy = (sin(b) - sin(a)) * scale;
+}
+
+// Calls out(j - 1, x, y) for points 1..count of the same arc starting at
+// (x0, y0). Consecutive points differ by a fixed rotation of the angle b, so
+// only every MAP_EXACT_EVERY-th point evaluates sin and cos directly.
+template <typename Out>
+void ArcPoints(double x0, double y0, double angle, double k, int count, Out out) {
+    double h = 0.5 * k;
+    if (fabs(h) < 1e-9) {
+        double dx, dy;
+        for (int j = 1; j <= count; ++j) { ArcOffset(angle, k, j, dx, dy); out(j - 1, x0 + dx, y0 + dy); }
+        return;
+    }
+    double scale = MAP_STEP / (2.0 * sin(h)), ca = cos(angle + h), sa = sin(angle + h);
+    double cr = cos(k), sr = sin(k), cb = 0.0, sb = 0.0;
+    for (int j = 1; j <= count; ++j) {
+        if ((j - 1) % MAP_EXACT_EVERY == 0) {
+            double b = angle + (2 * j + 1) * h;
+            cb = cos(b); sb = sin(b);
+        } else {
+            double c = cb * cr - sb * sr;
+            sb = sb * cr + cb * sr;
+            cb = c;
+        }
+        out(j - 1, x0 + (ca - cb) * scale, y0 + (sb - sa) * scale);
+    }
+}
+
+void GenerateMapPoints(const vector<TrackSegment>& track, vector<pair<float, float>>& points) {
+    int n = (int)track.size();
+    // Scan: first point and start heading of every segment
+    vector<int> begin(n + 1, 0);
+    vector<double> angle(n + 1, 0.0), x(n + 1, 0.0), y(n + 1, 0.0);
+    for (int s = 0; s < n; ++s) {
+        int count = MapPointCount(track[s].fDistance);
+        begin[s + 1] = begin[s] + count;
+        angle[s + 1] = angle[s] + count * MapTurn(track[s].fCurvature);
+    }
+    points.resize(begin[n]);
+    int chunks = (n + MAP_CHUNK_SEGMENTS - 1) / MAP_CHUNK_SEGMENTS;
+    auto forSegments = [&](const std::function<void(int)>& fn) {
+        SharedPool().ParallelFor(chunks, [&](int c) {
+            for (int s = c * MAP_CHUNK_SEGMENTS; s < min(n, (c + 1) * MAP_CHUNK_SEGMENTS); ++s) fn(s);
+        });
+    };
+    // Each segment's end-to-end offset, then a scan for the start positions
+    forSegments([&](int s) {
+        ArcOffset(angle[s], MapTurn(track[s].fCurvature), begin[s + 1] - begin[s], x[s + 1], y[s + 1]);
+    });
+    for (int s = 0; s < n; ++s) { x[s + 1] += x[s]; y[s + 1] += y[s]; }
+    forSegments([&](int s) {
+        pair<float, float>* out = points.data() + begin[s];
+        ArcPoints(x[s], y[s], angle[s], MapTurn(track[s].fCurvature), begin[s + 1] - begin[s],
+                  [out](int i, double px, double py) { out[i] = make_pair((float)px, (float)py); });
+    });
+}
+
+// Level of detail: a minimap box is a few dozen cells across, so the
+// outline only has to stay within half a cell of a MAP_LOD_CELLS-wide box.
+// Douglas-Peucker keeps just the walk points needed for that, so the vertex
+// count follows the shape at screen resolution rather than the track length.
+// Distances are measured after normalizing each axis, as the box stretches them.
+const int MAP_LOD_CELLS = 128;
+
+void SimplifyMapPoints(const vector<pair<float, float>>& points, vector<MapVertex>& out) {
+    out.clear();
+    size_t n = points.size();
+    if (n == 0) return;
+    float minX = 1e9f, maxX = -1e9f, minY = 1e9f, maxY = -1e9f;
+    for (auto& pt : points) {
+        minX = min(minX, pt.first); maxX = max(maxX, pt.first);
+        minY = min(minY, pt.second); maxY = max(maxY, pt.second);
+    }
+    float rx = (maxX - minX) != 0.0f ? (maxX - minX) : 1.0f;
+    float ry = (maxY - minY) != 0.0f ? (maxY - minY) : 1.0f;
+    auto ux = [&](size_t i) { return (points[i].first - minX) / rx; };
+    auto uy = [&](size_t i) { return (points[i].second - minY) / ry; };
+
+    const float tolerance = 0.5f / MAP_LOD_CELLS;
+    vector<uint8_t> keep(n, 0);
+    keep[0] = keep[n - 1] = 1;
+    vector<pair<size_t, size_t>> spans; // Explicit stack: walks can be millions of points
+    if (n > 2) spans.push_back(make_pair((size_t)0, n - 1));
+    while (!spans.empty()) {
+        size_t lo = spans.back().first, hi = spans.back().second;
+        spans.pop_back();
+        float ax = ux(lo), ay = uy(lo), dx = ux(hi) - ax, dy = uy(hi) - ay;
+        float len2 = dx * dx + dy * dy;
+        size_t worst = 0;
+        float worstDist2 = tolerance * tolerance;
+        for (size_t i = lo + 1; i < hi; ++i) {
+            // Distance to the chord as a segment, so loops back past an end still count
+            float px = ux(i) - ax, py = uy(i) - ay;
+            float t = len2 > 0.0f ? max(0.0f, min(1.0f, (px * dx + py * dy) / len2)) : 0.0f;
+            float ex = px - t * dx, ey = py - t * dy, d2 = ex * ex + ey * ey;
+            if (d2 > worstDist2) { worstDist2 = d2; worst = i; }
+        }
+        if (worst == 0) continue;
+        keep[worst] = 1;
+        spans.push_back(make_pair(lo, worst));
+        spans.push_back(make_pair(worst, hi));
+    }
+    for (size_t i = 0; i < n; ++i) {
+        if (!keep[i]) continue;
+        MapVertex v;
+        v.x = (int16_t)lround(ux(i) * MAP_QUANT_MAX);
+        v.y = (int16_t)lround(uy(i) * MAP_QUANT_MAX);
+        v.nUnit = (uint32_t)i;
+        out.push_back(v);
+    }
+}
+
+// Number of walk points the outline stands for
+inline int MapUnitCount(ArrayView<MapVertex> p) { return p.empty() ? 0 : (int)p.back().nUnit + 1; }
+
+// Position of walk point `unit` on the outline, in [0, 1] on each axis
+pair<float, float> MapOutlineAt(ArrayView<MapVertex> p, int unit) {
+    const MapVertex* b = upper_bound(p.begin(), p.end(), (uint32_t)max(0, unit),
+                                     [](uint32_t u, const MapVertex& v) { return u < v.nUnit; });
+    const MapVertex* a = b == p.begin() ? b : b - 1;
+    if (b == p.end()) b = a;
+    float t = b->nUnit != a->nUnit ? (float)(unit - (int)a->nUnit) / (float)(b->nUnit - a->nUnit) : 0.0f;
+    return make_pair((a->x + (b->x - a->x) * t) / MAP_QUANT_MAX, (a->y + (b->y - a->y) * t) / MAP_QUANT_MAX);
+}
+
+// Minimap outlines by track geometry. The tracks shown most recently keep
+// theirs, so switching maps, or loading the map a preview was drawn from,
+// is a lookup. A table evicted here lives on while a track still shares it.
+const size_t MAP_CACHE_ENTRIES = 8;
+
+shared_ptr<const vector<MapVertex>> MapOutlineFor(const vector<TrackSegment>& track) {
+    typedef pair<vector<pair<float, float>>, shared_ptr<const vector<MapVertex>>> Entry;
+    static vector<Entry> cache; // (curvature, length) per segment -> outline; most recent last
+    static std::mutex cacheMutex;
+    vector<pair<float, float>> key(track.size());
+    for (size_t i = 0; i < track.size(); ++i) key[i] = make_pair(track[i].fCurvature, track[i].fDistance);
+
+    std::lock_guard<std::mutex> lk(cacheMutex);
+    for (size_t i = 0; i < cache.size(); ++i) {
+        if (cache[i].first != key) continue;
+        rotate(cache.begin() + i, cache.begin() + i + 1, cache.end());
+        return cache.back().second;
+    }
+    vector<pair<float, float>> points;
+    GenerateMapPoints(track, points);
+    auto outline = std::make_shared<vector<MapVertex>>();
+    SimplifyMapPoints(points, *outline);
+    g_mapPointsVersion++;
+    if (cache.size() >= MAP_CACHE_ENTRIES) cache.erase(cache.begin());
+    cache.push_back(Entry(move(key), outline));
+    return outline;
+}
+
+void BuildTrackData(int id, vector<TrackSegment>& t) {
+    t.clear();
+    if (id == 1) { // ADVANCED S-CURVE (No Obstacles)
+        t.push_back({ 0.0f, 80 });
+        t.push_back({ 0.6f, 250 });
+        t.push_back({-0.6f, 250 });
+        t.push_back({ 0.0f, 100 });
+        t.push_back({ 0.8f, 200 });
+        t.push_back({ 0.0f, 120 });
+    }
+    else if (id == 2) { // EXPERT SLALOM (Some Obstacles)
+        t.push_back({ 0.0f, 100 });
+        t.push_back({ 0.7f, 150 });
+        t.push_back({-0.5f, 150 });
+        t.push_back({ 0.9f, 200 });
+        t.push_back({ 0.0f, 100 });
+        t.push_back({-0.8f, 180 });
+        t.push_back({ 0.6f, 200 });
+        t.push_back({ 0.0f, 150 });
+        t.push_back({ 1.0f, 120 });
+        t.push_back({ 0.0f, 100 });
+        // Obstacles
+        t[4].vecObstacles.push_back({ 20.0f, 0.4f, 0.3f });
+        t[4].vecObstacles.push_back({ 70.0f, -0.5f, 0.4f });
+        t[5].vecObstacles.push_back({ 80.0f, 0.6f, 0.3f });
+    }
+    else if (id == 3) { // EXTREME CIRCULAR (More Obstacles)
+        t.push_back({ 0.0f, 100 });
+        t.push_back({ 0.8f, 200 });
+        t.push_back({-0.6f, 150 });
+        t.push_back({ 0.6f, 180 });
+        t.push_back({-0.8f, 200 });
+        t.push_back({ 0.5f, 150 });
+        t.push_back({-0.5f, 150 });
+        t.push_back({ 0.8f, 200 });
+        t.push_back({-0.8f, 200 });
+        t.push_back({ 0.0f, 100 });
+        // Obstacles
+        t[1].vecObstacles.push_back({ 50.0f, -0.6f, 0.3f });
+        t[1].vecObstacles.push_back({150.0f, 0.6f, 0.3f });
+        t[3].vecObstacles.push_back({ 40.0f, 0.0f, 0.5f });
+        t[5].vecObstacles.push_back({100.0f, -0.4f, 0.4f });
+        t[7].vecObstacles.push_back({ 70.0f, 0.3f, 0.2f });
+    }
+}
+
+// Synthetic track for scaling tests: `segments` curves of 50-250 units and
+// `obstacles` obstacles spread uniformly over them. The same seed always
+// gives the same track.
+void BuildStressTrack(int segments, int obstacles, uint32_t seed, vector<TrackSegment>& t) {
+    mt19937 rng(seed);
+    uniform_real_distribution<float> curvature(-1.0f, 1.0f), length(50.0f, 250.0f), unit(0.0f, 1.0f);
+    t.clear();
+    t.push_back({ 0.0f, 100 }); // Clear run-up, like the built-in maps
+    for (int i = 1; i < segments; ++i) t.push_back({ curvature(rng), floorf(length(rng)) });
+    for (int i = 0; i < obstacles; ++i) {
+        TrackSegment& seg = t[1 + rng() % (uint32_t)max(1, segments - 1)];
+        float width = 0.2f + 0.3f * unit(rng);
+        float offset = (ROAD_WIDTH_LIMIT - width * 0.5f) * (unit(rng) * 2.0f - 1.0f);
+        seg.vecObstacles.push_back({ floorf(unit(rng) * seg.fDistance), offset, width });
+    }
+}
+
+void InitMaps() {
+    vector<TrackSegment> tmp;
+    for (int i = 0; i < 3; i++) {
+        BuildTrackData(i + 1, tmp);
+        vecMapPreview[i] = MapOutlineFor(tmp);
+    }
+}
+
+void ReleaseTrackFile();
+bool LoadTrackFile(const char* path);
+const char* g_trackPath = nullptr; // a.exe --track <file>: replaces the built-in maps
+uint64_t g_trackHash = 0; // Source content hash of the loaded track file; 0 for the built-in maps
+void StartEndlessTrack();
+bool g_endlessTrack = false; // a.exe --endless [seed]: streamed procedural track
+uint32_t g_endlessSeed = 1;
+
+// Derives the minimap, segment tables and obstacle index from vecTrack
+void InstallTrack() {
+    vecMapPointsCurrent.Share(MapOutlineFor(vecTrack));
+    g_mapPointsVersion++;
+    vector<float> segCurvature;
+    vector<int64_t> segStartQ(1, 0);
+    vector<int32_t> segCurvatureQ;
+    fTotalTrackLength = 0.0f;
+    for (auto& s : vecTrack) {
+        fTotalTrackLength += s.fDistance;
+        segCurvature.push_back(s.fCurvature);
+        segStartQ.push_back(segStartQ.back() + ToQ16Wide(s.fDistance));
+        segCurvatureQ.push_back(ToQ16(s.fCurvature));
+    }
+    vecSegCurvature.Assign(move(segCurvature));
+    vecSegStartQ.Assign(move(segStartQ));
+    vecSegCurvatureQ.Assign(move(segCurvatureQ));
+    BuildObstacleIndex(vecTrack, obstacleIndex);
+    ReleaseTrackFile();
+}
+
+void LoadMap(int id) {
+    g_currentMapId = id;
+    g_trackHash = 0;
+    if (g_endlessTrack) { StartEndlessTrack(); return; }
+    if (g_trackPath && LoadTrackFile(g_trackPath)) return;
+    BuildTrackData(id, vecTrack);
+    InstallTrack();
+}
+
+// =================================================================
+// Mini-map Rendering
+// =================================================================
+// The box, the track and its obstacles depend only on the outline, the box
+// and the obstacle table, so each combination is rasterized once and copied
+// into the frame a row at a time; only the car markers are drawn per frame.
+// The last few rasters are kept, so flipping between map previews in the
+// menu does not rebuild them.
+struct MinimapRaster {
+    const MapVertex* pPoints = nullptr; // Tells outlines of one g_mapPointsVersion apart
+    size_t nPoints = 0;
+    uint32_t nPointsVersion = 0;
+    int x = 0, y = 0, w = 0, h = 0;
+    uint32_t nObstacleVersion = 0;
+    int x0 = 0, x1 = 0, y0 = 0, y1 = 0; // The box clipped to the screen
+    vector<wchar_t> cells;               // (x1 - x0) * (y1 - y0), row-major
+};
+const int MINIMAP_RASTERS = 4;
+
+// Buffer offset of an outline position inside the box, or -1
+inline int MinimapCell(pair<float, float> u, int x, int y, int w, int h, bool bInner) {
+    int px = x + 2 + (int)(u.first * (w - 4));
+    int py = y + h - 2 - (int)(u.second * (h - 4));
+    int b = bInner ? 1 : 0;
+    if (px < x + b || px >= x + w - b || py < y + b || py >= y + h - b) return -1;
+    return py * nScreenWidth + px;
+}
+
+void BuildMinimapRaster(MinimapRaster& r, int x, int y, int w, int h, ArrayView<MapVertex> p, uint32_t pointsVersion) {
+    const ObstacleIndex& oi = obstacleIndex;
+    r.pPoints = p.data(); r.nPoints = p.size(); r.nPointsVersion = pointsVersion;
+    r.x = x; r.y = y; r.w = w; r.h = h;
+    r.nObstacleVersion = oi.nVersion;
+    r.x0 = max(0, x); r.x1 = min(nScreenWidth, x + w);
+    r.y0 = max(0, y); r.y1 = min(nScreenHeight, y + h);
+
+    // Drawn in place on a scratch screen, then the box is cut out of it
+    vector<wchar_t> s(nScreenWidth * nScreenHeight, L' ');
+    KernelDrawBox(s.data(), x, y, w, h);
+    KernelDrawString(s.data(), x + 1, y + 1, L"TRACK MAP");
+    if (!p.empty()) {
+        auto plot = [&](pair<float, float> u, wchar_t ch) {
+            int cell = MinimapCell(u, x, y, w, h, true);
+            if (cell >= 0) s[cell] = ch;
+        };
+        // Each outline edge sampled at least twice per cell it crosses
+        float cellsX = (float)max(1, w - 4), cellsY = (float)max(1, h - 4);
+        for (size_t i = 0; i < p.size(); ++i) {
+            pair<float, float> b((float)p[i].x / MAP_QUANT_MAX, (float)p[i].y / MAP_QUANT_MAX);
+            if (i == 0) { plot(b, CHAR_FULL); continue; }
+            pair<float, float> a((float)p[i - 1].x / MAP_QUANT_MAX, (float)p[i - 1].y / MAP_QUANT_MAX);
+            int steps = 1 + (int)(2.0f * max(fabsf(b.first - a.first) * cellsX, fabsf(b.second - a.second) * cellsY));
+            for (int k = 1; k <= steps; ++k) {
+                float t = (float)k / steps;
+                plot(make_pair(a.first + (b.first - a.first) * t, a.second + (b.second - a.second) * t), CHAR_FULL);
+            }
+        }
+        // Obstacles as 'X', over the track and, in the frame, over the markers
+        int units = MapUnitCount(p);
+        for (int i = 0; i < oi.Size(); ++i) {
+            float globalObsDist = FromQ16(oi.nDistQ[i]);
+            if (globalObsDist > fTotalTrackLength) break;
+            if (globalObsDist < 0) continue;
+            int idx = (int)((globalObsDist / (fTotalTrackLength > 0 ? fTotalTrackLength : 1.0f)) * units);
+            plot(MapOutlineAt(p, max(0, min(units - 1, idx))), L'╳');
+        }
+    }
+    r.cells.resize((size_t)max(0, r.x1 - r.x0) * max(0, r.y1 - r.y0));
+    for (int row = r.y0; row < r.y1; ++row)
+        copy(s.begin() + row * nScreenWidth + r.x0, s.begin() + row * nScreenWidth + r.x1,
+             r.cells.begin() + (row - r.y0) * (r.x1 - r.x0));
+}
+
+void DrawTrackView(wchar_t* s, int x, int y, int w, int h,
+                   ArrayView<MapVertex> p,
+                   float fPlayerDist, float fGhostDist = -1.0f, // Negative distance = no marker
+                   const float* pOpponentDist = nullptr, int nOpponents = 0) {
+    static MinimapRaster rasters[MINIMAP_RASTERS]; // Render thread only; most recent first
+    const ObstacleIndex& oi = obstacleIndex;
+    uint32_t pointsVersion = g_mapPointsVersion.load();
+    int k = 0;
+    while (k < MINIMAP_RASTERS && !(rasters[k].nPointsVersion == pointsVersion &&
+                                    rasters[k].pPoints == p.data() && rasters[k].nPoints == p.size() &&
+                                    rasters[k].x == x && rasters[k].y == y && rasters[k].w == w && rasters[k].h == h &&
+                                    rasters[k].nObstacleVersion == oi.nVersion && !rasters[k].cells.empty()))
+        k++;
+    if (k == MINIMAP_RASTERS) {
+        k = MINIMAP_RASTERS - 1;
+        BuildMinimapRaster(rasters[k], x, y, w, h, p, pointsVersion);
+    }
+    rotate(rasters, rasters + k, rasters + k + 1);
+    const MinimapRaster& r = rasters[0];
+    int span = r.x1 - r.x0;
+    for (int row = r.y0; row < r.y1; ++row)
+        memcpy(s + row * nScreenWidth + r.x0, r.cells.data() + (row - r.y0) * span, span * sizeof(wchar_t));
+    if (p.empty()) return;
+
+    // Markers: one outline lookup each. Obstacles keep their cells, and the
+    // player, drawn last, wins a cell shared with another car.
+    int units = MapUnitCount(p);
+    auto mark = [&](float d, wchar_t ch) {
+        if (d < 0.0f || d > fTotalTrackLength) return;
+        int idx = min((int)((d / (fTotalTrackLength > 0 ? fTotalTrackLength : 1.0f)) * units), units - 1);
+        int cell = MinimapCell(MapOutlineAt(p, idx), x, y, w, h, false);
+        if (cell < 0) return;
+        int px = cell % nScreenWidth, py = cell / nScreenWidth;
+        if (px >= r.x0 && px < r.x1 && py >= r.y0 && py < r.y1 && r.cells[(py - r.y0) * span + (px - r.x0)] != L'╳')
+            s[cell] = ch;
+    };
+    for (int i = 0; i < nOpponents; ++i) mark(pOpponentDist[i], L'●');
+    mark(fGhostDist, L'◆');
+    mark(fPlayerDist, L'★');
+}
+
+// =================================================================
+// Boundary & Collision
+// =================================================================
+// Returns true when a car at (dist, x) overlaps an obstacle within +-0.5 units.
+// `dist` is measured from originQ (the car's PlayerPCB::nOriginQ).
+bool ObstacleHit(float dist, float x, int64_t originQ, ObstacleCursor& cursor) {
+    const ObstacleIndex& oi = obstacleIndex;
+    int i = ObstacleSeek(cursor, dist - 0.5f, originQ);
+    while (i > oi.First() && oi.Dist(i - 1, originQ) >= dist - 0.5f) i--;
+    for (; i < oi.Size() && oi.Dist(i, originQ) <= dist + 0.5f; ++i) {
+        float fPlayerLeft = x - PLAYER_HALF_WIDTH;
+        float fPlayerRight = x + PLAYER_HALF_WIDTH;
+        float fObsLeft = oi.fOffsetX[i] - oi.fWidth[i] / 2.0f;
+        float fObsRight = oi.fOffsetX[i] + oi.fWidth[i] / 2.0f;
+        if (max(fPlayerLeft, fObsLeft) < min(fPlayerRight, fObsRight)) return true;
+    }
+    return false;
+}
+
+// ---- Swept tests ----
+// Within a tick a car moves on the straight path (d0, x0) -> (d1, x1). These
+// return the fraction t in [0, 1] of the tick at which the path first
+// touches a road edge or obstacle, or -1. Obstacles are the +-0.5 unit
+// window along the track widened by the car's half width (Minkowski sum),
+// so the car is a point and fast cars cannot step over anything.
+
+// Narrows [tIn, tOut] to the part of the path where a0 -> a1 lies in [lo, hi]
+bool SlabClip(float a0, float a1, float lo, float hi, float& tIn, float& tOut) {
+    float da = a1 - a0;
+    if (da == 0.0f) return a0 >= lo && a0 <= hi;
+    float t0 = (lo - a0) / da, t1 = (hi - a0) / da;
+    if (t0 > t1) swap(t0, t1);
+    tIn = max(tIn, t0);
+    tOut = min(tOut, t1);
+    return tIn <= tOut;
+}
+
+// The end-of-tick edge test decides whether the edge was reached
+float SweptEdgeTOI(float x0, float x1) {
+    bool bRight = x1 + PLAYER_HALF_WIDTH >= ROAD_WIDTH_LIMIT;
+    if (!bRight && !(x1 - PLAYER_HALF_WIDTH <= -ROAD_WIDTH_LIMIT)) return -1.0f;
+    float edge = bRight ? ROAD_WIDTH_LIMIT - PLAYER_HALF_WIDTH : PLAYER_HALF_WIDTH - ROAD_WIDTH_LIMIT;
+    if (x1 == x0) return 0.0f;
+    return max(0.0f, min(1.0f, (edge - x0) / (x1 - x0)));
+}
+
+float SweptObstacleTOI(float d0, float x0, float d1, float x1, int64_t originQ, ObstacleCursor& cursor) {
+    const ObstacleIndex& oi = obstacleIndex;
+    float dLo = min(d0, d1) - 0.5f, dHi = max(d0, d1) + 0.5f;
+    int i = ObstacleSeek(cursor, dLo, originQ);
+    while (i > oi.First() && oi.Dist(i - 1, originQ) >= dLo) i--;
+    float toi = -1.0f;
+    for (; i < oi.Size() && oi.Dist(i, originQ) <= dHi; ++i) {
+        float reach = oi.fWidth[i] / 2.0f + PLAYER_HALF_WIDTH;
+        float od = oi.Dist(i, originQ);
+        float tIn = 0.0f, tOut = 1.0f;
+        if (SlabClip(d0, d1, od - 0.5f, od + 0.5f, tIn, tOut) &&
+            SlabClip(x0, x1, oi.fOffsetX[i] - reach, oi.fOffsetX[i] + reach, tIn, tOut) &&
+            (toi < 0.0f || tIn < toi))
+            toi = tIn;
+    }
+    // On rounding boundaries the end-of-tick overlap test has the last word
+    if (toi < 0.0f && ObstacleHit(d1, x1, originQ, cursor)) toi = 1.0f;
+    return toi;
+}
+
+// Earliest impact of the tick; obstacles are skipped on the finishing tick
+float SweptImpactTOI(float d0, float x0, float d1, float x1, bool bObstacles, int64_t originQ, ObstacleCursor& cursor) {
+    float tEdge = SweptEdgeTOI(x0, x1);
+    float tObs = bObstacles ? SweptObstacleTOI(d0, x0, d1, x1, originQ, cursor) : -1.0f;
+    if (tEdge < 0.0f) return tObs;
+    return tObs < 0.0f ? tEdge : min(tEdge, tObs);
+}
+
+// ---- Fixed-point versions (same rules, time in Q16) ----
+bool SlabClipQ(int64_t a0, int64_t a1, int64_t lo, int64_t hi, int64_t& tIn, int64_t& tOut) {
+    int64_t da = a1 - a0;
+    if (da == 0) return a0 >= lo && a0 <= hi;
+    int64_t t0 = (lo - a0) * Q_ONE / da, t1 = (hi - a0) * Q_ONE / da;
+    if (t0 > t1) swap(t0, t1);
+    tIn = max(tIn, t0);
+    tOut = min(tOut, t1);
+    return tIn <= tOut;
+}
+
+int64_t SweptEdgeTOIQ(int32_t x0, int32_t x1) {
+    static const int32_t halfWidth = ToQ16(PLAYER_HALF_WIDTH), limit = ToQ16(ROAD_WIDTH_LIMIT);
+    bool bRight = x1 + halfWidth >= limit;
+    if (!bRight && !(x1 - halfWidth <= -limit)) return -1;
+    int64_t edge = bRight ? limit - halfWidth : halfWidth - limit;
+    if (x1 == x0) return 0;
+    return max<int64_t>(0, min<int64_t>(Q_ONE, (edge - x0) * Q_ONE / ((int64_t)x1 - x0)));
+}
+
+bool ObstacleHitQ(int64_t dist, int32_t x, ObstacleCursor& cursor) {
+    static const int32_t halfWidth = ToQ16(PLAYER_HALF_WIDTH);
+    const int64_t window = Q_ONE / 2;
+    const ObstacleIndex& oi = obstacleIndex;
+    ObstacleSeekQ(cursor, dist - window);
+    int i = cursor.nNext;
+    while (i > oi.First() && oi.nDistQ[i - 1] >= dist - window) i--;
+    for (; i < oi.Size() && oi.nDistQ[i] <= dist + window; ++i) {
+        int32_t obsLeft = oi.nOffsetXQ[i] - oi.nHalfWidthQ[i];
+        int32_t obsRight = oi.nOffsetXQ[i] + oi.nHalfWidthQ[i];
+        if (max(x - halfWidth, obsLeft) < min(x + halfWidth, obsRight)) return true;
+    }
+    return false;
+}
+
+int64_t SweptObstacleTOIQ(int64_t d0, int32_t x0, int64_t d1, int32_t x1, ObstacleCursor& cursor) {
+    static const int32_t halfWidth = ToQ16(PLAYER_HALF_WIDTH);
+    const int64_t window = Q_ONE / 2;
+    const ObstacleIndex& oi = obstacleIndex;
+    int64_t dLo = min(d0, d1) - window, dHi = max(d0, d1) + window;
+    ObstacleSeekQ(cursor, dLo);
+    int i = cursor.nNext;
+    while (i > oi.First() && oi.nDistQ[i - 1] >= dLo) i--;
+    int64_t toi = -1;
+    for (; i < oi.Size() && oi.nDistQ[i] <= dHi; ++i) {
+        int64_t reach = oi.nHalfWidthQ[i] + halfWidth;
+        int64_t tIn = 0, tOut = Q_ONE;
+        if (SlabClipQ(d0, d1, oi.nDistQ[i] - window, oi.nDistQ[i] + window, tIn, tOut) &&
+            SlabClipQ(x0, x1, oi.nOffsetXQ[i] - reach, oi.nOffsetXQ[i] + reach, tIn, tOut) &&
+            (toi < 0 || tIn < toi))
+            toi = tIn;
+    }
+    if (toi < 0 && ObstacleHitQ(d1, x1, cursor)) toi = Q_ONE;
+    return toi;
+}
+
+int64_t SweptImpactTOIQ(int64_t d0, int32_t x0, int64_t d1, int32_t x1, bool bObstacles, ObstacleCursor& cursor) {
+    int64_t tEdge = SweptEdgeTOIQ(x0, x1);
+    int64_t tObs = bObstacles ? SweptObstacleTOIQ(d0, x0, d1, x1, cursor) : -1;
+    if (tEdge < 0) return tObs;
+    return tObs < 0 ? tEdge : min(tEdge, tObs);
+}
+
+// =================================================================
+// Physics Kernel
+// =================================================================
+// Driver input consumed by one physics tick
+struct KernelInput {
+    int nSteer = 0; // -1, 0, +1
+    bool bAccel = false;
+    bool bBrake = false;
+};
+
+enum KernelEvent { EVT_NONE = 0, EVT_CRASH, EVT_WIN };
+
+// Lookup caches owned by whoever steps a PlayerPCB
+struct KernelCursors {
+    TrackCursor track;
+    ObstacleCursor collision;
+};
+
+// Handling constants of the KPT as run-time values, so tools can step cars
+// under other tunings. KERNEL_DEFAULTS is the table above.
+struct KernelParams {
+    float fMaxSpeed = MAX_SPEED;
+    float fAcceleration = ACCELERATION;
+    float fDeceleration = DECELERATION;
+    float fFriction = FRICTION;
+    float fLateralFactor = LATERAL_FACTOR;
+    float fSteerCompensation = STEER_COMPENSATION;
+    float fHeadingTurnSpeed = HEADING_TURN_SPEED;
+    float fHeadingDriftFactor = HEADING_DRIFT_FACTOR;
+};
+const KernelParams KERNEL_DEFAULTS = KernelParams();
+
+// Per-tick factors of KernelStep, folded with dt in double and rounded once
+struct FixedKernelConstants {
+    int32_t nAccelStep, nDecelStep, nMinSpeed, nMaxSpeed, nHeadingStep;
+    int64_t kFriction, kDt, kCurvEase, kBgCurv, kHeadingDecay;
+    int64_t kSlide, kSteer, kDrift; // Lateral terms, each already multiplied by 40 * dt
+
+    explicit FixedKernelConstants(const KernelParams& kp) {
+        nAccelStep = ToQ16((double)kp.fAcceleration / PHYSICS_HZ);
+        nDecelStep = ToQ16((double)kp.fDeceleration / PHYSICS_HZ);
+        nMinSpeed = ToQ16(-15.0);
+        nMaxSpeed = ToQ16(kp.fMaxSpeed);
+        nHeadingStep = ToQ16((double)kp.fHeadingTurnSpeed / PHYSICS_HZ);
+        kFriction = ToQ32(kp.fFriction);
+        kDt = ToQ32(1.0 / PHYSICS_HZ);
+        kCurvEase = ToQ32(3.0 / PHYSICS_HZ);
+        kBgCurv = ToQ32(0.01 / PHYSICS_HZ);
+        kHeadingDecay = ToQ32(0.95);
+        kSlide = ToQ32((double)kp.fLateralFactor * 40.0 / PHYSICS_HZ);
+        kSteer = ToQ32(0.5 * kp.fSteerCompensation * 40.0 / PHYSICS_HZ);
+        kDrift = ToQ32((double)kp.fHeadingDriftFactor * 40.0 / PHYSICS_HZ);
+    }
+};
+
+KernelEvent KernelStepFixed(PlayerPCB& p, const KernelInput& in, KernelCursors& cur, const FixedKernelConstants& k);
+
+// FixedKernelConstants of KERNEL_DEFAULTS, built once
+const FixedKernelConstants& FixedDefaults() {
+    static const FixedKernelConstants k(KERNEL_DEFAULTS);
+    return k;
+}
+
+// Advances one car by one DELTA_T step: dynamics, finish line, road edges
+// and obstacles. Touches no globals besides the read-only track data, so the
+// threaded game and the headless runner share exactly the same math.
+// kq is FixedKernelConstants(kp), built by the caller once per run.
+KernelEvent KernelStep(PlayerPCB& p, const KernelInput& in, KernelCursors& cur,
+                       const KernelParams& kp, const FixedKernelConstants& kq) {
+    if (g_fixedPhysics) return KernelStepFixed(p, in, cur, kq);
+    const float dt = DELTA_T;
+    KernelEvent ev = EVT_NONE;
+    p.nSteerState = in.nSteer;
+    float d0 = p.fDistance, x0 = p.fX_Register;
+
+    if (!p.bCrashed) {
+        if (in.bAccel) p.fSpeed += kp.fAcceleration * dt;
+        else p.fSpeed *= kp.fFriction;
+        if (in.bBrake) p.fSpeed -= kp.fDeceleration * dt;
+    } else {
+        p.fSpeed = 0.0f;
+    }
+
+    p.fSpeed = max(-15.0f, min(kp.fMaxSpeed, p.fSpeed));
+    p.fDistance += p.fSpeed * dt;
+
+    float trackEnd = LocalQ(TrackLengthQ(), p.nOriginQ);
+    if (p.fDistance >= trackEnd) {
+        p.fDistance = trackEnd;
+        ev = EVT_WIN;
+    }
+
+    float targetCurv = 0.0f;
+    int section = TrackSeek(cur.track, p.fDistance, p.nOriginQ);
+    if (section < TrackSegmentCount())
+        targetCurv = vecSegCurvature[section];
+
+    p.fCurvature += (targetCurv - p.fCurvature) * dt * 3.0f;
+    p.fPlayerCurvature += p.fCurvature * dt * p.fSpeed * 0.01f;
+
+    float steerInput = (float)p.nSteerState * 0.5f;
+    float fInertiaSlide = -p.fCurvature * p.fSpeed * kp.fLateralFactor;
+    float compensation = steerInput * kp.fSteerCompensation;
+    float headingDrift = p.fHeadingAngle * p.fSpeed * kp.fHeadingDriftFactor;
+    float fNetForce = (fInertiaSlide + compensation + headingDrift) * 40.0f;
+    p.fX_Register += fNetForce * dt;
+
+    if (p.nSteerState == -1) p.fHeadingAngle -= kp.fHeadingTurnSpeed * dt;
+    else if (p.nSteerState == 1) p.fHeadingAngle += kp.fHeadingTurnSpeed * dt;
+    else p.fHeadingAngle *= 0.95f;
+
+    // A crash on the finishing tick still ends the race as a crash; the car
+    // stops where its path met the edge or obstacle
+    if (!p.bCrashed) {
+        float t = SweptImpactTOI(d0, x0, p.fDistance, p.fX_Register, ev == EVT_NONE, p.nOriginQ, cur.collision);
+        if (t >= 0.0f) {
+            p.fDistance = d0 + (p.fDistance - d0) * t;
+            p.fX_Register = x0 + (p.fX_Register - x0) * t;
+            p.fSpeed = 0.0f;
+            p.bCrashed = true;
+            p.fImpactTime = t;
+            ev = EVT_CRASH;
+        }
+    }
+    RebaseDistance(p.fDistance, p.nOriginQ);
+    return ev;
+}
+
+// KernelStep under the KPT defaults
+inline KernelEvent KernelStep(PlayerPCB& p, const KernelInput& in, KernelCursors& cur) {
+    return KernelStep(p, in, cur, KERNEL_DEFAULTS, FixedDefaults());
+}
+
+// Rewrites the float fields of a fixed-point car from its Q16 state
+void MirrorFixed(PlayerPCB& p) {
+    const FixedState& q = p.q;
+    RebaseOriginQ(q.nDistance, p.nOriginQ);
+    p.fX_Register = FromQ16(q.nX);
+    p.fSpeed = FromQ16(q.nSpeed);
+    p.fDistance = FromQ16(q.nDistance - p.nOriginQ);
+    p.fCurvature = FromQ16(q.nCurvature);
+    p.fPlayerCurvature = FromQ16(q.nPlayerCurvature);
+    p.fHeadingAngle = FromQ16(q.nHeading);
+}
+
+// KernelStep on the Q16 state. Mirrors the result into the float fields,
+// which are outputs only in this mode.
+KernelEvent KernelStepFixed(PlayerPCB& p, const KernelInput& in, KernelCursors& cur, const FixedKernelConstants& k) {
+    FixedState& q = p.q;
+    KernelEvent ev = EVT_NONE;
+    p.nSteerState = in.nSteer;
+    int64_t d0 = q.nDistance;
+    int32_t x0 = q.nX;
+
+    if (!p.bCrashed) {
+        if (in.bAccel) q.nSpeed += k.nAccelStep;
+        else q.nSpeed = QScale(q.nSpeed, k.kFriction);
+        if (in.bBrake) q.nSpeed -= k.nDecelStep;
+    } else {
+        q.nSpeed = 0;
+    }
+
+    q.nSpeed = max(k.nMinSpeed, min(k.nMaxSpeed, q.nSpeed));
+    q.nDistance += QScale(q.nSpeed, k.kDt);
+
+    int64_t total = TrackLengthQ();
+    if (q.nDistance >= total) {
+        q.nDistance = total;
+        ev = EVT_WIN;
+    }
+
+    int32_t targetCurv = 0;
+    int section = TrackSeekQ(cur.track, q.nDistance);
+    if (section < TrackSegmentCount()) targetCurv = vecSegCurvatureQ[section];
+
+    q.nCurvature += QScale(targetCurv - q.nCurvature, k.kCurvEase);
+    q.nPlayerCurvature += QScale(QMul(q.nCurvature, q.nSpeed), k.kBgCurv);
+
+    // Sum the lateral terms at Q48 and round once
+    int64_t dx = -(int64_t)QMul(q.nCurvature, q.nSpeed) * k.kSlide
+               + (int64_t)p.nSteerState * Q_ONE * k.kSteer
+               + (int64_t)QMul(q.nHeading, q.nSpeed) * k.kDrift;
+    q.nX += (int32_t)((dx + (1LL << 31)) >> 32);
+
+    if (p.nSteerState == -1) q.nHeading -= k.nHeadingStep;
+    else if (p.nSteerState == 1) q.nHeading += k.nHeadingStep;
+    else q.nHeading = QScale(q.nHeading, k.kHeadingDecay);
+
+    if (!p.bCrashed) {
+        int64_t t = SweptImpactTOIQ(d0, x0, q.nDistance, q.nX, ev == EVT_NONE, cur.collision);
+        if (t >= 0) {
+            q.nDistance = d0 + (q.nDistance - d0) * t / Q_ONE;
+            q.nX = x0 + (int32_t)((int64_t)(q.nX - x0) * t / Q_ONE);
+            q.nSpeed = 0;
+            p.bCrashed = true;
+            p.fImpactTime = FromQ16(t);
+            ev = EVT_CRASH;
+        }
+    }
+
+    MirrorFixed(p);
+    return ev;
+}
+
+// =================================================================
+// Input Thread
+// =================================================================
+void InputThreadProc() {
+    bool lastSpace = false, lastUp = false, lastDown = false;
+    bool last1 = false, last2 = false, last3 = false;
+    while (running.load()) {
+#ifndef _WIN32
+        PollTerminalKeys();
+#endif
+        int steer = 0;
+        if ((GetAsyncKeyState('A') & 0x8000) || (GetAsyncKeyState(VK_LEFT) & 0x8000)) steer = -1;
+        if ((GetAsyncKeyState('D') & 0x8000) || (GetAsyncKeyState(VK_RIGHT) & 0x8000)) steer = 1;
+        if (!g_autopilot.load()) {
+            input_steer.store(steer);
+            input_accel.store((GetAsyncKeyState('W') & 0x8000) || (GetAsyncKeyState(VK_UP) & 0x8000));
+            input_brake.store((GetAsyncKeyState('S') & 0x8000) || (GetAsyncKeyState(VK_DOWN) & 0x8000));
+        }
+        if (GetAsyncKeyState('P') & 1) g_autopilot.store(!g_autopilot.load());
+
+        bool nowSpace = (GetAsyncKeyState(VK_SPACE) & 0x8000);
+        if (nowSpace && !lastSpace) input_space_edge.store(true);
+        lastSpace = nowSpace;
+
+        bool nowUp = (GetAsyncKeyState(VK_UP) & 0x8000);
+        if (nowUp && !lastUp) input_up_edge.store(true);
+        lastUp = nowUp;
+
+        bool nowDown = (GetAsyncKeyState(VK_DOWN) & 0x8000);
+        if (nowDown && !lastDown) input_down_edge.store(true);
+        lastDown = nowDown;
+
+        bool now1 = (GetAsyncKeyState('1') & 0x8000);
+        if (now1 && !last1) input_1_edge.store(true); last1 = now1;
+        bool now2 = (GetAsyncKeyState('2') & 0x8000);
+        if (now2 && !last2) input_2_edge.store(true); last2 = now2;
+        bool now3 = (GetAsyncKeyState('3') & 0x8000);
+        if (now3 && !last3) input_3_edge.store(true); last3 = now3;
+
+        if (GetAsyncKeyState(VK_ESCAPE) & 1) input_escape.store(true);
+
+        Sleep(1);
+    }
+}
+
+// =================================================================
+// Input Sources
+// =================================================================
+// Supplies the driver input for a tick, given the state before that tick
+typedef std::function<KernelInput(uint64_t tick, const PlayerPCB& p)> InputSource;
+
+// Input script: each line "<tick> <steer> <accel> <brake>" holds from that
+// tick until the next line. Lines starting with '#' are comments.
+typedef vector<pair<uint64_t, KernelInput>> InputScript;
+
+bool LoadInputScript(const char* path, InputScript& script) {
+    FILE* f = fopen(path, "r");
+    if (!f) return false;
+    script.clear();
+    char line[256];
+    while (fgets(line, sizeof(line), f)) {
+        if (line[0] == '#') continue;
+        unsigned long long tick = 0;
+        int steer = 0, accel = 0, brake = 0;
+        if (sscanf(line, "%llu %d %d %d", &tick, &steer, &accel, &brake) != 4) continue;
+        KernelInput in;
+        in.nSteer = max(-1, min(1, steer));
+        in.bAccel = accel != 0;
+        in.bBrake = brake != 0;
+        script.emplace_back((uint64_t)tick, in);
+    }
+    fclose(f);
+    stable_sort(script.begin(), script.end(),
+                [](const pair<uint64_t, KernelInput>& a, const pair<uint64_t, KernelInput>& b) { return a.first < b.first; });
+    return true;
+}
+
+InputSource ScriptInputSource(const InputScript& script) {
+    return [script](uint64_t tick, const PlayerPCB&) {
+        auto it = upper_bound(script.begin(), script.end(), tick,
+                              [](uint64_t t, const pair<uint64_t, KernelInput>& e) { return t < e.first; });
+        return it == script.begin() ? KernelInput() : (it - 1)->second;
+    };
+}
+
+// =================================================================
+// Autopilot
+// =================================================================
+// Reference driver. Lateral motion per tick is roughly
+//   (-curvature * LATERAL_FACTOR + heading * HEADING_DRIFT_FACTOR) * speed * 40,
+// so holding heading = curvature * LATERAL_FACTOR / HEADING_DRIFT_FACTOR
+// cancels the slide at any speed. The driver picks a lateral target clear of
+// the obstacles ahead, adds the heading that closes the gap to it, and
+// steers bang-bang toward that heading using the curvature it will meet
+// AUTOPILOT_CURV_LOOKAHEAD seconds ahead.
+const float AUTOPILOT_CURV_LOOKAHEAD = 0.3f; // s
+const float AUTOPILOT_OBSTACLE_TIME = 2.0f;  // s of road scanned for obstacles
+const float AUTOPILOT_MARGIN = 0.08f;        // Lateral clearance kept from obstacles
+const float AUTOPILOT_LANE_LIMIT = ROAD_WIDTH_LIMIT - PLAYER_HALF_WIDTH - 0.12f;
+const float AUTOPILOT_MAX_HEADING = 0.35f;
+
+struct Autopilot {
+    TrackCursor track;
+    ObstacleCursor obstacles;
+    float fTargetX = 0.0f;
+    const KernelParams* pParams = &KERNEL_DEFAULTS; // Handling model the driver plans with
+
+    void Reset() {
+        const KernelParams* kp = pParams;
+        *this = Autopilot();
+        pParams = kp;
+    }
+
+    // True when a car centered at x passes every obstacle in [first, end)
+    static bool LaneClear(float x, int first, int end) {
+        const ObstacleIndex& oi = obstacleIndex;
+        for (int i = first; i < end; ++i)
+            if (fabsf(x - oi.fOffsetX[i]) < oi.fWidth[i] * 0.5f + PLAYER_HALF_WIDTH + AUTOPILOT_MARGIN) return false;
+        return true;
+    }
+
+    KernelInput Drive(const PlayerPCB& p) {
+        const ObstacleIndex& oi = obstacleIndex;
+        float d = p.fDistance, x = p.fX_Register;
+        int64_t o = p.nOriginQ;
+        float v = max(1.0f, p.fSpeed);
+
+        // Obstacles from just beside the car to the end of the scan window
+        int first = ObstacleSeek(obstacles, d - 1.0f, o);
+        int end = first;
+        float reach = d + v * AUTOPILOT_OBSTACLE_TIME + 10.0f;
+        while (end < oi.Size() && oi.Dist(end, o) <= reach) end++;
+
+        // Keep the current target while it stays clear; otherwise take the
+        // clear lane that needs the least travel, leaning toward the center
+        if (!LaneClear(fTargetX, first, end) || (first == end && fTargetX != 0.0f)) {
+            float best = 0.0f, bestCost = 1e9f;
+            bool found = false;
+            for (int k = -14; k <= 14; ++k) {
+                float c = AUTOPILOT_LANE_LIMIT * (float)k / 14.0f;
+                if (!LaneClear(c, first, end)) continue;
+                float cost = fabsf(c - x) + 0.3f * fabsf(c);
+                if (cost < bestCost) { bestCost = cost; best = c; found = true; }
+            }
+            // Nothing clears the whole window: dodge the nearest obstacle only
+            if (!found && first < end) {
+                for (int k = -14; k <= 14; ++k) {
+                    float c = AUTOPILOT_LANE_LIMIT * (float)k / 14.0f;
+                    if (!LaneClear(c, first, first + 1)) continue;
+                    float cost = fabsf(c - x);
+                    if (cost < bestCost) { bestCost = cost; best = c; }
+                }
+            }
+            fTargetX = best;
+        }
+
+        // Curvature the car will be under shortly: its eased value blended toward the segment ahead
+        float ahead = 0.0f;
+        int section = TrackSeek(track, d + v * AUTOPILOT_CURV_LOOKAHEAD, o);
+        if (section < TrackSegmentCount()) ahead = vecSegCurvature[section];
+        float curv = p.fCurvature + (ahead - p.fCurvature) * (1.0f - expf(-3.0f * AUTOPILOT_CURV_LOOKAHEAD));
+
+        float err = x - fTargetX;
+        float vxWanted = max(-1.5f, min(1.5f, -err * 2.5f));
+        const KernelParams& kp = *pParams;
+        float hDes = curv * kp.fLateralFactor / kp.fHeadingDriftFactor + vxWanted / (v * kp.fHeadingDriftFactor * 40.0f);
+        hDes = max(-AUTOPILOT_MAX_HEADING, min(AUTOPILOT_MAX_HEADING, hDes));
+
+        KernelInput in;
+        float step = kp.fHeadingTurnSpeed * DELTA_T;
+        in.nSteer = p.fHeadingAngle < hDes - step ? 1 : (p.fHeadingAngle > hDes + step ? -1 : 0);
+        // Buy time when an obstacle is close and the car is not yet clear of it
+        bool bLate = first < end && oi.Dist(first, o) > d && oi.Dist(first, o) - d < v * 0.6f && !LaneClear(x, first, first + 1);
+        in.bAccel = !bLate;
+        in.bBrake = bLate;
+        return in;
+    }
+};
+
+InputSource AutopilotSource(const KernelParams& kp = KERNEL_DEFAULTS) {
+    auto ap = std::make_shared<Autopilot>();
+    ap->pParams = &kp;
+    return [ap](uint64_t tick, const PlayerPCB& p) {
+        if (tick == 0) ap->Reset();
+        return ap->Drive(p);
+    };
+}
+
+// =================================================================
+// Input Recording & Replay
+// =================================================================
+// Replay file (little endian):
+//   char[4] "OSRP", u16 version, u16 map id, u32 build constants hash,
+//   u32 flags (version 2+), u64 track hash (version 3+: the source hash of
+//   the --track file, 0 for a built-in map), u32 endless seed (version 4+),
+//   u64 tick count, u64 trajectory hash, u32 payload bytes, payload.
+// The payload run-length encodes the input consumed on every physics tick.
+// Each run is one byte: high nibble = symbol ((steer + 1) * 4 + accel * 2 + brake),
+// low nibble = run length - 1; a low nibble of 15 is followed by a varint
+// holding run length - 16. Held keys cost one or two bytes per change, far
+// below one byte per tick.
+const char REPLAY_MAGIC[4] = { 'O', 'S', 'R', 'P' };
+const uint16_t REPLAY_VERSION = 4;
+const uint32_t REPLAY_FLAG_FIXED = 1; // Recorded with the fixed-point kernel
+const uint32_t REPLAY_FLAG_ENDLESS = 2; // Recorded on the endless track of the stored seed
+const int REPLAY_OPPONENTS_SHIFT = 16; // Flags bits 16-31: AI opponent count
+const char* REPLAY_LAST_FILE = "last_run.osr"; // Every finished race is saved here
+
+const uint64_t FNV_OFFSET = 14695981039346656037ULL;
+const uint64_t FNV_PRIME = 1099511628211ULL;
+
+uint64_t HashBytes(uint64_t h, const void* data, size_t n) {
+    const uint8_t* p = (const uint8_t*)data;
+    for (size_t i = 0; i < n; ++i) { h ^= p[i]; h *= FNV_PRIME; }
+    return h;
+}
+
+// Bumped whenever KernelStep's rules change without a constant changing
+// (2: swept collision, 3: rebased distances and Q16 track positions)
+const int KERNEL_REVISION = 3;
+
+// Hash of every constant that feeds KernelStep; a replay only reproduces
+// its trajectory on a build with the same value.
+uint32_t BuildConstantsHash() {
+    const float k[] = { (float)KERNEL_REVISION, PHYSICS_HZ, DELTA_T, ROAD_WIDTH_LIMIT, PLAYER_HALF_WIDTH, MAX_SPEED, ACCELERATION,
+                        DECELERATION, FRICTION, LATERAL_FACTOR, STEER_COMPENSATION, HEADING_TURN_SPEED,
+                        HEADING_DRIFT_FACTOR };
+    uint64_t h = HashBytes(FNV_OFFSET, k, sizeof(k));
+    return (uint32_t)(h ^ (h >> 32));
+}
+
+// Folds the car state after a tick into a running trajectory hash
+uint64_t HashPCB(uint64_t h, const PlayerPCB& p) {
+    const float f[] = { p.fX_Register, p.fSpeed, p.fDistance, p.fCurvature, p.fPlayerCurvature, p.fHeadingAngle };
+    h = HashBytes(h, f, sizeof(f));
+    int flags[] = { p.nSteerState, p.bCrashed ? 1 : 0 };
+    h = HashBytes(h, flags, sizeof(flags));
+    if (p.nOriginQ != 0) h = HashBytes(h, &p.nOriginQ, sizeof(p.nOriginQ)); // Short tracks hash as before
+    if (g_fixedPhysics) {
+        const int64_t qv[] = { p.q.nDistance, p.q.nX, p.q.nSpeed, p.q.nCurvature, p.q.nPlayerCurvature, p.q.nHeading };
+        h = HashBytes(h, qv, sizeof(qv));
+    }
+    return h;
+}
+
+int EncodeInputSymbol(const KernelInput& in) {
+    return (in.nSteer + 1) * 4 + (in.bAccel ? 2 : 0) + (in.bBrake ? 1 : 0);
+}
+
+KernelInput DecodeInputSymbol(int sym) {
+    KernelInput in;
+    in.nSteer = sym / 4 - 1;
+    in.bAccel = (sym & 2) != 0;
+    in.bBrake = (sym & 1) != 0;
+    return in;
+}
+
+struct ReplayHeader {
+    int nVersion = REPLAY_VERSION;
+    int nMapId = 0;
+    uint32_t nConstantsHash = 0;
+    uint32_t nFlags = 0;
+    uint64_t nTrackHash = 0; // g_trackHash of the recording
+    uint32_t nEndlessSeed = 0; // g_endlessSeed, with REPLAY_FLAG_ENDLESS
+    uint64_t nTicks = 0;
+    uint64_t nTrajectoryHash = FNV_OFFSET;
+    uint32_t nPayloadBytes = 0;
+};
+
+struct InputRecorder {
+    bool bActive = false;
+    ReplayHeader hdr;
+    vector<uint8_t> payload;
+    int nRunSymbol = -1;
+    uint64_t nRunLength = 0;
+
+    void Begin(int mapId) {
+        bActive = true;
+        hdr = ReplayHeader();
+        hdr.nMapId = mapId;
+        hdr.nConstantsHash = BuildConstantsHash();
+        hdr.nFlags = (g_fixedPhysics ? REPLAY_FLAG_FIXED : 0) | (g_endlessTrack ? REPLAY_FLAG_ENDLESS : 0) |
+                     ((uint32_t)g_opponentCount << REPLAY_OPPONENTS_SHIFT);
+        hdr.nTrackHash = g_trackHash;
+        hdr.nEndlessSeed = g_endlessTrack ? g_endlessSeed : 0;
+        payload.clear();
+        nRunSymbol = -1;
+        nRunLength = 0;
+    }
+
+    // Called once per tick with the input consumed and the resulting state
+    void Append(const KernelInput& in, const PlayerPCB& after) {
+        int sym = EncodeInputSymbol(in);
+        if (sym != nRunSymbol) {
+            FlushRun();
+            nRunSymbol = sym;
+        }
+        nRunLength++;
+        hdr.nTicks++;
+        hdr.nTrajectoryHash = HashPCB(hdr.nTrajectoryHash, after);
+    }
+
+    void FlushRun() {
+        if (nRunLength == 0) return;
+        if (nRunLength <= 15) {
+            payload.push_back((uint8_t)((nRunSymbol << 4) | (nRunLength - 1)));
+        } else {
+            payload.push_back((uint8_t)((nRunSymbol << 4) | 15));
+            uint64_t v = nRunLength - 16;
+            while (v >= 0x80) { payload.push_back((uint8_t)(v | 0x80)); v >>= 7; }
+            payload.push_back((uint8_t)v);
+        }
+        nRunLength = 0;
+    }
+
+    bool End(const char* path) {
+        bActive = false;
+        FlushRun();
+        hdr.nPayloadBytes = (uint32_t)payload.size();
+        FILE* f = fopen(path, "wb");
+        if (!f) return false;
+        uint16_t version = REPLAY_VERSION, mapId = (uint16_t)hdr.nMapId;
+        fwrite(REPLAY_MAGIC, 1, 4, f);
+        fwrite(&version, sizeof(version), 1, f);
+        fwrite(&mapId, sizeof(mapId), 1, f);
+        fwrite(&hdr.nConstantsHash, sizeof(hdr.nConstantsHash), 1, f);
+        fwrite(&hdr.nFlags, sizeof(hdr.nFlags), 1, f);
+        fwrite(&hdr.nTrackHash, sizeof(hdr.nTrackHash), 1, f);
+        fwrite(&hdr.nEndlessSeed, sizeof(hdr.nEndlessSeed), 1, f);
+        fwrite(&hdr.nTicks, sizeof(hdr.nTicks), 1, f);
+        fwrite(&hdr.nTrajectoryHash, sizeof(hdr.nTrajectoryHash), 1, f);
+        fwrite(&hdr.nPayloadBytes, sizeof(hdr.nPayloadBytes), 1, f);
+        if (!payload.empty()) fwrite(payload.data(), 1, payload.size(), f);
+        fclose(f);
+        return true;
+    }
+};
+
+// Reads a replay and expands its runs into an input script (one entry per run).
+bool LoadReplay(const char* path, ReplayHeader& hdr, InputScript& script) {
+    FILE* f = fopen(path, "rb");
+    if (!f) return false;
+    char magic[4];
+    uint16_t version = 0, mapId = 0;
+    bool ok = fread(magic, 1, 4, f) == 4 && memcmp(magic, REPLAY_MAGIC, 4) == 0 &&
+              fread(&version, sizeof(version), 1, f) == 1 && version >= 1 && version <= REPLAY_VERSION &&
+              fread(&mapId, sizeof(mapId), 1, f) == 1 &&
+              fread(&hdr.nConstantsHash, sizeof(hdr.nConstantsHash), 1, f) == 1 &&
+              (version < 2 || fread(&hdr.nFlags, sizeof(hdr.nFlags), 1, f) == 1) &&
+              (version < 3 || fread(&hdr.nTrackHash, sizeof(hdr.nTrackHash), 1, f) == 1) &&
+              (version < 4 || fread(&hdr.nEndlessSeed, sizeof(hdr.nEndlessSeed), 1, f) == 1) &&
+              fread(&hdr.nTicks, sizeof(hdr.nTicks), 1, f) == 1 &&
+              fread(&hdr.nTrajectoryHash, sizeof(hdr.nTrajectoryHash), 1, f) == 1 &&
+              fread(&hdr.nPayloadBytes, sizeof(hdr.nPayloadBytes), 1, f) == 1;
+    vector<uint8_t> payload;
+    if (ok) {
+        payload.resize(hdr.nPayloadBytes);
+        ok = payload.empty() || fread(payload.data(), 1, payload.size(), f) == payload.size();
+    }
+    fclose(f);
+    if (!ok) return false;
+    hdr.nVersion = version;
+    hdr.nMapId = mapId;
+
+    script.clear();
+    uint64_t tick = 0;
+    for (size_t i = 0; i < payload.size();) {
+        int sym = payload[i] >> 4;
+        uint64_t run = (payload[i] & 15) + 1;
+        i++;
+        if (run == 16) {
+            uint64_t v = 0;
+            int shift = 0;
+            while (i < payload.size()) {
+                uint8_t byte = payload[i++];
+                v |= (uint64_t)(byte & 0x7F) << shift;
+                shift += 7;
+                if (!(byte & 0x80)) break;
+            }
+            run = v + 16;
+        }
+        if (sym > 11) return false;
+        script.emplace_back(tick, DecodeInputSymbol(sym));
+        tick += run;
+    }
+    return tick == hdr.nTicks;
+}
+
+// Replay being watched in real time (a.exe --replay <file> --watch)
+InputScript g_replayScript;
+int g_replayMapId = 1;
+std::atomic<bool> g_replayWatching(false);
+
+// =================================================================
+// Memory-Mapped Files
+// =================================================================
+// Read-only view of a whole file; callers read structs straight out of it.
+struct MappedFile {
+    const uint8_t* pData = nullptr;
+    size_t nSize = 0;
+#ifdef _WIN32
+    HANDLE hFile = INVALID_HANDLE_VALUE;
+    HANDLE hMapping = NULL;
+#endif
+};
+
+bool MapFileReadOnly(const char* path, MappedFile& m) {
+#ifdef _WIN32
+    wchar_t wpath[MAX_PATH];
+    swprintf_s(wpath, L"%hs", path);
+    m.hFile = CreateFileW(wpath, GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+    if (m.hFile == INVALID_HANDLE_VALUE) return false;
+    LARGE_INTEGER size;
+    if (!GetFileSizeEx(m.hFile, &size) || size.QuadPart == 0) {
+        CloseHandle(m.hFile); m.hFile = INVALID_HANDLE_VALUE;
+        return false;
+    }
+    m.hMapping = CreateFileMappingW(m.hFile, NULL, PAGE_READONLY, 0, 0, NULL);
+    if (m.hMapping) m.pData = (const uint8_t*)MapViewOfFile(m.hMapping, FILE_MAP_READ, 0, 0, 0);
+    if (!m.pData) {
+        if (m.hMapping) CloseHandle(m.hMapping);
+        CloseHandle(m.hFile);
+        m = MappedFile();
+        return false;
+    }
+    m.nSize = (size_t)size.QuadPart;
+    return true;
+#else
+    int fd = open(path, O_RDONLY);
+    if (fd < 0) return false;
+    struct stat st;
+    if (fstat(fd, &st) != 0 || st.st_size == 0) { close(fd); return false; }
+    void* p = mmap(NULL, (size_t)st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (p == MAP_FAILED) return false;
+    m.pData = (const uint8_t*)p;
+    m.nSize = (size_t)st.st_size;
+    return true;
+#endif
+}
+
+void UnmapFile(MappedFile& m) {
+    if (!m.pData) return;
+#ifdef _WIN32
+    UnmapViewOfFile(m.pData);
+    CloseHandle(m.hMapping);
+    CloseHandle(m.hFile);
+#else
+    munmap((void*)m.pData, m.nSize);
+#endif
+    m = MappedFile();
+}
+
+// =================================================================
+// Track Files
+// =================================================================
+// Tracks can ship as text and need no rebuild of the game:
+//   # comment
+//   segment <curvature> <length>
+//   obstacle <distance into segment> <offset x> <width>   (joins the last segment)
+// On first load the source is compiled to track_<content hash>.otb in the
+// working directory. Later loads only hash the source and map the compiled
+// file read-only; every run-time table is a view into the mapping, so a
+// 100k-obstacle track loads without parsing or copying. Layout (native
+// endian): TrackFileHeader, then the tables of VisitTrackTables in order,
+// each padded to a multiple of 8 bytes. An .otb can also be loaded directly.
+const char TRACK_FILE_MAGIC[4] = { 'O', 'S', 'T', 'B' };
+const uint16_t TRACK_FILE_VERSION = 3; // 2: Q16 positions only, 3: simplified minimap outline
+const uint32_t TRACK_FILE_LAYOUT = Q_SHIFT | (OBSTACLE_BUCKET_SHIFT << 8); // Fixed-point and grid parameters baked in
+
+struct TrackFileHeader {
+    char magic[4];
+    uint16_t nVersion;
+    uint16_t nHeaderBytes;
+    uint64_t nSourceHash; // FNV-1a of the source text
+    uint32_t nLayout;
+    uint32_t nSegments, nObstacles, nMapPoints;
+    uint32_t nBucketsQ; // Broadphase bucket count (the table holds one more entry)
+    float fTotalLength;
+};
+
+MappedFile g_trackFile; // Backs the track tables while a compiled track is loaded
+
+void ReleaseTrackFile() { UnmapFile(g_trackFile); }
+
+inline size_t Align8(size_t n) { return (n + 7) & ~(size_t)7; }
+
+// Calls v(table, element count) for every run-time track table, in file order
+template <typename V>
+void VisitTrackTables(V& v, const TrackFileHeader& h) {
+    ObstacleIndex& oi = obstacleIndex;
+    v(vecSegStartQ, h.nSegments + 1);
+    v(vecSegCurvature, h.nSegments);
+    v(vecSegCurvatureQ, h.nSegments);
+    v(oi.nDistQ, h.nObstacles);
+    v(oi.fOffsetX, h.nObstacles);
+    v(oi.fWidth, h.nObstacles);
+    v(oi.nSegBegin, h.nSegments + 1);
+    v(oi.nOffsetXQ, h.nObstacles);
+    v(oi.nHalfWidthQ, h.nObstacles);
+    v(oi.nBucketBeginQ, h.nBucketsQ + 1);
+    v(vecMapPointsCurrent, h.nMapPoints);
+}
+
+struct TrackTableSizer {
+    size_t nBytes = 0;
+    template <typename T> void operator()(const TrackArray<T>&, size_t count) { nBytes += Align8(count * sizeof(T)); }
+};
+
+struct TrackTableWriter {
+    FILE* f;
+    bool ok = true;
+    template <typename T> void operator()(const TrackArray<T>& a, size_t count) {
+        static const uint8_t zeros[8] = {};
+        size_t pad = Align8(count * sizeof(T)) - count * sizeof(T);
+        ok = ok && a.size() == count && fwrite(a.data(), sizeof(T), count, f) == count && fwrite(zeros, 1, pad, f) == pad;
+    }
+};
+
+// Locates one table of a mapped file without installing it
+template <typename T>
+struct TrackTableFind {
+    const uint8_t* pData;
+    const TrackArray<T>* pTable;
+    const T* pFound;
+    size_t nCount;
+    template <typename U> void operator()(const TrackArray<U>& a, size_t count) {
+        if ((const void*)&a == (const void*)pTable) { pFound = (const T*)pData; nCount = count; }
+        pData += Align8(count * sizeof(U));
+    }
+};
+
+template <typename T>
+const T* FindTrackTable(const uint8_t* tables, const TrackFileHeader& h, const TrackArray<T>& a) {
+    TrackTableFind<T> find = { tables, &a, nullptr, 0 };
+    VisitTrackTables(find, h);
+    return find.pFound;
+}
+
+// Checks the invariants the seek code relies on in a mapped file's tables:
+// sorted positions, and offset tables that never decrease and end at the
+// obstacle count. A bucket table entry must be exactly the first obstacle
+// at or past its bucket, as BuildBuckets writes it.
+bool ValidTrackTables(const uint8_t* tables, const TrackFileHeader& h) {
+    const ObstacleIndex& oi = obstacleIndex;
+    const int64_t* segStart = FindTrackTable(tables, h, vecSegStartQ);
+    const int64_t* dist = FindTrackTable(tables, h, oi.nDistQ);
+    const int* segBegin = FindTrackTable(tables, h, oi.nSegBegin);
+    const int* buckets = FindTrackTable(tables, h, oi.nBucketBeginQ);
+    int n = (int)h.nObstacles;
+    if (!is_sorted(segStart, segStart + h.nSegments + 1) || !is_sorted(dist, dist + n)) return false;
+    if (segBegin[0] != 0 || segBegin[h.nSegments] != n) return false;
+    for (uint32_t s = 0; s < h.nSegments; ++s)
+        if (segBegin[s] > segBegin[s + 1]) return false;
+    if (buckets[h.nBucketsQ] != n) return false;
+    const int shift = Q_SHIFT + OBSTACLE_BUCKET_SHIFT;
+    for (uint32_t k = 0; k <= h.nBucketsQ; ++k) {
+        int b = buckets[k];
+        if (b < 0 || b > n || (b < n && (dist[b] >> shift) < (int64_t)k) || (b > 0 && (dist[b - 1] >> shift) >= (int64_t)k))
+            return false;
+    }
+    return true;
+}
+
+struct TrackTableMapper {
+    const uint8_t* pData;
+    template <typename T> void operator()(TrackArray<T>& a, size_t count) {
+        a.View((const T*)pData, count);
+        pData += Align8(count * sizeof(T));
+    }
+};
+
+// Maps a compiled track and points the track tables into it. With a
+// nonzero `sourceHash` the file must have been compiled from that source.
+// A file whose tables fail ValidTrackTables is refused before anything
+// points into it, so a source track is compiled again.
+bool MapCompiledTrack(const char* path, uint64_t sourceHash) {
+    MappedFile m;
+    if (!MapFileReadOnly(path, m)) return false;
+    TrackFileHeader h;
+    bool ok = m.nSize >= sizeof(h);
+    if (ok) memcpy(&h, m.pData, sizeof(h));
+    ok = ok && memcmp(h.magic, TRACK_FILE_MAGIC, 4) == 0 && h.nVersion == TRACK_FILE_VERSION &&
+         h.nHeaderBytes == sizeof(h) && h.nLayout == TRACK_FILE_LAYOUT && (sourceHash == 0 || h.nSourceHash == sourceHash);
+    // Counts index int tables and gain one entry below
+    const uint32_t maxCount = (uint32_t)INT32_MAX - 1;
+    ok = ok && h.nSegments > 0 && h.nSegments <= maxCount && h.nObstacles <= maxCount && h.nMapPoints <= maxCount &&
+         h.nBucketsQ > 0 && h.nBucketsQ <= maxCount;
+    if (ok) {
+        TrackTableSizer size;
+        VisitTrackTables(size, h);
+        ok = m.nSize >= sizeof(h) + size.nBytes;
+    }
+    const uint8_t* tables = m.pData + sizeof(h);
+    ok = ok && ValidTrackTables(tables, h);
+    if (!ok) { UnmapFile(m); return false; }
+
+    TrackTableMapper mapper = { tables };
+    VisitTrackTables(mapper, h);
+    fTotalTrackLength = h.fTotalLength;
+    vecTrack.clear();
+    obstacleIndex.nVersion++;
+    g_mapPointsVersion++;
+    g_trackHash = h.nSourceHash;
+    UnmapFile(g_trackFile);
+    g_trackFile = m;
+    return true;
+}
+
+// Writes the installed track tables as a compiled track
+bool WriteCompiledTrack(const char* path, uint64_t sourceHash) {
+    TrackFileHeader h = {};
+    memcpy(h.magic, TRACK_FILE_MAGIC, 4);
+    h.nVersion = TRACK_FILE_VERSION;
+    h.nHeaderBytes = sizeof(h);
+    h.nSourceHash = sourceHash;
+    h.nLayout = TRACK_FILE_LAYOUT;
+    h.nSegments = (uint32_t)vecSegCurvature.size();
+    h.nObstacles = (uint32_t)obstacleIndex.Size();
+    h.nMapPoints = (uint32_t)vecMapPointsCurrent.size();
+    h.nBucketsQ = (uint32_t)obstacleIndex.nBucketBeginQ.size() - 1;
+    h.fTotalLength = fTotalTrackLength;
+    // Written aside and renamed, so a reader never maps a half-written file
+    string tmp = string(path) + ".tmp";
+    FILE* f = fopen(tmp.c_str(), "wb");
+    if (!f) return false;
+    TrackTableWriter w;
+    w.f = f;
+    w.ok = fwrite(&h, sizeof(h), 1, f) == 1;
+    VisitTrackTables(w, h);
+    w.ok = fclose(f) == 0 && w.ok;
+    remove(path);
+    if (!w.ok || rename(tmp.c_str(), path) != 0) { remove(tmp.c_str()); return false; }
+    return true;
+}
+
+bool ReadWholeFile(const char* path, string& out) {
+    FILE* f = fopen(path, "rb");
+    if (!f) return false;
+    fseek(f, 0, SEEK_END);
+    long n = ftell(f);
+    fseek(f, 0, SEEK_SET);
+    out.resize(n > 0 ? (size_t)n : 0);
+    bool ok = n >= 0 && fread(&out[0], 1, out.size(), f) == out.size();
+    fclose(f);
+    return ok;
+}
+
+// Parses track source text; on failure `errorLine` is the offending line
+bool ParseTrackSource(const string& text, vector<TrackSegment>& t, int& errorLine) {
+    t.clear();
+    errorLine = 0;
+    size_t pos = 0;
+    while (pos < text.size()) {
+        size_t eol = text.find('\n', pos);
+        if (eol == string::npos) eol = text.size();
+        string line = text.substr(pos, eol - pos);
+        pos = eol + 1;
+        errorLine++;
+        char word[16];
+        float a = 0.0f, b = 0.0f, c = 0.0f;
+        int n = sscanf(line.c_str(), "%15s %f %f %f", word, &a, &b, &c);
+        if (n <= 0 || word[0] == '#') continue;
+        if (strcmp(word, "segment") == 0 && n == 3 && b > 0.0f) {
+            t.push_back({ a, b });
+        } else if (strcmp(word, "obstacle") == 0 && n == 4 && !t.empty() && c > 0.0f) {
+            t.back().vecObstacles.push_back({ a, b, c });
+        } else {
+            return false;
+        }
+    }
+    return !t.empty();
+}
+
+void WriteTrackSource(FILE* f, const vector<TrackSegment>& t) {
+    fprintf(f, "# segment <curvature> <length>\n# obstacle <distance into segment> <offset x> <width>\n");
+    for (auto& seg : t) {
+        fprintf(f, "segment %.9g %.9g\n", seg.fCurvature, seg.fDistance);
+        for (auto& o : seg.vecObstacles) fprintf(f, "obstacle %.9g %.9g %.9g\n", o.fSegDistance, o.fOffsetX, o.fWidth);
+    }
+}
+
+void CompiledTrackName(uint64_t sourceHash, char* out, size_t n) {
+    snprintf(out, n, "track_%016llx.otb", (unsigned long long)sourceHash);
+}
+
+// Loads a track source (compiling it on a cache miss) or a compiled .otb
+bool LoadTrackFile(const char* path) {
+    size_t len = strlen(path);
+    if (len > 4 && strcmp(path + len - 4, ".otb") == 0) return MapCompiledTrack(path, 0);
+    string text;
+    if (!ReadWholeFile(path, text)) return false;
+    uint64_t hash = HashBytes(FNV_OFFSET, text.data(), text.size());
+    char cache[64];
+    CompiledTrackName(hash, cache, sizeof(cache));
+    if (MapCompiledTrack(cache, hash)) return true;
+    vector<TrackSegment> t;
+    int errorLine = 0;
+    if (!ParseTrackSource(text, t, errorLine)) return false;
+    vecTrack.swap(t);
+    InstallTrack();
+    g_trackHash = hash;
+    // Run from the mapping even on the first load; if the cache cannot be
+    // written the tables built in memory stay in use
+    if (WriteCompiledTrack(cache, hash)) MapCompiledTrack(cache, hash);
+    return true;
+}
+
+// =================================================================
+// Endless Track
+// =================================================================
+// a.exe --endless [seed] races a procedural track with no finish line.
+// Segments are generated ahead of the player into fixed rings and retired
+// behind it, so memory stays the same however far the car goes. The
+// generator is the only writer: it fills segment k's slots (and the end
+// entries in slot k + 1) before publishing the new head, and never touches a
+// slot from the tail on. Physics retires segments by moving the tail. The
+// same seed always gives the same track.
+const int ENDLESS_SEGMENTS = 512;                    // Segment ring capacity (power of two)
+const int ENDLESS_OBSTACLES = ENDLESS_SEGMENTS * 4;  // At most 3 per segment: fills after the segment ring
+const int ENDLESS_POINTS = ENDLESS_SEGMENTS * 256;   // Minimap points, one per unit of segments < 256 long
+const int ENDLESS_KEEP_BEHIND = 8;                   // Segments kept behind the player for the camera
+
+struct EndlessTrack {
+    // Ring storage, allocated by the first Start and never resized
+    vector<float> segCurvature;
+    vector<int64_t> segStartQ;
+    vector<int32_t> segCurvatureQ;
+    vector<int> segBegin;   // First obstacle of each segment
+    vector<int> pointBegin; // First minimap point of each segment
+    vector<float> obsOffsetX, obsWidth;
+    vector<int64_t> obsDistQ;
+    vector<int32_t> obsOffsetXQ, obsHalfWidthQ;
+    vector<pair<float, float>> points;
+
+    // Producer state
+    mt19937 rng;
+    int nNextSegment = 0, nNextObstacle = 0, nNextPoint = 0;
+    int64_t nEndQ = 0;
+    double fMapX = 0.0, fMapY = 0.0, fMapAngle = 0.0; // Double: the walk never ends
+    std::mutex producerMutex; // Generator thread vs. a restart from LoadMap
+    bool bThreaded = false;   // Filled by EndlessThreadProc rather than the stepping loop
+
+    // Appends segment nNextSegment and publishes it
+    void Produce() {
+        const int sm = ENDLESS_SEGMENTS - 1, om = ENDLESS_OBSTACLES - 1, pm = ENDLESS_POINTS - 1;
+        uniform_real_distribution<float> unit(0.0f, 1.0f);
+        int k = nNextSegment;
+        float curvature = 0.0f, length = 100.0f; // Clear run-up, like the built-in maps
+        if (k > 0) {
+            curvature = 0.9f * (unit(rng) * 2.0f - 1.0f);
+            length = floorf(80.0f + 170.0f * unit(rng));
+        }
+        segCurvature[k & sm] = curvature;
+        segCurvatureQ[k & sm] = ToQ16(curvature);
+
+        // Obstacles get denser the further the track goes, each at least 40 units from the next
+        int count = k < 2 ? 0 : (int)(rng() % (uint32_t)(min(3, 1 + k / 16) + 1));
+        count = min(count, (int)(length - 30.0f) / 60);
+        float slot = count > 0 ? (length - 30.0f) / (float)count : 0.0f;
+        for (int j = 0; j < count; ++j) {
+            float segDist = floorf(20.0f + slot * ((float)j + 0.3f * unit(rng)));
+            float width = 0.2f + 0.2f * unit(rng);
+            float offset = (ROAD_WIDTH_LIMIT - width * 0.5f) * (unit(rng) * 2.0f - 1.0f);
+            int o = nNextObstacle++ & om;
+            obsOffsetX[o] = offset;
+            obsWidth[o] = width;
+            obsDistQ[o] = nEndQ + ToQ16Wide(segDist);
+            obsOffsetXQ[o] = ToQ16(offset);
+            obsHalfWidthQ[o] = ToQ16(width * 0.5);
+        }
+
+        // Minimap points, continuing GenerateMapPoints' walk
+        double turn = MapTurn(curvature), dx, dy;
+        int nPoints = MapPointCount(length);
+        ArcPoints(fMapX, fMapY, fMapAngle, turn, nPoints, [&](int i, double px, double py) {
+            points[(nNextPoint + i) & pm] = make_pair((float)px, (float)py);
+        });
+        nNextPoint += nPoints;
+        ArcOffset(fMapAngle, turn, nPoints, dx, dy);
+        fMapX += dx;
+        fMapY += dy;
+        fMapAngle += nPoints * turn;
+
+        nEndQ += ToQ16Wide(length);
+        segStartQ[(k + 1) & sm] = nEndQ;
+        segBegin[(k + 1) & sm] = nNextObstacle;
+        pointBegin[(k + 1) & sm] = nNextPoint;
+        nNextSegment = k + 1;
+        g_trackWindow.nObsHead.store(nNextObstacle, memory_order_release);
+        g_trackWindow.nSegHead.store(nNextSegment, memory_order_release);
+    }
+
+    // Generates until the ring is full; returns the number of new segments
+    int Fill() {
+        std::lock_guard<std::mutex> lk(producerMutex);
+        if (segStartQ.empty()) return 0; // Not started yet
+        int n = 0;
+        // Segment k writes slot k + 1, which must not be the tail's
+        while (nNextSegment + 1 - g_trackWindow.nSegTail.load(memory_order_acquire) < ENDLESS_SEGMENTS) {
+            Produce();
+            n++;
+        }
+        return n;
+    }
+
+    // Points the track tables at the rings and regenerates from segment 0
+    void Start(uint32_t seed) {
+        {
+            std::lock_guard<std::mutex> lk(producerMutex);
+            if (segStartQ.empty()) {
+                segCurvature.resize(ENDLESS_SEGMENTS);
+                segStartQ.resize(ENDLESS_SEGMENTS); segCurvatureQ.resize(ENDLESS_SEGMENTS);
+                segBegin.resize(ENDLESS_SEGMENTS); pointBegin.resize(ENDLESS_SEGMENTS);
+                obsOffsetX.resize(ENDLESS_OBSTACLES); obsWidth.resize(ENDLESS_OBSTACLES);
+                obsDistQ.resize(ENDLESS_OBSTACLES); obsOffsetXQ.resize(ENDLESS_OBSTACLES); obsHalfWidthQ.resize(ENDLESS_OBSTACLES);
+                points.resize(ENDLESS_POINTS);
+            }
+            rng.seed(seed);
+            nNextSegment = nNextObstacle = nNextPoint = 0;
+            nEndQ = 0;
+            fMapX = fMapY = fMapAngle = 0.0;
+            segStartQ[0] = 0; segBegin[0] = 0; pointBegin[0] = 0;
+            g_trackWindow.nSegTail.store(0);
+            g_trackWindow.nObsTail.store(0);
+            g_trackWindow.nObsHead.store(0);
+            g_trackWindow.nSegHead.store(0);
+
+            vecTrack.clear();
+            fTotalTrackLength = INFINITY;
+            vecMapPointsCurrent.Assign(vector<MapVertex>()); // Drawn by DrawEndlessTrackView
+            g_mapPointsVersion++;
+            vecSegCurvature.Ring(segCurvature.data(), ENDLESS_SEGMENTS);
+            vecSegStartQ.Ring(segStartQ.data(), ENDLESS_SEGMENTS);
+            vecSegCurvatureQ.Ring(segCurvatureQ.data(), ENDLESS_SEGMENTS);
+            ObstacleIndex& oi = obstacleIndex;
+            oi.fOffsetX.Ring(obsOffsetX.data(), ENDLESS_OBSTACLES);
+            oi.fWidth.Ring(obsWidth.data(), ENDLESS_OBSTACLES);
+            oi.nSegBegin.Ring(segBegin.data(), ENDLESS_SEGMENTS);
+            oi.nDistQ.Ring(obsDistQ.data(), ENDLESS_OBSTACLES);
+            oi.nOffsetXQ.Ring(obsOffsetXQ.data(), ENDLESS_OBSTACLES);
+            oi.nHalfWidthQ.Ring(obsHalfWidthQ.data(), ENDLESS_OBSTACLES);
+            oi.nBucketBeginQ.View(nullptr, 0);
+            oi.nVersion++;
+            ReleaseTrackFile();
+        }
+        Fill();
+    }
+} g_endless;
+
+void StartEndlessTrack() { g_endless.Start(g_endlessSeed); }
+
+// Called after every player tick with the player's segment: retires what the
+// camera has left behind and, without a generator thread, refills the ring
+void EndlessAdvance(int section) {
+    if (!g_trackWindow.Streaming()) return;
+    int tail = section - ENDLESS_KEEP_BEHIND;
+    if (tail <= g_trackWindow.nSegTail.load(memory_order_relaxed)) return;
+    g_trackWindow.nObsTail.store(obstacleIndex.nSegBegin[tail], memory_order_relaxed);
+    g_trackWindow.nSegTail.store(tail, memory_order_release);
+    if (!g_endless.bThreaded) g_endless.Fill();
+}
+
+// Keeps the ring full during the game. Physics never waits for it: the ring
+// holds hundreds of segments ahead of the player.
+void EndlessThreadProc() {
+    while (running.load()) {
+        if (g_endless.Fill() == 0) Sleep(5);
+    }
+}
+
+// Minimap of the streamed track: a window from a couple of segments behind
+// the player to several ahead, fitted to the box every frame
+void DrawEndlessTrackView(wchar_t* s, int x, int y, int w, int h, float fPlayerDist, int64_t originQ) {
+    KernelDrawBox(s, x, y, w, h);
+    KernelDrawString(s, x + 1, y + 1, L"TRACK MAP");
+    static TrackCursor cursor; // Render thread only
+    const EndlessTrack& e = g_endless;
+    const int sm = ENDLESS_SEGMENTS - 1, pm = ENDLESS_POINTS - 1;
+    int head = TrackSegmentCount();
+    if (head <= 0) return;
+    int section = min(TrackSeek(cursor, fPlayerDist, originQ), head - 1);
+    int first = max(g_trackWindow.nSegTail.load(memory_order_acquire), section - 2);
+    int last = min(head, section + 7);
+    int p0 = e.pointBegin[first & sm], p1 = e.pointBegin[last & sm];
+    if (p1 <= p0) return;
+
+    float minX = 1e9f, maxX = -1e9f, minY = 1e9f, maxY = -1e9f;
+    for (int i = p0; i < p1; ++i) {
+        const pair<float, float>& pt = e.points[i & pm];
+        minX = min(minX, pt.first); maxX = max(maxX, pt.first);
+        minY = min(minY, pt.second); maxY = max(maxY, pt.second);
+    }
+    // Same scale on both axes so curves keep their shape as the window moves
+    float range = max(max(maxX - minX, maxY - minY), 1.0f);
+    float sx = (float)(w - 4) / range, sy = (float)(h - 4) / range;
+    auto plot = [&](int point, wchar_t ch, bool bInner) {
+        const pair<float, float>& pt = e.points[point & pm];
+        int px = x + 2 + (int)((pt.first - minX) * sx);
+        int py = y + h - 2 - (int)((pt.second - minY) * sy);
+        int b = bInner ? 1 : 0;
+        if (px >= x + b && px < x + w - b && py >= y + b && py < y + h - b) s[py * nScreenWidth + px] = ch;
+    };
+    // Point of a distance into segment sg
+    auto pointAt = [&](int sg, float segDist) {
+        int n = e.pointBegin[(sg + 1) & sm] - e.pointBegin[sg & sm];
+        return e.pointBegin[sg & sm] + max(0, min(n - 1, (int)segDist));
+    };
+
+    for (int i = p0; i < p1; ++i) plot(i, CHAR_FULL, true);
+    const ObstacleIndex& oi = obstacleIndex;
+    for (int sg = first; sg < last; ++sg)
+        for (int i = oi.nSegBegin[sg]; i < oi.nSegBegin[sg + 1]; ++i) plot(pointAt(sg, oi.Dist(i, vecSegStartQ[sg])), L'╳', true);
+    if (section >= first && section < last) plot(pointAt(section, fPlayerDist - LocalQ(vecSegStartQ[section], originQ)), L'★', false);
+}
+
+// =================================================================
+// Ghost Car
+// =================================================================
+// Best winning run per map, stored as one (distance, lateral x) sample per
+// physics tick in ghost_map<N>.osg:
+//   char[4] "OSGH", u16 version, u16 map id, u32 build constants hash,
+//   u32 sample count, GhostSample[count]
+// The render thread maps the file and samples it by race time, so drawing
+// the ghost needs no allocation or parsing per frame.
+struct GhostSample {
+    float fDistance;
+    float fX;
+};
+
+const char GHOST_MAGIC[4] = { 'O', 'S', 'G', 'H' };
+const uint16_t GHOST_VERSION = 1;
+const size_t GHOST_HEADER_BYTES = 16;
+
+void GhostFileName(int mapId, char* out, size_t n) {
+    snprintf(out, n, "ghost_map%d.osg", mapId);
+}
+
+struct GhostRun {
+    MappedFile file;
+    const GhostSample* pSamples = nullptr;
+    uint32_t nSamples = 0;
+
+    bool Active() const { return nSamples > 1; }
+
+    // Interpolated position at race time t (seconds); parks at the finish line afterwards
+    void SampleAt(double t, float& dist, float& x) const {
+        double f = t * PHYSICS_HZ;
+        if (f <= 0.0) { dist = 0.0f; x = 0.0f; return; }
+        uint32_t i = (uint32_t)f;
+        if (i >= nSamples - 1) { dist = pSamples[nSamples - 1].fDistance; x = pSamples[nSamples - 1].fX; return; }
+        float a = (float)(f - (double)i);
+        dist = pSamples[i].fDistance + (pSamples[i + 1].fDistance - pSamples[i].fDistance) * a;
+        x = pSamples[i].fX + (pSamples[i + 1].fX - pSamples[i].fX) * a;
+    }
+};
+
+GhostRun g_ghost; // Render thread only
+
+void GhostClose() {
+    UnmapFile(g_ghost.file);
+    g_ghost = GhostRun();
+}
+
+bool GhostOpen(int mapId) {
+    GhostClose();
+    if (g_trackPath || g_endlessTrack) return false; // Ghost files belong to the built-in maps
+    char path[64];
+    GhostFileName(mapId, path, sizeof(path));
+    MappedFile m;
+    if (!MapFileReadOnly(path, m)) return false;
+    uint16_t version = 0, fileMap = 0;
+    uint32_t constants = 0, count = 0;
+    if (m.nSize >= GHOST_HEADER_BYTES) {
+        memcpy(&version, m.pData + 4, 2);
+        memcpy(&fileMap, m.pData + 6, 2);
+        memcpy(&constants, m.pData + 8, 4);
+        memcpy(&count, m.pData + 12, 4);
+    }
+    if (m.nSize < GHOST_HEADER_BYTES || memcmp(m.pData, GHOST_MAGIC, 4) != 0 || version != GHOST_VERSION ||
+        fileMap != mapId || constants != BuildConstantsHash() ||
+        m.nSize < GHOST_HEADER_BYTES + (size_t)count * sizeof(GhostSample)) {
+        UnmapFile(m);
+        return false;
+    }
+    g_ghost.file = m;
+    g_ghost.pSamples = (const GhostSample*)(m.pData + GHOST_HEADER_BYTES);
+    g_ghost.nSamples = count;
+    return true;
+}
+
+const size_t GHOST_BLOCK_SAMPLES = 4096; // About 17 s of racing
+
+// One sample per physics tick, stored in fixed blocks: a race longer than
+// the blocks already held adds one without moving the samples recorded so
+// far, so the 240 Hz thread never copies the trail.
+struct GhostTrail {
+    void Clear() { nSize = 0; }
+    size_t Size() const { return nSize; }
+
+    // Allocates blocks up front for a race of `samples` ticks, and room for
+    // the block list itself to cover over an hour
+    void Reserve(size_t samples) {
+        blocks.reserve(max<size_t>(256, samples / GHOST_BLOCK_SAMPLES + 1));
+        while (blocks.size() * GHOST_BLOCK_SAMPLES < samples) blocks.emplace_back(new GhostSample[GHOST_BLOCK_SAMPLES]);
+    }
+
+    void Push(const GhostSample& s) {
+        size_t b = nSize / GHOST_BLOCK_SAMPLES;
+        if (b == blocks.size()) blocks.emplace_back(new GhostSample[GHOST_BLOCK_SAMPLES]);
+        blocks[b][nSize % GHOST_BLOCK_SAMPLES] = s;
+        nSize++;
+    }
+
+    void Write(FILE* f) const {
+        for (size_t b = 0; b * GHOST_BLOCK_SAMPLES < nSize; ++b)
+            fwrite(blocks[b].get(), sizeof(GhostSample), min(GHOST_BLOCK_SAMPLES, nSize - b * GHOST_BLOCK_SAMPLES), f);
+    }
+
+    void Swap(GhostTrail& o) {
+        blocks.swap(o.blocks);
+        std::swap(nSize, o.nSize);
+    }
+
+private:
+    vector<unique_ptr<GhostSample[]>> blocks;
+    size_t nSize = 0;
+};
+
+// Winning trail handed from the physics thread; written by the render thread
+// once it has released its mapping of the old ghost file.
+std::mutex g_ghost_mutex;
+GhostTrail g_pendingGhost;
+int g_pendingGhostMap = 0;
+
+// Saves the pending trail if it beats the stored ghost for its map.
+void GhostFlushPending() {
+    GhostTrail trail;
+    int mapId = 0;
+    {
+        std::lock_guard<std::mutex> lk(g_ghost_mutex);
+        if (g_pendingGhostMap == 0) return;
+        trail.Swap(g_pendingGhost);
+        mapId = g_pendingGhostMap;
+        g_pendingGhostMap = 0;
+    }
+    char path[64];
+    GhostFileName(mapId, path, sizeof(path));
+
+    FILE* f = fopen(path, "rb");
+    if (f) {
+        uint8_t hdr[GHOST_HEADER_BYTES];
+        uint32_t constants = 0, count = 0;
+        bool valid = fread(hdr, 1, sizeof(hdr), f) == sizeof(hdr) && memcmp(hdr, GHOST_MAGIC, 4) == 0;
+        fclose(f);
+        memcpy(&constants, hdr + 8, 4);
+        memcpy(&count, hdr + 12, 4);
+        if (valid && constants == BuildConstantsHash() && count <= trail.Size()) return; // Not a new best
+    }
+
+    f = fopen(path, "wb");
+    if (!f) return;
+    uint16_t version = GHOST_VERSION, map16 = (uint16_t)mapId;
+    uint32_t constants = BuildConstantsHash(), count = (uint32_t)trail.Size();
+    fwrite(GHOST_MAGIC, 1, 4, f);
+    fwrite(&version, 2, 1, f);
+    fwrite(&map16, 2, 1, f);
+    fwrite(&constants, 4, 1, f);
+    fwrite(&count, 4, 1, f);
+    trail.Write(f);
+    fclose(f);
+}
+
+// =================================================================
+// Batch Simulation (SoA)
+// =================================================================
+// N cars in structure-of-arrays form, all advanced one DELTA_T step per
+// BatchStep call. The vector kernels replay KernelStep operation by operation
+// (same operand order, no fused multiply-add), so every lane produces the same
+// bits as the scalar path. Build without FP contraction (MSVC /fp:precise
+// without /fp:contract, GCC/Clang -ffp-contract=off).
+#if defined(__AVX2__)
+#define BATCH_SIMD_WIDTH 8
+typedef __m256 vfloat;
+inline vfloat VLoad(const float* p) { return _mm256_loadu_ps(p); }
+inline void VStore(float* p, vfloat v) { _mm256_storeu_ps(p, v); }
+inline vfloat VSet(float f) { return _mm256_set1_ps(f); }
+inline vfloat VAdd(vfloat a, vfloat b) { return _mm256_add_ps(a, b); }
+inline vfloat VSub(vfloat a, vfloat b) { return _mm256_sub_ps(a, b); }
+inline vfloat VMul(vfloat a, vfloat b) { return _mm256_mul_ps(a, b); }
+inline vfloat VMin(vfloat a, vfloat b) { return _mm256_min_ps(a, b); }
+inline vfloat VMax(vfloat a, vfloat b) { return _mm256_max_ps(a, b); }
+inline vfloat VNeg(vfloat a) { return _mm256_xor_ps(a, _mm256_set1_ps(-0.0f)); }
+inline vfloat VCmpEq(vfloat a, vfloat b) { return _mm256_cmp_ps(a, b, _CMP_EQ_OQ); }
+inline vfloat VCmpLe(vfloat a, vfloat b) { return _mm256_cmp_ps(a, b, _CMP_LE_OQ); }
+inline vfloat VCmpGe(vfloat a, vfloat b) { return _mm256_cmp_ps(a, b, _CMP_GE_OQ); }
+inline vfloat VAnd(vfloat a, vfloat b) { return _mm256_and_ps(a, b); }
+inline vfloat VOr(vfloat a, vfloat b) { return _mm256_or_ps(a, b); }
+inline vfloat VSelect(vfloat m, vfloat a, vfloat b) { return _mm256_blendv_ps(b, a, m); } // m ? a : b
+inline int VMoveMask(vfloat m) { return _mm256_movemask_ps(m); }
+#elif defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define BATCH_SIMD_WIDTH 4
+typedef __m128 vfloat;
+inline vfloat VLoad(const float* p) { return _mm_loadu_ps(p); }
+inline void VStore(float* p, vfloat v) { _mm_storeu_ps(p, v); }
+inline vfloat VSet(float f) { return _mm_set1_ps(f); }
+inline vfloat VAdd(vfloat a, vfloat b) { return _mm_add_ps(a, b); }
+inline vfloat VSub(vfloat a, vfloat b) { return _mm_sub_ps(a, b); }
+inline vfloat VMul(vfloat a, vfloat b) { return _mm_mul_ps(a, b); }
+inline vfloat VMin(vfloat a, vfloat b) { return _mm_min_ps(a, b); }
+inline vfloat VMax(vfloat a, vfloat b) { return _mm_max_ps(a, b); }
+inline vfloat VNeg(vfloat a) { return _mm_xor_ps(a, _mm_set1_ps(-0.0f)); }
+inline vfloat VCmpEq(vfloat a, vfloat b) { return _mm_cmpeq_ps(a, b); }
+inline vfloat VCmpLe(vfloat a, vfloat b) { return _mm_cmple_ps(a, b); }
+inline vfloat VCmpGe(vfloat a, vfloat b) { return _mm_cmpge_ps(a, b); }
+inline vfloat VAnd(vfloat a, vfloat b) { return _mm_and_ps(a, b); }
+inline vfloat VOr(vfloat a, vfloat b) { return _mm_or_ps(a, b); }
+inline vfloat VSelect(vfloat m, vfloat a, vfloat b) { return _mm_or_ps(_mm_and_ps(m, a), _mm_andnot_ps(m, b)); }
+inline int VMoveMask(vfloat m) { return _mm_movemask_ps(m); }
+#else
+#define BATCH_SIMD_WIDTH 1
+typedef float vfloat; // Masks are 1.0f / 0.0f
+inline vfloat VLoad(const float* p) { return *p; }
+inline void VStore(float* p, vfloat v) { *p = v; }
+inline vfloat VSet(float f) { return f; }
+inline vfloat VAdd(vfloat a, vfloat b) { return a + b; }
+inline vfloat VSub(vfloat a, vfloat b) { return a - b; }
+inline vfloat VMul(vfloat a, vfloat b) { return a * b; }
+inline vfloat VMin(vfloat a, vfloat b) { return a < b ? a : b; }
+inline vfloat VMax(vfloat a, vfloat b) { return a > b ? a : b; }
+inline vfloat VNeg(vfloat a) { return -a; }
+inline vfloat VCmpEq(vfloat a, vfloat b) { return a == b ? 1.0f : 0.0f; }
+inline vfloat VCmpLe(vfloat a, vfloat b) { return a <= b ? 1.0f : 0.0f; }
+inline vfloat VCmpGe(vfloat a, vfloat b) { return a >= b ? 1.0f : 0.0f; }
+inline vfloat VAnd(vfloat a, vfloat b) { return (a != 0.0f && b != 0.0f) ? 1.0f : 0.0f; }
+inline vfloat VOr(vfloat a, vfloat b) { return (a != 0.0f || b != 0.0f) ? 1.0f : 0.0f; }
+inline vfloat VSelect(vfloat m, vfloat a, vfloat b) { return m != 0.0f ? a : b; }
+inline int VMoveMask(vfloat m) { return m != 0.0f ? 1 : 0; }
+#endif
+
+struct BatchSim {
+    int nCount = 0;  // Vehicles
+    int nPadded = 0; // nCount rounded up to BATCH_SIMD_WIDTH
+    // Vehicle state (PlayerPCB fields)
+    vector<float> fX, fSpeed, fDistance, fCurvature, fPlayerCurvature, fHeading, fSteer;
+    // Inputs for the next step: steer -1/0/+1, accel/brake 0/1
+    vector<float> fInSteer, fInAccel, fInBrake;
+    vector<float> fActive;     // 1 while racing, 0 once finished or crashed (and padding)
+    vector<float> fTargetCurv; // Scratch: curvature under each car
+    vector<float> fPrevDistance, fPrevX; // Scratch: position at the start of the step
+    vector<uint8_t> nEvent;    // KernelEvent that ended each car's run
+    vector<int64_t> nOriginQ;  // PlayerPCB::nOriginQ
+    vector<FixedState> q;      // PlayerPCB::q, stepped by BatchStepFixed
+    vector<KernelCursors> cursors;
+
+    void Resize(int n) {
+        nCount = n;
+        nPadded = (n + BATCH_SIMD_WIDTH - 1) / BATCH_SIMD_WIDTH * BATCH_SIMD_WIDTH;
+        vector<float>* arrays[] = { &fX, &fSpeed, &fDistance, &fCurvature, &fPlayerCurvature, &fHeading, &fSteer,
+                                    &fInSteer, &fInAccel, &fInBrake, &fActive, &fTargetCurv,
+                                    &fPrevDistance, &fPrevX };
+        for (auto* a : arrays) a->assign(nPadded, 0.0f);
+        for (int i = 0; i < n; ++i) fActive[i] = 1.0f;
+        nEvent.assign(nPadded, EVT_NONE);
+        nOriginQ.assign(nPadded, 0);
+        q.assign(nPadded, FixedState());
+        cursors.assign(nPadded, KernelCursors());
+    }
+
+    void SetInput(int i, const KernelInput& in) {
+        fInSteer[i] = (float)in.nSteer;
+        fInAccel[i] = in.bAccel ? 1.0f : 0.0f;
+        fInBrake[i] = in.bBrake ? 1.0f : 0.0f;
+    }
+
+    PlayerPCB Get(int i) const {
+        PlayerPCB p;
+        p.fX_Register = fX[i]; p.fSpeed = fSpeed[i]; p.fDistance = fDistance[i];
+        p.fCurvature = fCurvature[i]; p.fPlayerCurvature = fPlayerCurvature[i];
+        p.fHeadingAngle = fHeading[i]; p.nSteerState = (int)fSteer[i];
+        p.bCrashed = nEvent[i] == EVT_CRASH;
+        p.nOriginQ = nOriginQ[i];
+        p.q = q[i];
+        return p;
+    }
+
+    void Set(int i, const PlayerPCB& p) {
+        fX[i] = p.fX_Register; fSpeed[i] = p.fSpeed; fDistance[i] = p.fDistance;
+        fCurvature[i] = p.fCurvature; fPlayerCurvature[i] = p.fPlayerCurvature;
+        fHeading[i] = p.fHeadingAngle; fSteer[i] = (float)p.nSteerState;
+        nOriginQ[i] = p.nOriginQ;
+        q[i] = p.q;
+    }
+};
+
+// Advances every active car in the batch by one DELTA_T step.
+void BatchStep(BatchSim& b, const KernelParams& kp = KERNEL_DEFAULTS) {
+    const float dt = DELTA_T;
+    const vfloat vOne = VSet(1.0f), vMinusOne = VSet(-1.0f);
+    const vfloat vDt = VSet(dt);
+    const vfloat vAccelStep = VSet(kp.fAcceleration * dt), vDecelStep = VSet(kp.fDeceleration * dt);
+    const vfloat vFriction = VSet(kp.fFriction);
+    const vfloat vMaxSpeed = VSet(kp.fMaxSpeed), vMinSpeed = VSet(-15.0f);
+
+    // Pass 1: steer latch, speed and distance
+    for (int i = 0; i < b.nPadded; i += BATCH_SIMD_WIDTH) {
+        vfloat active = VCmpEq(VLoad(&b.fActive[i]), vOne);
+        vfloat inSteer = VLoad(&b.fInSteer[i]);
+        vfloat speed = VLoad(&b.fSpeed[i]);
+        vfloat accelerated = VAdd(speed, vAccelStep);
+        vfloat coasting = VMul(speed, vFriction);
+        vfloat s = VSelect(VCmpEq(VLoad(&b.fInAccel[i]), vOne), accelerated, coasting);
+        s = VSelect(VCmpEq(VLoad(&b.fInBrake[i]), vOne), VSub(s, vDecelStep), s);
+        s = VMax(vMinSpeed, VMin(vMaxSpeed, s));
+        vfloat dist = VLoad(&b.fDistance[i]);
+        vfloat d = VAdd(dist, VMul(s, vDt));
+        VStore(&b.fPrevDistance[i], dist);
+        VStore(&b.fSteer[i], VSelect(active, inSteer, VLoad(&b.fSteer[i])));
+        VStore(&b.fSpeed[i], VSelect(active, s, speed));
+        VStore(&b.fDistance[i], VSelect(active, d, dist));
+    }
+
+    // Pass 2 (scalar): finish line and segment lookup
+    const int64_t trackLengthQ = TrackLengthQ();
+    for (int i = 0; i < b.nCount; ++i) {
+        if (b.fActive[i] != 1.0f) continue;
+        float trackEnd = LocalQ(trackLengthQ, b.nOriginQ[i]);
+        if (b.fDistance[i] >= trackEnd) {
+            b.fDistance[i] = trackEnd;
+            b.nEvent[i] = EVT_WIN;
+        }
+        // Fast path: still inside the cached segment
+        int section = b.cursors[i].track.nSection;
+        int64_t dq = FloorQ16(b.fDistance[i], b.nOriginQ[i]);
+        if (section >= (int)vecSegCurvature.size() || dq < vecSegStartQ[section] || dq >= vecSegStartQ[section + 1])
+            section = TrackSeekQ(b.cursors[i].track, dq);
+        b.fTargetCurv[i] = section < (int)vecSegCurvature.size() ? vecSegCurvature[section] : 0.0f;
+    }
+
+    // Pass 3: curvature, lateral force and heading
+    const vfloat vThree = VSet(3.0f), vCurvScale = VSet(0.01f), vHalf = VSet(0.5f), vForty = VSet(40.0f);
+    const vfloat vLateral = VSet(kp.fLateralFactor), vSteerComp = VSet(kp.fSteerCompensation);
+    const vfloat vHeadingDrift = VSet(kp.fHeadingDriftFactor), vHeadingStep = VSet(kp.fHeadingTurnSpeed * dt);
+    const vfloat vHeadingDecay = VSet(0.95f);
+    for (int i = 0; i < b.nPadded; i += BATCH_SIMD_WIDTH) {
+        vfloat active = VCmpEq(VLoad(&b.fActive[i]), vOne);
+        vfloat speed = VLoad(&b.fSpeed[i]);
+        vfloat steer = VLoad(&b.fSteer[i]);
+        vfloat curv0 = VLoad(&b.fCurvature[i]);
+        vfloat pcurv0 = VLoad(&b.fPlayerCurvature[i]);
+        vfloat x0 = VLoad(&b.fX[i]);
+        vfloat h0 = VLoad(&b.fHeading[i]);
+
+        vfloat curv = VAdd(curv0, VMul(VMul(VSub(VLoad(&b.fTargetCurv[i]), curv0), vDt), vThree));
+        vfloat pcurv = VAdd(pcurv0, VMul(VMul(VMul(curv, vDt), speed), vCurvScale));
+
+        vfloat inertia = VMul(VMul(VNeg(curv), speed), vLateral);
+        vfloat comp = VMul(VMul(steer, vHalf), vSteerComp);
+        vfloat drift = VMul(VMul(h0, speed), vHeadingDrift);
+        vfloat force = VMul(VAdd(VAdd(inertia, comp), drift), vForty);
+        vfloat x = VAdd(x0, VMul(force, vDt));
+
+        vfloat h = VSelect(VCmpEq(steer, vMinusOne), VSub(h0, vHeadingStep),
+                   VSelect(VCmpEq(steer, vOne), VAdd(h0, vHeadingStep), VMul(h0, vHeadingDecay)));
+
+        VStore(&b.fCurvature[i], VSelect(active, curv, curv0));
+        VStore(&b.fPlayerCurvature[i], VSelect(active, pcurv, pcurv0));
+        VStore(&b.fX[i], VSelect(active, x, x0));
+        VStore(&b.fHeading[i], VSelect(active, h, h0));
+        VStore(&b.fPrevX[i], x0);
+    }
+
+    // Pass 4 (scalar): swept road edge and obstacle tests, then retire cars whose run ended
+    const ObstacleIndex& oi = obstacleIndex;
+    const int nObs = oi.Size(), nFirst = oi.First();
+    for (int i = 0; i < b.nCount; ++i) {
+        if (b.fActive[i] != 1.0f) continue;
+        // Fast path: the cached cursor still brackets an obstacle-free window over the whole path
+        int next = b.cursors[i].collision.nNext;
+        int64_t o = b.nOriginQ[i];
+        float d0 = b.fPrevDistance[i], x0 = b.fPrevX[i], d = b.fDistance[i], x = b.fX[i];
+        bool bClear = (next >= nObs || oi.Dist(next, o) > max(d0, d) + 0.5f) && (next <= nFirst || oi.Dist(next - 1, o) < min(d0, d) - 0.5f);
+        float t = bClear ? SweptEdgeTOI(x0, x) : SweptImpactTOI(d0, x0, d, x, b.nEvent[i] == EVT_NONE, o, b.cursors[i].collision);
+        if (t >= 0.0f) {
+            b.fDistance[i] = d0 + (d - d0) * t;
+            b.fX[i] = x0 + (x - x0) * t;
+            b.fSpeed[i] = 0.0f;
+            b.nEvent[i] = EVT_CRASH;
+        }
+        RebaseDistance(b.fDistance[i], b.nOriginQ[i]);
+        if (b.nEvent[i] != EVT_NONE) b.fActive[i] = 0.0f;
+    }
+}
+
+// BatchStep on the Q16 state, for --fixed: every active car takes the
+// player's own KernelStepFixed, so a batch stays integer-exact on any build.
+// The float columns are rewritten from the result.
+void BatchStepFixed(BatchSim& b, const FixedKernelConstants& k) {
+    for (int i = 0; i < b.nCount; ++i) {
+        if (b.fActive[i] != 1.0f) continue;
+        PlayerPCB p = b.Get(i);
+        KernelInput in;
+        in.nSteer = (int)b.fInSteer[i];
+        in.bAccel = b.fInAccel[i] == 1.0f;
+        in.bBrake = b.fInBrake[i] == 1.0f;
+        KernelEvent ev = KernelStepFixed(p, in, b.cursors[i], k);
+        b.Set(i, p);
+        b.nEvent[i] = (uint8_t)ev;
+        if (ev != EVT_NONE) b.fActive[i] = 0.0f;
+    }
+}
+
+// Deterministic lane-keeping driver with a per-car gain, used by the batch benchmark
+KernelInput BenchDriverInput(int car, float x, float heading) {
+    float gain = 0.5f + (float)(car % 16) * 0.05f;
+    float err = x + heading * gain;
+    KernelInput in;
+    in.bAccel = true;
+    in.nSteer = err > 0.05f ? -1 : (err < -0.05f ? 1 : 0);
+    return in;
+}
+
+// =================================================================
+// AI Opponents
+// =================================================================
+// a.exe --opponents N puts N AI cars on the grid ahead of the player. They
+// are stepped with BatchStep in chunks of OPPONENT_CHUNK cars, one
+// ParallelFor task per chunk, and collide with each other and the player
+// along the distance axis: the car behind is pushed back to one car length
+// and slowed, so drivers pull out to pass slower cars ahead. Crashed
+// opponents rejoin at their lane after a short delay; finished ones leave
+// the road. Under --fixed the drivers, BatchStepFixed and the contacts all
+// work on the Q16 state, so nothing float reaches the player's trajectory
+// and a fixed replay with opponents verifies on any build.
+const int MAX_OPPONENTS = 256;
+const int OPPONENT_CHUNK = 64; // Cars per BatchSim / parallel task
+const float CAR_LENGTH = 1.0f; // Bumper-to-bumper spacing on the distance axis
+const int OPPONENT_RESPAWN_TICKS = (int)PHYSICS_HZ; // 1 s
+const float OPPONENT_GRID_GAP = 4.0f;
+const float OPPONENT_PASS_RANGE = 12.0f; // How far ahead a driver looks for slower cars
+
+// What the renderer needs, sorted by distance
+struct OpponentSnapshot {
+    int nCount = 0;
+    int64_t nOriginQ = 0; // fDistance is measured from here (the player's origin)
+    float fDistance[MAX_OPPONENTS];
+    float fX[MAX_OPPONENTS];
+    float fSpeed[MAX_OPPONENTS];
+};
+SeqLock<OpponentSnapshot> g_opponentSnapshot;
+
+// Lane keeping with a dodge around the next obstacle and a per-driver pace
+KernelInput OpponentDriverInput(const BatchSim& b, int j, float skill, float lane, ObstacleCursor& look) {
+    const float LOOKAHEAD = 40.0f, EDGE = ROAD_WIDTH_LIMIT - PLAYER_HALF_WIDTH - 0.1f;
+    float d = b.fDistance[j], x = b.fX[j];
+    float target = lane;
+    int o = ObstacleSeek(look, d, b.nOriginQ[j]);
+    if (o < obstacleIndex.Size() && obstacleIndex.Dist(o, b.nOriginQ[j]) - d < LOOKAHEAD) {
+        float ox = obstacleIndex.fOffsetX[o];
+        float clear = obstacleIndex.fWidth[o] * 0.5f + PLAYER_HALF_WIDTH + 0.1f;
+        if (fabsf(target - ox) < clear) {
+            float left = ox - clear, right = ox + clear;
+            target = (right <= EDGE && (left < -EDGE || fabsf(right - x) < fabsf(left - x))) ? right : left;
+        }
+    }
+    float err = (x - target) + b.fHeading[j] * 0.6f;
+
+    KernelInput in;
+    in.nSteer = err > 0.04f ? -1 : (err < -0.04f ? 1 : 0);
+    float targetSpeed = MAX_SPEED * skill * (1.0f - min(0.4f, fabsf(b.fCurvature[j]) * 0.5f));
+    in.bAccel = b.fSpeed[j] < targetSpeed;
+    in.bBrake = b.fSpeed[j] > targetSpeed + 5.0f;
+    return in;
+}
+
+// The same driver on the Q16 state, for --fixed
+KernelInput OpponentDriverInputQ(const FixedState& q, int32_t skill, int32_t lane, ObstacleCursor& look) {
+    static const int64_t LOOKAHEAD = 40 * (int64_t)Q_ONE;
+    static const int32_t EDGE = ToQ16((double)ROAD_WIDTH_LIMIT - PLAYER_HALF_WIDTH - 0.1);
+    static const int32_t margin = ToQ16((double)PLAYER_HALF_WIDTH + 0.1), deadband = ToQ16(0.04);
+    static const int32_t maxSpeed = ToQ16(MAX_SPEED), maxSlowdown = ToQ16(0.4), brakeMargin = ToQ16(5.0);
+    static const int64_t kHeading = ToQ32(0.6);
+    const ObstacleIndex& oi = obstacleIndex;
+    int32_t target = lane;
+    int o = ObstacleSeekQ(look, q.nDistance);
+    if (o < oi.Size() && oi.nDistQ[o] - q.nDistance < LOOKAHEAD) {
+        int32_t ox = oi.nOffsetXQ[o], clear = oi.nHalfWidthQ[o] + margin;
+        if (abs(target - ox) < clear) {
+            int32_t left = ox - clear, right = ox + clear;
+            target = (right <= EDGE && (left < -EDGE || abs(right - q.nX) < abs(left - q.nX))) ? right : left;
+        }
+    }
+    int32_t err = (q.nX - target) + QScale(q.nHeading, kHeading);
+
+    KernelInput in;
+    in.nSteer = err > deadband ? -1 : (err < -deadband ? 1 : 0);
+    int32_t targetSpeed = QMul(QMul(maxSpeed, skill), Q_ONE - min(maxSlowdown, abs(q.nCurvature) / 2));
+    in.bAccel = q.nSpeed < targetSpeed;
+    in.bBrake = q.nSpeed > targetSpeed + brakeMargin;
+    return in;
+}
+
+struct OpponentField {
+    int nCount = 0;
+    vector<BatchSim> chunks;
+    vector<float> fSkill; // Fraction of MAX_SPEED each driver aims for
+    vector<float> fLane;  // Preferred lateral position
+    vector<float> fTarget; // Lateral position the driver steers for this tick
+    vector<int32_t> nTargetQ; // fTarget under --fixed
+    vector<int> nRespawn; // Ticks until a crashed car rejoins
+    vector<ObstacleCursor> lookCursors;
+    vector<int> order;    // Car ids sorted by distance, kept between ticks
+    int64_t nFrameQ = 0;  // Origin Dist() is measured from: the player's, as of the last Collide
+
+    BatchSim& Sim(int id) { return chunks[id / OPPONENT_CHUNK]; }
+    // Each car keeps its own origin; these convert to and from the common frame
+    float Dist(int id) {
+        BatchSim& b = Sim(id);
+        int j = id % OPPONENT_CHUNK;
+        return b.fDistance[j] + LocalQ(b.nOriginQ[j], nFrameQ);
+    }
+    void SetDist(int id, float d) {
+        BatchSim& b = Sim(id);
+        int j = id % OPPONENT_CHUNK;
+        b.fDistance[j] = d - LocalQ(b.nOriginQ[j], nFrameQ);
+    }
+    float& Speed(int id) { return Sim(id).fSpeed[id % OPPONENT_CHUNK]; }
+    float X(int id) { return Sim(id).fX[id % OPPONENT_CHUNK]; }
+    // Q16 state under --fixed, with absolute distances
+    FixedState& Q(int id) { return Sim(id).q[id % OPPONENT_CHUNK]; }
+    void MirrorQ(int id) {
+        BatchSim& b = Sim(id);
+        int j = id % OPPONENT_CHUNK;
+        PlayerPCB p = b.Get(j);
+        MirrorFixed(p);
+        b.Set(j, p);
+    }
+
+    // Two-wide grid ahead of the player, alternating lanes
+    void Reset(int n) {
+        nCount = max(0, min(MAX_OPPONENTS, n));
+        chunks.assign((nCount + OPPONENT_CHUNK - 1) / OPPONENT_CHUNK, BatchSim());
+        for (int c = 0; c < (int)chunks.size(); ++c) chunks[c].Resize(min(OPPONENT_CHUNK, nCount - c * OPPONENT_CHUNK));
+        fSkill.resize(nCount);
+        fLane.resize(nCount);
+        fTarget.resize(nCount);
+        nTargetQ.resize(nCount);
+        nRespawn.assign(nCount, 0);
+        lookCursors.assign(nCount, ObstacleCursor());
+        order.resize(nCount);
+        nFrameQ = 0;
+        for (int id = 0; id < nCount; ++id) {
+            uint32_t hash = (uint32_t)id * 2654435761u;
+            fSkill[id] = 0.80f + (float)((hash >> 8) % 1000) * 0.0002f; // 0.80 .. 1.00
+            fLane[id] = fTarget[id] = (id % 2 == 0 ? -0.4f : 0.4f);
+            Sim(id).fX[id % OPPONENT_CHUNK] = fLane[id];
+            SetDist(id, (float)((nCount - 1 - id) / 2 + 1) * OPPONENT_GRID_GAP);
+            order[id] = nCount - 1 - id;
+            if (g_fixedPhysics) {
+                Q(id).nX = nTargetQ[id] = ToQ16(fLane[id]);
+                Q(id).nDistance = ToQ16Wide((double)((nCount - 1 - id) / 2 + 1) * OPPONENT_GRID_GAP);
+                MirrorQ(id);
+            }
+        }
+    }
+
+    void StepChunk(int c) {
+        BatchSim& b = chunks[c];
+        for (int j = 0; j < b.nCount; ++j) {
+            int id = c * OPPONENT_CHUNK + j;
+            if (b.nEvent[j] == EVT_CRASH && --nRespawn[id] <= 0) {
+                b.nEvent[j] = EVT_NONE;
+                b.fActive[j] = 1.0f;
+                // Rejoin in the first lane clear of the obstacle that caused the crash
+                if (g_fixedPhysics) {
+                    FixedState& q = b.q[j];
+                    const int32_t lanes[] = { ToQ16(fLane[id]), -ToQ16(fLane[id]), 0 };
+                    q.nX = lanes[0];
+                    for (int32_t lx : lanes) {
+                        ObstacleCursor probe = lookCursors[id];
+                        if (!ObstacleHitQ(q.nDistance, lx, probe)) { q.nX = lx; break; }
+                    }
+                    q.nHeading = 0;
+                    q.nSpeed = 0;
+                    MirrorQ(id);
+                } else {
+                    const float lanes[] = { fLane[id], -fLane[id], 0.0f };
+                    b.fX[j] = lanes[0];
+                    for (float lx : lanes) {
+                        ObstacleCursor probe = lookCursors[id];
+                        if (!ObstacleHit(b.fDistance[j], lx, b.nOriginQ[j], probe)) { b.fX[j] = lx; break; }
+                    }
+                    b.fHeading[j] = 0.0f;
+                    b.fSpeed[j] = 0.0f;
+                }
+            }
+            if (b.fActive[j] != 1.0f) continue;
+            if (g_fixedPhysics) b.SetInput(j, OpponentDriverInputQ(b.q[j], ToQ16(fSkill[id]), nTargetQ[id], lookCursors[id]));
+            else b.SetInput(j, OpponentDriverInput(b, j, fSkill[id], fTarget[id], lookCursors[id]));
+        }
+        if (g_fixedPhysics) BatchStepFixed(b, FixedDefaults());
+        else BatchStep(b);
+        for (int j = 0; j < b.nCount; ++j)
+            if (b.nEvent[j] == EVT_CRASH && nRespawn[c * OPPONENT_CHUNK + j] <= 0)
+                nRespawn[c * OPPONENT_CHUNK + j] = OPPONENT_RESPAWN_TICKS;
+    }
+
+    bool Overlap(float xa, float xb) const { return fabsf(xa - xb) < 2.0f * PLAYER_HALF_WIDTH; }
+    bool OnRoad(int id) { return Sim(id).nEvent[id % OPPONENT_CHUNK] != EVT_WIN; }
+
+    // Pushes the trailing car of an overlapping pair back behind the leader
+    void Collide(PlayerPCB& p, bool bPlayerRacing) {
+        if (g_fixedPhysics) { CollideFixed(p, bPlayerRacing); return; }
+        nFrameQ = p.nOriginQ;
+        const float start = LocalQ(0, nFrameQ); // The start line in this frame
+        // Order barely changes tick to tick: insertion sort is linear here
+        for (int k = 1; k < nCount; ++k) {
+            int id = order[k];
+            float d = Dist(id);
+            int m = k;
+            while (m > 0 && Dist(order[m - 1]) > d) { order[m] = order[m - 1]; m--; }
+            order[m] = id;
+        }
+        for (int k = nCount - 1; k >= 0; --k) {
+            int back = order[k];
+            if (!OnRoad(back)) continue;
+            fTarget[back] = fLane[back];
+            for (int m = k + 1; m < nCount && Dist(order[m]) - Dist(back) < OPPONENT_PASS_RANGE; ++m) {
+                int front = order[m];
+                if (!OnRoad(front) || fabsf(X(back) - X(front)) > 0.5f) continue;
+                // Pull out past a slower car, to whichever side has more road
+                if (Speed(front) < Speed(back)) fTarget[back] = X(front) > 0.0f ? X(front) - 0.6f : X(front) + 0.6f;
+                if (Dist(front) - Dist(back) < CAR_LENGTH && Overlap(X(back), X(front))) {
+                    SetDist(back, max(start, Dist(front) - CAR_LENGTH));
+                    Speed(back) = min(Speed(back), Speed(front) * 0.8f);
+                }
+            }
+        }
+        if (!bPlayerRacing || p.bCrashed) return;
+
+        float pd = p.fDistance;
+        int k = (int)(lower_bound(order.begin(), order.end(), pd - CAR_LENGTH,
+                                  [this](int id, float v) { return Dist(id) < v; }) - order.begin());
+        for (; k < nCount && Dist(order[k]) < pd + CAR_LENGTH; ++k) {
+            int id = order[k];
+            if (!OnRoad(id) || !Overlap(X(id), p.fX_Register)) continue;
+            if (Dist(id) >= pd) {
+                p.fDistance = min(p.fDistance, max(start, Dist(id) - CAR_LENGTH));
+                p.fSpeed = min(p.fSpeed, Speed(id) * 0.8f);
+            } else {
+                SetDist(id, max(start, pd - CAR_LENGTH));
+                Speed(id) = min(Speed(id), p.fSpeed * 0.8f);
+            }
+        }
+    }
+
+    // Collide on the Q16 state. Distances are absolute, so no frame is needed.
+    void CollideFixed(PlayerPCB& p, bool bPlayerRacing) {
+        static const int64_t carLength = ToQ16Wide(CAR_LENGTH), passRange = ToQ16Wide(OPPONENT_PASS_RANGE);
+        static const int32_t width = ToQ16(2.0 * PLAYER_HALF_WIDTH), sameLane = ToQ16(0.5), pullOut = ToQ16(0.6);
+        static const int64_t kSlow = ToQ32(0.8);
+        nFrameQ = p.nOriginQ;
+        for (int k = 1; k < nCount; ++k) {
+            int id = order[k];
+            int64_t d = Q(id).nDistance;
+            int m = k;
+            while (m > 0 && Q(order[m - 1]).nDistance > d) { order[m] = order[m - 1]; m--; }
+            order[m] = id;
+        }
+        for (int k = nCount - 1; k >= 0; --k) {
+            int back = order[k];
+            if (!OnRoad(back)) continue;
+            FixedState& qb = Q(back);
+            nTargetQ[back] = ToQ16(fLane[back]);
+            for (int m = k + 1; m < nCount && Q(order[m]).nDistance - qb.nDistance < passRange; ++m) {
+                int front = order[m];
+                const FixedState& qf = Q(front);
+                if (!OnRoad(front) || abs(qb.nX - qf.nX) > sameLane) continue;
+                if (qf.nSpeed < qb.nSpeed) nTargetQ[back] = qf.nX > 0 ? qf.nX - pullOut : qf.nX + pullOut;
+                if (qf.nDistance - qb.nDistance < carLength && abs(qb.nX - qf.nX) < width) {
+                    qb.nDistance = max<int64_t>(0, qf.nDistance - carLength);
+                    qb.nSpeed = min(qb.nSpeed, QScale(qf.nSpeed, kSlow));
+                    MirrorQ(back);
+                }
+            }
+        }
+        if (!bPlayerRacing || p.bCrashed) return;
+
+        int64_t pd = p.q.nDistance;
+        int k = (int)(lower_bound(order.begin(), order.end(), pd - carLength,
+                                  [this](int id, int64_t v) { return Q(id).nDistance < v; }) - order.begin());
+        for (; k < nCount && Q(order[k]).nDistance < pd + carLength; ++k) {
+            int id = order[k];
+            FixedState& qo = Q(id);
+            if (!OnRoad(id) || abs(qo.nX - p.q.nX) >= width) continue;
+            if (qo.nDistance >= pd) {
+                p.q.nDistance = min(p.q.nDistance, max<int64_t>(0, qo.nDistance - carLength));
+                p.q.nSpeed = min(p.q.nSpeed, QScale(qo.nSpeed, kSlow));
+                MirrorFixed(p);
+            } else {
+                qo.nDistance = max<int64_t>(0, pd - carLength);
+                qo.nSpeed = min(qo.nSpeed, QScale(p.q.nSpeed, kSlow));
+                MirrorQ(id);
+            }
+        }
+    }
+
+    void Step(PlayerPCB& p, bool bPlayerRacing) {
+        if (nCount == 0) return;
+        if (chunks.size() > 1) SharedPool().ParallelFor((int)chunks.size(), [this](int c) { StepChunk(c); });
+        else StepChunk(0);
+        Collide(p, bPlayerRacing);
+    }
+
+    void Publish() {
+        OpponentSnapshot snap;
+        snap.nCount = nCount;
+        snap.nOriginQ = nFrameQ;
+        for (int k = 0; k < nCount; ++k) {
+            int id = order[k];
+            snap.fDistance[k] = Dist(id);
+            snap.fX[k] = X(id);
+            snap.fSpeed[k] = Speed(id);
+        }
+        g_opponentSnapshot.Publish(snap);
+    }
+};
+
+// Player tick followed by one tick of the opponent field
+KernelEvent RaceStep(PlayerPCB& p, const KernelInput& in, KernelCursors& cur, OpponentField& field) {
+    KernelEvent ev = KernelStep(p, in, cur);
+    field.Step(p, ev == EVT_NONE);
+    EndlessAdvance(cur.track.nSection);
+    return ev;
+}
+
+// =================================================================
+// Tick Pacing
+// =================================================================
+// Sleeps until each tick deadline with the OS timer (a high-resolution
+// waitable timer on Windows, clock_nanosleep(TIMER_ABSTIME) elsewhere),
+// waking a margin early and spinning the last few microseconds. The margin
+// follows the timer's measured oversleep, so the thread costs a few percent
+// of a core instead of the whole core a Sleep(0) loop burns.
+#ifndef CREATE_WAITABLE_TIMER_HIGH_RESOLUTION
+#define CREATE_WAITABLE_TIMER_HIGH_RESOLUTION 0x00000002
+#endif
+
+inline void CpuRelax() {
+#if defined(_WIN32)
+    YieldProcessor();
+#elif defined(__SSE2__)
+    _mm_pause();
+#endif
+}
+
+// Process CPU time in seconds (all threads)
+double ProcessCpuSeconds() {
+#ifdef _WIN32
+    FILETIME created, exited, kernel, user;
+    if (!GetProcessTimes(GetCurrentProcess(), &created, &exited, &kernel, &user)) return 0.0;
+    ULONGLONG k = ((ULONGLONG)kernel.dwHighDateTime << 32) | kernel.dwLowDateTime;
+    ULONGLONG u = ((ULONGLONG)user.dwHighDateTime << 32) | user.dwLowDateTime;
+    return (double)(k + u) * 1e-7;
+#else
+    timespec ts;
+    clock_gettime(CLOCK_PROCESS_CPUTIME_ID, &ts);
+    return (double)ts.tv_sec + (double)ts.tv_nsec * 1e-9;
+#endif
+}
+
+// Lateness of each tick relative to its deadline
+struct JitterStats {
+    static const int BUCKETS = 101; // 10 us buckets, last one = 1 ms and above
+    uint64_t nTicks = 0;
+    double fSumUs = 0.0, fSumSqUs = 0.0, fMaxUs = 0.0;
+    uint64_t hist[BUCKETS] = {};
+
+    void Add(double us) {
+        nTicks++;
+        fSumUs += us;
+        fSumSqUs += us * us;
+        fMaxUs = max(fMaxUs, us);
+        hist[min(BUCKETS - 1, (int)(us / 10.0))]++;
+    }
+    double MeanUs() const { return nTicks ? fSumUs / nTicks : 0.0; }
+    double StdDevUs() const {
+        if (!nTicks) return 0.0;
+        double m = MeanUs();
+        return sqrt(max(0.0, fSumSqUs / nTicks - m * m));
+    }
+    double PercentileUs(double q) const {
+        uint64_t target = (uint64_t)(q * (double)nTicks), acc = 0;
+        for (int i = 0; i < BUCKETS; ++i) { acc += hist[i]; if (acc > target) return (i + 1) * 10.0; }
+        return fMaxUs;
+    }
+};
+
+class TickPacer {
+public:
+    typedef chrono::steady_clock clock;
+    JitterStats stats;
+
+    explicit TickPacer(double hz) : period(chrono::duration_cast<clock::duration>(chrono::duration<double>(1.0 / hz))) {
+#ifdef _WIN32
+        hTimer = CreateWaitableTimerExW(NULL, NULL, CREATE_WAITABLE_TIMER_HIGH_RESOLUTION, TIMER_ALL_ACCESS);
+        if (!hTimer) {
+            // Pre-1803 Windows: plain timer at 1 ms system resolution
+            hTimer = CreateWaitableTimerW(NULL, TRUE, NULL);
+            timeBeginPeriod(1);
+            bRaisedResolution = true;
+        }
+#endif
+        next = clock::now();
+        Calibrate();
+    }
+
+    ~TickPacer() {
+#ifdef _WIN32
+        if (hTimer) CloseHandle(hTimer);
+        if (bRaisedResolution) timeEndPeriod(1);
+#endif
+    }
+
+    // Blocks until the next deadline. Returns the ticks now due: 1 normally,
+    // more when the thread was held up past later deadlines.
+    int WaitNext() {
+        next += period;
+        clock::time_point wakeAt = next - spinMargin;
+        clock::time_point now = clock::now();
+        if (now < wakeAt) {
+            SleepUntil(wakeAt);
+            now = clock::now();
+            AdaptMargin(now - wakeAt);
+        }
+        while (now < next) { CpuRelax(); now = clock::now(); }
+        stats.Add(chrono::duration<double, micro>(now - next).count());
+
+        int due = 1;
+        while (now >= next + period) { next += period; due++; }
+        return due;
+    }
+
+    clock::time_point LastDeadline() const { return next; }
+
+private:
+    clock::duration period;
+    clock::time_point next;
+    clock::duration spinMargin = chrono::microseconds(500);
+    double fOversleepUs = 0.0; // Smoothed timer oversleep
+#ifdef _WIN32
+    HANDLE hTimer = NULL;
+    bool bRaisedResolution = false;
+#endif
+
+    void SleepUntil(clock::time_point t) {
+#ifdef _WIN32
+        clock::duration left = t - clock::now();
+        if (left <= clock::duration::zero()) return;
+        if (!hTimer) { Sleep(0); return; }
+        LARGE_INTEGER due;
+        due.QuadPart = -(LONGLONG)(chrono::duration_cast<chrono::nanoseconds>(left).count() / 100); // Relative, 100 ns units
+        if (due.QuadPart == 0) return;
+        SetWaitableTimer(hTimer, &due, 0, NULL, NULL, FALSE);
+        WaitForSingleObject(hTimer, INFINITE);
+#else
+        // steady_clock shares CLOCK_MONOTONIC's epoch
+        chrono::nanoseconds ns = chrono::duration_cast<chrono::nanoseconds>(t.time_since_epoch());
+        timespec ts;
+        ts.tv_sec = (time_t)(ns.count() / 1000000000LL);
+        ts.tv_nsec = (long)(ns.count() % 1000000000LL);
+        while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &ts, NULL) == EINTR) {}
+#endif
+    }
+
+    // Margin = twice the smoothed oversleep plus slack, within [20 us, 2 ms]
+    void AdaptMargin(clock::duration oversleep) {
+        double us = chrono::duration<double, micro>(oversleep).count();
+        fOversleepUs += (us - fOversleepUs) * 0.05;
+        double marginUs = min(2000.0, max(20.0, fOversleepUs * 2.0 + 20.0));
+        spinMargin = chrono::duration_cast<clock::duration>(chrono::duration<double, micro>(marginUs));
+    }
+
+    // Seeds the oversleep estimate from a few short sleeps
+    void Calibrate() {
+        for (int i = 0; i < 16; ++i) {
+            clock::time_point t = clock::now() + chrono::microseconds(200);
+            SleepUntil(t);
+            double us = chrono::duration<double, micro>(clock::now() - t).count();
+            fOversleepUs = i == 0 ? us : max(fOversleepUs, us);
+        }
+        AdaptMargin(chrono::duration_cast<clock::duration>(chrono::duration<double, micro>(fOversleepUs)));
+        next = clock::now();
+    }
+};
+
+// =================================================================
+// Physics Thread
+// =================================================================
+// Eases the camera toward the curvature CAMERA_LAG_DISTANCE behind the player
+void CameraStep(CameraState& c, const PlayerPCB& p, TrackCursor& cursor) {
+    const float dt = DELTA_T;
+    float camDist = max(LocalQ(0, p.nOriginQ), p.fDistance - CAMERA_LAG_DISTANCE);
+    float targetCurv = 0.0f;
+    if (camDist < LocalQ(TrackLengthQ(), p.nOriginQ)) {
+        int section = TrackSeek(cursor, camDist, p.nOriginQ);
+        if (section < TrackSegmentCount()) targetCurv = vecSegCurvature[section];
+    }
+    c.fCurvature += (targetCurv - c.fCurvature) * dt * 3.0f;
+    c.fPlayerCurvature += c.fCurvature * dt * p.fSpeed * 0.01f;
+}
+
+void PhysicsThreadProc() {
+    TickPacer pacer(PHYSICS_HZ);
+    KernelCursors cursors;
+    ObstacleCursor warningCursor;
+    InputRecorder recorder;
+    InputSource replaySource;
+    uint64_t nRaceTick = 0;
+    GhostTrail ghostTrail;
+    TrackCursor cameraCursor;
+    CameraState camera;
+    RenderFrame frame;
+    uint64_t nTick = 0;
+    OpponentField opponents;
+    opponents.Reset(g_opponentCount);
+    Autopilot autopilot;
+    int nLastSteer = 0;
+    g_playerSnapshot.Publish(player);
+    g_renderFrame.Publish(frame);
+    opponents.Publish();
+
+    while (running.load()) {
+        int due = pacer.WaitNext();
+        double fLastDeadline = chrono::duration<double>(pacer.LastDeadline().time_since_epoch()).count();
+        for (int tick = 0; tick < due; ++tick) {
+            nTick++;
+            double fTickTime = fLastDeadline - (double)(due - 1 - tick) * DELTA_T;
+            auto raise = [&](uint32_t type) {
+                GameEvent e;
+                e.nType = type;
+                e.nMapId = g_currentMapId;
+                e.nTick = nTick;
+                e.fTime = fTickTime;
+                e.fDistance = (float)TrackPosition(player.nOriginQ, player.fDistance);
+                e.fX = player.fX_Register;
+                e.fSpeed = player.fSpeed;
+                g_events.Push(e);
+            };
+            // State first: a reset requested before entering KERNEL_RUNNING is then always seen
+            GameState st = currentState.load();
+            if (g_playerResetRequest.exchange(false)) {
+                player.Reset();
+                nRaceTick = 0;
+                g_playerSnapshot.Publish(player);
+                // No interpolation across a reset
+                camera = CameraState();
+                cameraCursor.Reset();
+                frame.cur = player;
+                frame.camCur = camera;
+                opponents.Reset(g_opponentCount);
+                opponents.Publish();
+            }
+
+            if (st == KERNEL_RUNNING) {
+                bool bWatching = g_replayWatching.load();
+                if (nRaceTick == 0) {
+                    if (bWatching) replaySource = ScriptInputSource(g_replayScript);
+                    else recorder.Begin(g_currentMapId);
+                    ghostTrail.Clear();
+                    ghostTrail.Reserve(1 << 16); // Longer races add blocks as they go
+                    autopilot.Reset();
+                    nLastSteer = 0;
+                    raise(GEV_RACE_START);
+                }
+
+                KernelInput in;
+                if (bWatching) {
+                    in = replaySource(nRaceTick, player);
+                } else {
+                    if (g_autopilot.load()) {
+                        KernelInput a = autopilot.Drive(player);
+                        input_steer.store(a.nSteer);
+                        input_accel.store(a.bAccel);
+                        input_brake.store(a.bBrake);
+                    }
+                    in.nSteer = input_steer.load();
+                    in.bAccel = input_accel.load();
+                    in.bBrake = input_brake.load();
+                }
+                if (in.nSteer != 0 && nLastSteer == 0 && player.fSpeed > 0.1f) raise(GEV_BRAKE);
+                nLastSteer = in.nSteer;
+                KernelEvent ev = RaceStep(player, in, cursors, opponents);
+                g_playerSnapshot.Publish(player);
+                opponents.Publish();
+                if (recorder.bActive) recorder.Append(in, player);
+                if (!g_endlessTrack) { // An endless run never wins, so it never becomes a ghost
+                    GhostSample gs = { (float)TrackPosition(player.nOriginQ, player.fDistance), player.fX_Register };
+                    ghostTrail.Push(gs);
+                }
+                nRaceTick++;
+
+                if (ev != EVT_NONE) {
+                    if (recorder.bActive) recorder.End(REPLAY_LAST_FILE);
+                    if (ev == EVT_WIN) {
+                        std::lock_guard<std::mutex> lk(g_ghost_mutex);
+                        g_pendingGhost.Swap(ghostTrail);
+                        g_pendingGhostMap = g_currentMapId;
+                    }
+                    g_replayWatching.store(false);
+                    nRaceTick = 0;
+                }
+                if (ev == EVT_CRASH) {
+                    currentState = GAME_OVER;
+                    raise(GEV_CRASH);
+                    raise(GEV_GAME_OVER);
+                } else if (ev == EVT_WIN) {
+                    currentState = GAME_WIN;
+                    raise(GEV_WIN);
+                }
+            }
+
+            if (st == KERNEL_RUNNING || st == GAME_WIN || st == GAME_OVER) CameraStep(camera, player, cameraCursor);
+            frame.prev = frame.cur;
+            frame.camPrev = frame.camCur;
+            frame.cur = player;
+            frame.camCur = camera;
+            frame.nTick = nTick;
+            frame.fTickTime = fTickTime;
+            g_renderFrame.Publish(frame);
+
+            // Obstacle warning
+            if (currentState.load() == KERNEL_RUNNING) {
+                float playerDist = player.fDistance;
+                const float WARNING_RANGE = 50.0f;
+                bool found = false;
+                float foundDistDelta = 0.0f, foundOffsetX = 0.0f;
+                // Nearest obstacle ahead of the player
+                int next = ObstacleSeek(warningCursor, playerDist, player.nOriginQ);
+                if (next < obstacleIndex.Size()) {
+                    float delta = obstacleIndex.Dist(next, player.nOriginQ) - playerDist;
+                    if (delta <= WARNING_RANGE) {
+                        found = true;
+                        foundDistDelta = delta;
+                        foundOffsetX = obstacleIndex.fOffsetX[next];
+                    }
+                }
+                if (found) {
+                    warnObstacle.store(true);
+                    warnObstacleDist.store(foundDistDelta);
+                    warnObstacleOffsetX.store(foundOffsetX);
+                } else {
+                    warnObstacle.store(false);
+                }
+            } else {
+                warnObstacle.store(false);
+            }
+        }
+    }
+}
+
+// =================================================================
+// Presenting Frames
+// =================================================================
+// A frame is a screen of characters plus Win32 console attributes (4-bit
+// foreground, 4-bit background). On Windows it goes out in two console
+// calls. On a VT terminal only the cells that changed since the last frame
+// are sent, as cursor moves, SGR color changes and UTF-8 text, in a single
+// write(); a mostly static scene then costs a small fraction of a full
+// redraw, which matters most over SSH.
+#ifdef _WIN32
+struct FramePresenter {
+    void Present(const wchar_t* chars, const WORD* attrs) {
+        std::lock_guard<std::mutex> lk(g_screen_mutex);
+        DWORD dw;
+        WriteConsoleOutputCharacterW(hConsole, chars, nScreenWidth * nScreenHeight, {0,0}, &dw);
+        WriteConsoleOutputAttribute(hConsole, attrs, nScreenWidth * nScreenHeight, {0,0}, &dw);
+    }
+};
+#else
+termios g_savedTermios;
+bool g_bTermiosSaved = false;
+
+void TerminalRestore() {
+    static const char leave[] = "\x1b[0m\x1b[?25h\x1b[?1049l"; // Reset colors, show cursor, leave alternate screen
+    static const char popKeys[] = "\x1b[<u"; // Back to the keyboard mode before TerminalBegin
+    ssize_t w = g_kittyKeyboard ? write(STDOUT_FILENO, popKeys, sizeof(popKeys) - 1) : 0;
+    w = write(STDOUT_FILENO, leave, sizeof(leave) - 1);
+    (void)w;
+    if (g_bTermiosSaved) tcsetattr(STDIN_FILENO, TCSANOW, &g_savedTermios);
+}
+
+void TerminalInterrupted(int) {
+    TerminalRestore();
+    _exit(130);
+}
+
+// Raw, non-blocking keyboard input on the alternate screen, undone on exit or Ctrl+C
+void TerminalBegin() {
+    if (tcgetattr(STDIN_FILENO, &g_savedTermios) == 0) {
+        g_bTermiosSaved = true;
+        termios raw = g_savedTermios;
+        raw.c_lflag &= ~(ICANON | ECHO);
+        raw.c_cc[VMIN] = 0;
+        raw.c_cc[VTIME] = 0;
+        tcsetattr(STDIN_FILENO, TCSANOW, &raw);
+    }
+    signal(SIGINT, TerminalInterrupted);
+    signal(SIGTERM, TerminalInterrupted);
+    // Alternate screen, hidden cursor, cleared; xterm-style terminals also resize
+    char enter[64];
+    int len = snprintf(enter, sizeof(enter), "\x1b[?1049h\x1b[?25l\x1b[2J\x1b[8;%d;%dt", nScreenHeight, nScreenWidth);
+    ssize_t w = write(STDOUT_FILENO, enter, (size_t)len);
+
+    // Kitty keyboard protocol: ask for its flags, then for the device
+    // attributes every VT terminal answers. A flags reply ahead of that
+    // answer means the terminal can report releases, so push flags 1 | 2 | 8
+    // (disambiguate, event types, every key as an escape code).
+    static const char query[] = "\x1b[?u\x1b[c";
+    static const char pushKeys[] = "\x1b[>11u";
+    w = write(STDOUT_FILENO, query, sizeof(query) - 1);
+    double deadline = TerminalNow() + 0.5;
+    while (!g_terminalReplies.bAttributes && TerminalNow() < deadline) {
+        PollTerminalKeys();
+        Sleep(1);
+    }
+    if (g_terminalReplies.bKittyFlags) {
+        w = write(STDOUT_FILENO, pushKeys, sizeof(pushKeys) - 1);
+        g_kittyKeyboard = true;
+    }
+    (void)w;
+}
+
+struct FramePresenter {
+    int fd = STDOUT_FILENO;
+    uint64_t nFrames = 0, nBytes = 0, nCells = 0; // Totals sent, for --bench-render
+    uint64_t nFirstBytes = 0;                      // The first frame: a full redraw
+
+    FramePresenter() : prevChars(nScreenWidth * nScreenHeight, 0), prevAttrs(nScreenWidth * nScreenHeight, 0) {
+        // Worst case per cell: cursor move, color change and a 3-byte character
+        out.reserve((size_t)nScreenWidth * nScreenHeight * 32);
+    }
+
+    void Present(const wchar_t* chars, const WORD* attrs) {
+        out.clear();
+        int curX = -1, curY = -1; // Where the terminal cursor is; -1 = unknown
+        int curAttr = -1;         // Attribute the terminal draws with; -1 = unknown
+        for (int y = 0; y < nScreenHeight; ++y) {
+            for (int x = 0; x < nScreenWidth; ++x) {
+                int i = y * nScreenWidth + x;
+                wchar_t c = chars[i];
+                if (bValid && c == prevChars[i] && attrs[i] == prevAttrs[i]) continue;
+                prevChars[i] = c;
+                prevAttrs[i] = attrs[i];
+                nCells++;
+                if (y == curY && x > curX && curX >= 0 && x - curX <= GAP_REPAINT && GapRepaintable(chars, i - (x - curX), i, curAttr)) {
+                    // Cheaper to repeat a few unchanged cells than to move over them
+                    for (int j = i - (x - curX); j < i; ++j) out += (char)chars[j];
+                }
+                else if (y == curY && x > curX && curX >= 0) Append(x - curX == 1 ? "\x1b[C" : "\x1b[%dC", x - curX);
+                else if (x != curX || y != curY) Append("\x1b[%d;%dH", y + 1, x + 1);
+                if (attrs[i] != curAttr) {
+                    int fg = SgrColor(attrs[i] & 0x0F, 30), bg = SgrColor((attrs[i] >> 4) & 0x0F, 40);
+                    if (curAttr >= 0 && (curAttr >> 4) == (attrs[i] >> 4)) Append("\x1b[%dm", fg);
+                    else if (curAttr >= 0 && (curAttr & 0x0F) == (attrs[i] & 0x0F)) Append("\x1b[%dm", bg);
+                    else Append("\x1b[%d;%dm", fg, bg);
+                    curAttr = attrs[i];
+                }
+                AppendUtf8(c);
+                // A character the terminal draws wider (or narrower) than a cell moves the cursor elsewhere
+                curX = x + 1;
+                curY = y;
+                if (c >= 0x80 && wcwidth(c) != 1) curX = -1;
+            }
+        }
+        bValid = true;
+        size_t sent = 0;
+        while (sent < out.size()) {
+            ssize_t w = write(fd, out.data() + sent, out.size() - sent);
+            if (w < 0 && errno == EINTR) continue;
+            if (w <= 0) break;
+            sent += (size_t)w;
+        }
+        if (nFrames++ == 0) nFirstBytes = out.size();
+        nBytes += out.size();
+    }
+
+private:
+    vector<wchar_t> prevChars;
+    vector<WORD> prevAttrs;
+    bool bValid = false; // prev* hold what the terminal shows
+    string out;
+
+    // Win32 color bits are blue 1, green 2, red 4, intensity 8; ANSI's are red 1, green 2, blue 4
+    static int SgrColor(int c, int base) {
+        int ansi = ((c & 4) ? 1 : 0) | (c & 2) | ((c & 1) ? 4 : 0);
+        return ((c & 8) ? base + 60 : base) + ansi;
+    }
+
+    static const int GAP_REPAINT = 3; // Unchanged cells worth repeating: an ESC [ n C move is 3-5 bytes
+
+    bool GapRepaintable(const wchar_t* chars, int from, int to, int attr) const {
+        for (int j = from; j < to; ++j)
+            if (chars[j] >= 0x80 || prevAttrs[j] != attr) return false;
+        return true;
+    }
+
+    void Append(const char* fmt, int a = 0, int b = 0) {
+        char tmp[32];
+        int len = snprintf(tmp, sizeof(tmp), fmt, a, b);
+        out.append(tmp, (size_t)len);
+    }
+
+    void AppendUtf8(wchar_t wc) {
+        uint32_t c = (uint32_t)wc;
+        if (c < 0x80) out += (char)c;
+        else if (c < 0x800) { out += (char)(0xC0 | (c >> 6)); out += (char)(0x80 | (c & 0x3F)); }
+        else if (c < 0x10000) {
+            out += (char)(0xE0 | (c >> 12)); out += (char)(0x80 | ((c >> 6) & 0x3F)); out += (char)(0x80 | (c & 0x3F));
+        } else {
+            out += (char)(0xF0 | (c >> 18)); out += (char)(0x80 | ((c >> 12) & 0x3F));
+            out += (char)(0x80 | ((c >> 6) & 0x3F)); out += (char)(0x80 | (c & 0x3F));
+        }
+    }
+};
+#endif
+FramePresenter g_presenter; // Render thread only
+
+// =================================================================
+// Render Thread
+// =================================================================
+// Heap allocations by the render thread, split into the first frames (maps,
+// rasters and caches warming up) and the rest, which should stay at zero.
+const uint64_t RENDER_WARMUP_FRAMES = 60;
+struct RenderAllocStats {
+    uint64_t nFrames = 0;
+    uint64_t nWarmupAllocs = 0;
+    uint64_t nSteadyAllocs = 0;
+    uint64_t nWorstFrame = 0; // Most allocations in one steady frame
+};
+RenderAllocStats g_renderAllocStats;
+uint64_t g_renderFrameLimit = 0; // Frames to draw before halting; 0 = run until halted
+bool g_renderUnpaced = false;    // Draw frames back to back instead of at FRAME_RATE
+
+void RenderThreadProc() {
+    using clock = chrono::high_resolution_clock;
+    const double frameMs = 1000.0 / FRAME_RATE;
+
+    int nSelectedMap = 1;
+    static const wchar_t* const maps[3] = {
+        L"1. No Obstacles",
+        L"2. Obstacles",
+        L"3. More Obstacles"
+    };
+    static const wchar_t* const desc[6] = {
+        L"LEVEL 1", L"General rural roads",
+        L"LEVEL 2", L"City roads",
+        L"LEVEL 3", L"Cyber ​​Road"
+    };
+
+    auto last = clock::now();
+    static double fTotalTime = 0.0;
+    TrackCursor cameraCursor;
+    ObstacleCursor roadHoleCursor;
+    uint64_t eventCursor = g_events.Head();
+    GameEvent hudEvent; // Latest game event, shown on the HUD for HUD_EVENT_SECONDS
+    bool bHudEvent = false;
+    const double HUD_EVENT_SECONDS = 2.0;
+
+    // Frame buffers live as long as the thread: a steady frame makes no heap
+    // allocations (see --bench-render)
+    vector<wchar_t> localBuf(nScreenWidth * nScreenHeight);
+    vector<WORD> localColor(nScreenWidth * nScreenHeight);
+    uint64_t nFrame = 0;
+
+    while (running.load()) {
+        auto start = clock::now();
+        uint64_t nAllocs0 = t_nHeapAllocs;
+        chrono::duration<double, milli> elapsed = start - last;
+        last = start;
+        double frameDeltaTime = elapsed.count() / 1000.0;
+        if (currentState.load() == KERNEL_RUNNING) fTotalTime += frameDeltaTime;
+        for (GameEvent e; g_events.Poll(eventCursor, e);) {
+            hudEvent = e;
+            bHudEvent = true;
+        }
+
+        fill(localBuf.begin(), localBuf.end(), CHAR_EMPTY);
+        fill(localColor.begin(), localColor.end(), (WORD)0x07);
+
+        GameState st = currentState.load();
+        int horizonY = nScreenHeight / 2;
+
+        // BOOT MENU
+        if (st == BOOT_MENU) {
+            KernelDrawBox(localBuf.data(), 35, 14, 50, 12);
+            KernelDrawString(localBuf.data(), 50, 18, L"OS RACER : KERNEL vX.Y (MT)");
+            KernelDrawString(localBuf.data(), 48, 22, L"[ PRESS SPACE TO START ]");
+            if (input_space_edge.exchange(false)) currentState = MAP_SELECT;
+            if (input_escape.exchange(false)) currentState = SYSTEM_HALT;
+        }
+        // MAP SELECT
+        else if (st == MAP_SELECT) {
+            KernelDrawBox(localBuf.data(), 15, 8, 40, 14);
+            KernelDrawString(localBuf.data(), 26, 10, L"SELECT TRACK");
+            for (int i = 0; i < 3; i++) {
+                KernelDrawString(localBuf.data(), 18, 13 + i * 2, (nSelectedMap == i + 1) ? L"▶ " : L"  ");
+                KernelDrawString(localBuf.data(), 20, 13 + i * 2, maps[i]);
+            }
+            KernelDrawBox(localBuf.data(), 15, 23, 40, 7);
+            KernelDrawString(localBuf.data(), 17, 24, L"DESCRIPTION:");
+            KernelDrawString(localBuf.data(), 17, 25, desc[(nSelectedMap - 1) * 2]);
+            KernelDrawString(localBuf.data(), 17, 26, desc[(nSelectedMap - 1) * 2 + 1]);
+            KernelDrawString(localBuf.data(), 20, 28, L"[↑↓] Select [SPACE] Start");
+            DrawTrackView(localBuf.data(), 65, 8, 40, 22, *vecMapPreview[nSelectedMap - 1], -1.0f);
+
+            if (input_up_edge.exchange(false)) nSelectedMap = max(1, nSelectedMap - 1);
+            if (input_down_edge.exchange(false)) nSelectedMap = min(3, nSelectedMap + 1);
+            if (input_1_edge.exchange(false)) nSelectedMap = 1;
+            if (input_2_edge.exchange(false)) nSelectedMap = 2;
+            if (input_3_edge.exchange(false)) nSelectedMap = 3;
+            if (input_space_edge.exchange(false)) {
+                LoadMap(nSelectedMap);
+                GhostClose();
+                GhostFlushPending();
+                GhostOpen(nSelectedMap);
+                RequestPlayerReset();
+                fTotalTime = 0.0;
+                currentState = KERNEL_RUNNING;
+            }
+            if (input_escape.exchange(false)) currentState = BOOT_MENU;
+        }
+        // RACING
+        else if (st == KERNEL_RUNNING || st == GAME_WIN || st == GAME_OVER) {
+            // Draw one tick behind physics, blended between the last two states
+            RenderFrame rf = g_renderFrame.Read();
+            double now = chrono::duration<double>(chrono::steady_clock::now().time_since_epoch()).count();
+            float alpha = (float)max(0.0, min(1.0, (now - rf.fTickTime) * PHYSICS_HZ));
+            auto lerp = [alpha](float a, float b) { return a + (b - a) * alpha; };
+            const PlayerPCB& snap = rf.cur;
+            float pX = lerp(rf.prev.fX_Register, snap.fX_Register);
+            float pSpeed = lerp(rf.prev.fSpeed, snap.fSpeed);
+            // Distances below are local to the latest tick's origin
+            const int64_t origin = snap.nOriginQ;
+            float pDist = lerp(rf.prev.fDistance + LocalQ(rf.prev.nOriginQ, origin), snap.fDistance);
+            double pTrackPos = TrackPosition(origin, pDist);
+            float pHeading = lerp(rf.prev.fHeadingAngle, snap.fHeadingAngle);
+            bool pCrashed = snap.bCrashed;
+            float fCameraCurvature = lerp(rf.camPrev.fCurvature, rf.camCur.fCurvature);
+            float fCameraPlayerCurvature = lerp(rf.camPrev.fPlayerCurvature, rf.camCur.fPlayerCurvature);
+
+            float fTrackEnd = LocalQ(TrackLengthQ(), origin);
+            float fCameraDistance = max(LocalQ(0, origin), pDist - CAMERA_LAG_DISTANCE);
+            float camPos = fCameraDistance;
+            int camSection = 0;
+            if (fCameraDistance < fTrackEnd) {
+                camSection = TrackSeek(cameraCursor, fCameraDistance, origin);
+                if (camSection < TrackSegmentCount()) camPos = fCameraDistance - LocalQ(vecSegStartQ[camSection], origin);
+            }
+
+            float fBgOffset = fCameraPlayerCurvature * 200.0f - pX * 30.0f;
+
+            // ==================== BACKGROUND ====================
+            // Speed-based background motion blur effect
+            float speedBlurFactor = 1.0f + (pSpeed / MAX_SPEED) * 0.5f; // 1.0x to 1.5x
+            
+            for (int y = 0; y < horizonY; ++y) {
+                for (int x = 0; x < nScreenWidth; ++x) {
+                    int idx = y * nScreenWidth + x;
+                    wchar_t& pixelChar = localBuf[idx];
+
+                    if (g_currentMapId == 1) { // Retro Grid (多層次山脈)
+
+                        float f2 = (x + fBgOffset * 0.1f * speedBlurFactor) * 0.07f;
+                        int h2 = (int)(fabs(sinf(f2)) * 8.0f + 3.0f);
+                        if (y >= horizonY - h2) {
+                            localBuf[idx] = CHAR_MED; // 使用中等字符
+                            localColor[idx] = FOREGROUND_GREEN  | FOREGROUND_GREEN | 0; 
+                        }
+
+                        float f1 = (x + fBgOffset * 0.2f * speedBlurFactor) * 0.08f;
+                        int h1 = (int)(fabs(sinf(f1)) * 10.0f + 4.0f);
+                        if (y >= horizonY - h1) {
+                            pixelChar = ((x + y) % 2 == 0) ? CHAR_LIGHT : CHAR_MED; 
+                            localColor[idx] = FOREGROUND_GREEN | FOREGROUND_INTENSITY; // 亮青綠色
+                        }
+                        
+                    }
+                    else if (g_currentMapId == 2) { // Cyber City
+                        float cityOffset = x + fBgOffset * speedBlurFactor;
+                        int bIndex = (int)(cityOffset / 6.0f);
+                        float rHeight = fabs(sinf(bIndex * 132.5f) + sinf(bIndex * 45.1f) * 0.5f);
+                        int h = (int)(rHeight * 8.0f + 4.0f);
+                        int bIndex2 = (int)((cityOffset + 100.0f) / 4.0f);
+                        float rHeight2 = fabs(sinf(bIndex2 * 99.3f));
+                        int h2 = (int)(rHeight2 * 6.0f + 2.0f);
+
+                        if (y >= horizonY - h) {
+                            if (rHeight > 0.4f && x % 3 != 0 && y % 3 != 0 && y > horizonY - h + 3)
+                                pixelChar = CHAR_LIGHT; // windows
+                            else
+                                pixelChar = CHAR_FULL;
+                            if (pixelChar == CHAR_FULL) {
+                                localColor[idx] = FOREGROUND_RED | FOREGROUND_BLUE | FOREGROUND_INTENSITY; // 粉紅建築
+                            }
+                        }
+                        else if (y >= horizonY - h2) {
+                            pixelChar = CHAR_MED;
+                        }
+                    }
+                    else if (g_currentMapId == 3) { // Pure Space
+                        int starX = (int)(x + fBgOffset * 0.1f * speedBlurFactor);
+                        int noise = (starX ^ (y * 57)) * 1664525;
+                        if ((noise & 0xFF) > 253) pixelChar = L'★';
+                        else if ((noise & 0xFF) > 245) pixelChar = L'.';
+                    }
+                }
+            }
+
+            // ==================== ROAD ====================
+            wchar_t roadMainChar = CHAR_DARK;
+            wchar_t roadStripeChar = CHAR_FULL;
+            wchar_t groundChar = CHAR_LIGHT;
+
+            if (g_currentMapId == 1) {
+                roadMainChar = CHAR_MED;    // 可見的中亮道路
+                roadStripeChar = CHAR_FULL;
+                groundChar = CHAR_DARK;
+            }
+            else if (g_currentMapId == 2) {
+                roadMainChar = CHAR_DARK;   // 深色瀝青
+                roadStripeChar = CHAR_FULL;
+                groundChar = CHAR_LIGHT;
+            }
+            else if (g_currentMapId == 3) {
+                roadMainChar = CHAR_MED;
+                roadStripeChar = CHAR_FULL;
+                groundChar = CHAR_EMPTY;
+            }
+
+            for (int y = 0; y < nScreenHeight / 2; y++) {
+                float pers = (float)y / (nScreenHeight / 2);
+                float mid = 0.5f + fCameraCurvature * powf(1.0f - pers, 3.0f) - pX * 0.5f;
+                float roadW = 0.1f + pers * 0.9f;
+                float clipW = roadW * 0.12f;
+                roadW *= 0.5f;
+                int row = horizonY + y;
+                float fDistToHorizon = (1.0f / (pers + 0.01f)) * 5.0f;
+                float fWorldDist = fCameraDistance + fDistToHorizon;
+                bool bDrawFinishLine = (fWorldDist >= fTrackEnd - 3.0f && fWorldDist <= fTrackEnd + 5.0f);
+                
+                // Speed-based stripe animation (faster speed = faster moving stripes)
+                float speedFactor = 1.0f + (pSpeed / MAX_SPEED) * 2.0f; // 1x to 3x speed
+                float stripeOffset = pDist * 0.2f * speedFactor;
+
+                for (int x = 0; x < nScreenWidth; x++) {
+                    float wx = (float)x / nScreenWidth;
+                    int nPixel = row * nScreenWidth + x;
+                    int stripe = (int)(25 * powf(1.0f - pers, 2.5f) + stripeOffset) % 2;
+
+                    if (wx >= mid - roadW && wx <= mid + roadW) {
+                        if (bDrawFinishLine && pDist < fTrackEnd) {
+                            bool check = ((int)(wx * 40) + (int)(y)) % 2 == 0;
+                            localBuf[nPixel] = check ? CHAR_FULL : CHAR_EMPTY;
+                        } else {
+                            localBuf[nPixel] = roadMainChar;
+                            if (fabs(wx - mid) < 0.005f && stripe)
+                                localBuf[nPixel] = roadStripeChar;
+                        }
+                    }
+                    else if (wx >= mid - roadW - clipW && wx <= mid + roadW + clipW) {
+                        localBuf[nPixel] = (g_currentMapId == 1) ? CHAR_FULL : (stripe ? roadStripeChar : roadMainChar);
+                        if (g_currentMapId == 2) {
+                            localBuf[nPixel] = CHAR_FULL; 
+                            bool isRed = ((int)(fWorldDist / 5.0f)) % 2 == 0;
+                            if (isRed) {
+                                localColor[nPixel] = FOREGROUND_RED | FOREGROUND_INTENSITY;
+                            } else {
+                                localColor[nPixel] = FOREGROUND_RED | FOREGROUND_GREEN | FOREGROUND_BLUE | FOREGROUND_INTENSITY;
+                            }
+                        }
+                    }
+                    else {
+                        localBuf[nPixel] = groundChar;
+                    }
+
+                    // Level 3 彩虹道路邊緣
+                    if (g_currentMapId == 3 && row >= horizonY) {
+                        if ((wx >= mid - roadW - clipW && wx <= mid - roadW) ||
+                            (wx >= mid + roadW && wx <= mid + roadW + clipW)) {
+                            int idx = ((int)pDist + x) % 7;
+                            WORD rainbow[7] = {
+                                FOREGROUND_RED | FOREGROUND_INTENSITY,
+                                FOREGROUND_RED | FOREGROUND_GREEN | FOREGROUND_INTENSITY,
+                                FOREGROUND_GREEN | FOREGROUND_INTENSITY,
+                                FOREGROUND_GREEN,
+                                FOREGROUND_BLUE | FOREGROUND_INTENSITY,
+                                FOREGROUND_RED | FOREGROUND_BLUE,
+                                FOREGROUND_RED | FOREGROUND_BLUE | FOREGROUND_INTENSITY
+                            };
+                            localColor[nPixel] = rainbow[idx];
+                        }
+                    }
+                }
+
+                // Obstacles (holes)
+                if (camSection < TrackSegmentCount()) {
+                    const ObstacleIndex& oi = obstacleIndex;
+                    ForEachRoadHole(camSection, camPos + fDistToHorizon, roadHoleCursor, [&](int oi_i) {
+                        float fObstacleX = mid + oi.fOffsetX[oi_i] * roadW * 2.0f;
+                        int nObsCenter = (int)(fObstacleX * nScreenWidth);
+                        int nObsPixelWidth = (int)(oi.fWidth[oi_i] * roadW * nScreenWidth * 2.0f);
+                        int nObsStart = nObsCenter - nObsPixelWidth / 2;
+                        int nObsEnd = nObsCenter + nObsPixelWidth / 2;
+                        for (int x = max(0, nObsStart); x < min(nScreenWidth, nObsEnd); ++x) {
+                            localBuf[row * nScreenWidth + x] = L' ';
+                        }
+                    });
+                }
+            }
+
+            // Other cars on the road, projected like the road rows
+            const int CAR_RENDER_ROW_Y = 28;
+            auto drawRoadCar = [&](float carDist, float carX, wchar_t ch, WORD color) {
+                float dz = carDist - fCameraDistance;
+                if (dz <= 0.0f) return;
+                // Inverse of the road's fDistToHorizon = 5 / (pers + 0.01)
+                float pers = min(1.0f, 5.0f / dz - 0.01f);
+                if (pers <= 0.0f) return;
+                int row = min(CAR_RENDER_ROW_Y, horizonY + (int)(pers * (nScreenHeight / 2)));
+                float roadW = (0.1f + pers * 0.9f) * 0.5f;
+                float mid = 0.5f + fCameraCurvature * powf(1.0f - pers, 3.0f) - pX * 0.5f;
+                int gx_center = (int)((mid + carX * roadW) * nScreenWidth);
+                // Full sprite near the camera, a compact one further out
+                static const wchar_t* carNear[] = { L"  |####|  ", L"|########|", L"||  ##  ||" };
+                static const wchar_t* carFar[] = { L"|##|" };
+                bool bNear = row >= CAR_RENDER_ROW_Y - 6;
+                const wchar_t** sprite = bNear ? carNear : carFar;
+                int rows = bNear ? 3 : 1;
+                int width = bNear ? 10 : 4;
+                for (int i = 0; i < rows; ++i) {
+                    int draw_y = row - (rows - 1) + i;
+                    if (draw_y <= horizonY || draw_y >= nScreenHeight) continue;
+                    for (int cx = 0; cx < width; ++cx) {
+                        int target_x = gx_center - width / 2 + cx;
+                        if (target_x < 0 || target_x >= nScreenWidth || sprite[i][cx] == L' ') continue;
+                        localBuf[draw_y * nScreenWidth + target_x] = ch;
+                        localColor[draw_y * nScreenWidth + target_x] = color;
+                    }
+                }
+            };
+
+            // AI opponents, far to near; positions rewound to the interpolated tick
+            OpponentSnapshot opp = g_opponentSnapshot.Read();
+            float oppShift = LocalQ(opp.nOriginQ, origin);
+            for (int k = 0; k < opp.nCount; ++k) opp.fDistance[k] += oppShift - opp.fSpeed[k] * DELTA_T * (1.0f - alpha);
+            for (int k = opp.nCount - 1; k >= 0; --k)
+                drawRoadCar(opp.fDistance[k], opp.fX[k], CHAR_DARK, FOREGROUND_RED | FOREGROUND_BLUE | FOREGROUND_INTENSITY);
+
+            // Ghost Car (best run), drawn under the player car
+            float fGhostDist = -1.0f;
+            if (g_ghost.Active()) {
+                float gX = 0.0f;
+                g_ghost.SampleAt(fTotalTime, fGhostDist, gX); // Ghosts record track positions
+                drawRoadCar(fGhostDist - LocalQ(origin, 0), gX, CHAR_LIGHT, FOREGROUND_GREEN | FOREGROUND_BLUE | FOREGROUND_INTENSITY);
+            }
+
+            // Player Car
+            int Y_INDEX = CAR_RENDER_ROW_Y - nScreenHeight / 2;
+            float pers_car = (float)Y_INDEX / (nScreenHeight / 2);
+            float mid_car = 0.5f + fCameraCurvature * powf(1.0f - pers_car, 3.0f) - pX * 0.5f;
+            float car_x_norm = mid_car + pX * 0.5f;
+            int car_x_center = (int)(car_x_norm * nScreenWidth);
+            int nSteer = snap.nSteerState;
+            if (nSteer == 0 && fabsf(pHeading) > 0.05f) nSteer = pHeading > 0.0f ? 1 : -1; // Still settling after a turn
+
+            static const wchar_t* const carSprites[3][5] = {
+                {                       // straight
+                    L"   ||####||   ",
+                    L"      ##      ",
+                    L"     ####     ",
+                    L"|||########|||",
+                    L"|||  ####  |||"
+                },
+                {                       // turning right
+                    L"      //####//",
+                    L"        ##    ",
+                    L"      ####    ",
+                    L"/// ########//",
+                    L"///   #### ///"
+                },
+                {                       // turning left
+                    L"\\\\####\\\\      ",
+                    L"    ##        ",
+                    L"    ####      ",
+                    L"\\\\######## \\\\\\",
+                    L"\\\\\\ ####   \\\\\\"
+                }
+            };
+            const wchar_t* const* carSprite = carSprites[nSteer == 0 ? 0 : nSteer > 0 ? 1 : 2];
+
+            int sprite_height = 5;
+            int sprite_width = 14;
+            for (int i = 0; i < sprite_height; ++i) {
+                int draw_y = CAR_RENDER_ROW_Y - (sprite_height - 1) + i;
+                if (draw_y < 0 || draw_y >= nScreenHeight) continue;
+                int draw_x_start = car_x_center - (sprite_width / 2);
+                for (int cx = 0; cx < sprite_width && carSprite[i][cx]; ++cx) {
+                    int target_x = draw_x_start + cx;
+                    if (target_x < 0 || target_x >= nScreenWidth) continue;
+                    wchar_t ch = carSprite[i][cx];
+                    if (ch != L' ') localBuf[draw_y * nScreenWidth + target_x] = ch;
+                }
+            }
+
+            // HUD
+            KernelDrawBox(localBuf.data(), 1, 1, 30, 11);
+            KernelDrawString(localBuf.data(), 3, 2, L"SYSTEM MONITOR");
+            if (g_autopilot.load()) KernelDrawString(localBuf.data(), 21, 2, L"[AUTO]");
+            wchar_t buf[80];
+            if (g_endlessTrack) swprintf_s(buf, L"DIST : %.0f (ENDLESS)", pTrackPos);
+            else swprintf_s(buf, L"DIST : %.0f / %.0f", pTrackPos, fTotalTrackLength);
+            KernelDrawString(localBuf.data(), 3, 4, buf);
+            swprintf_s(buf, L"TIME : %.2f sec", fTotalTime);
+            KernelDrawString(localBuf.data(), 3, 6, buf);
+            
+            // Speed with visual indicator
+            int speedPercent = (int)((pSpeed / MAX_SPEED) * 100.0f);
+            swprintf_s(buf, L"SPEED: %3d km/h", (int)pSpeed);
+            KernelDrawString(localBuf.data(), 3, 8, buf);
+            
+            // Speed bar
+            const int barWidth = 24;
+            int filledWidth = (int)((pSpeed / MAX_SPEED) * barWidth);
+            wchar_t speedBar[barWidth + 3];
+            speedBar[0] = L'[';
+            for (int i = 0; i < barWidth; i++) {
+                if (i < filledWidth) {
+                    // Color based on speed: green -> yellow -> red
+                    if (i < barWidth / 3) speedBar[i + 1] = L'█';
+                    else if (i < barWidth * 2 / 3) speedBar[i + 1] = L'▓';
+                    else speedBar[i + 1] = L'▒';
+                } else {
+                    speedBar[i + 1] = L' ';
+                }
+            }
+            speedBar[barWidth + 1] = L']';
+            speedBar[barWidth + 2] = L'\0';
+            KernelDrawString(localBuf.data(), 3, 9, speedBar);
+            
+            // Speed effect indicator
+            if (pSpeed > MAX_SPEED * 0.7f) {
+                KernelDrawString(localBuf.data(), 3, 10, L">>> HIGH SPEED <<<");
+            }
+
+            if (warnObstacle.load()) {
+                swprintf_s(buf, L"OBST: %.0f m", warnObstacleDist.load());
+                KernelDrawString(localBuf.data(), 3, 5, buf);
+            }
+
+            if (bHudEvent && now - hudEvent.fTime < HUD_EVENT_SECONDS) {
+                swprintf_s(buf, L"EVT  : %ls t%llu", GameEventName(hudEvent.nType), (unsigned long long)hudEvent.nTick);
+                KernelDrawString(localBuf.data(), 3, 7, buf);
+            }
+
+			if (g_endlessTrack) DrawEndlessTrackView(localBuf.data(), nScreenWidth - 33, 1, 31, 15, pDist, origin);
+			else {
+                // The minimap places cars by track position
+                for (int k = 0; k < opp.nCount; ++k) opp.fDistance[k] += LocalQ(origin, 0);
+                DrawTrackView(localBuf.data(), nScreenWidth - 33, 1, 31, 15, vecMapPointsCurrent, (float)pTrackPos, fGhostDist,
+                              opp.fDistance, opp.nCount);
+            }
+
+            // ==================== [START] 設置儀表板和地圖背景為白色 ====================
+            const WORD WHITE_BACKGROUND = BACKGROUND_RED | BACKGROUND_GREEN | BACKGROUND_BLUE;
+            
+            // 設置儀表板背景
+            int hudX = 1, hudY = 1, hudW = 29, hudH = 10;
+            for (int y = hudY; y <= hudY + hudH; ++y) {
+                if (y >= nScreenHeight) break;
+                for (int x = hudX; x <= hudX + hudW; ++x) {
+                    if (x >= nScreenWidth) break;
+                    // 保留前景文字顏色，只修改背景為白色 (0x0F 是白字黑底，需要修改)
+                    localColor[y * nScreenWidth + x] = (localColor[y * nScreenWidth + x] & 0xF0) | WHITE_BACKGROUND;
+                }
+            }
+            
+            // 設置地圖鳥瞰圖背景
+            int mapX = nScreenWidth - 33, mapY = 1, mapW = 31, mapH = 14;
+            for (int y = mapY; y <= mapY + mapH; ++y) {
+                if (y >= nScreenHeight) break;
+                for (int x = mapX; x <= mapX + mapW; ++x) {
+                    if (x >= nScreenWidth) break;
+                    // 保留前景文字顏色，只修改背景為白色
+                    localColor[y * nScreenWidth + x] = (localColor[y * nScreenWidth + x] & 0xF0) | WHITE_BACKGROUND;
+                }
+            }
+
+            if (st == GAME_OVER) {
+                // Enhanced GAME OVER screen
+                KernelDrawBox(localBuf.data(), 35, 10, 50, 16);
+                KernelDrawString(localBuf.data(), 52, 12, L"╔══════════════════╗");
+                KernelDrawString(localBuf.data(), 52, 13, L"║                  ║");
+                KernelDrawString(localBuf.data(), 52, 14, L"║   GAME  OVER     ║");
+                KernelDrawString(localBuf.data(), 52, 15, L"║                  ║");
+                KernelDrawString(localBuf.data(), 52, 16, L"╚══════════════════╝");
+                
+                KernelDrawString(localBuf.data(), 48, 18, L"!! CRASHED !!");
+                KernelDrawString(localBuf.data(), 45, 20, L"Final Distance: ");
+                if (g_endlessTrack) swprintf_s(buf, L"%.0f", pTrackPos);
+                else swprintf_s(buf, L"%.0f / %.0f", pTrackPos, fTotalTrackLength);
+                KernelDrawString(localBuf.data(), 60, 20, buf);
+                KernelDrawString(localBuf.data(), 45, 21, L"Time: ");
+                swprintf_s(buf, L"%.2f sec", fTotalTime);
+                KernelDrawString(localBuf.data(), 51, 21, buf);
+                KernelDrawString(localBuf.data(), 45, 22, L"Final Speed: ");
+                swprintf_s(buf, L"%d km/h", (int)pSpeed);
+                KernelDrawString(localBuf.data(), 58, 22, buf);
+                
+                KernelDrawString(localBuf.data(), 46, 24, L"[SPACE] Return to Menu");
+                KernelDrawString(localBuf.data(), 46, 25, L"[ESC] Exit Game");
+                
+                // Red tint for crash effect
+                for (int y = 10; y < 26; y++) {
+                    for (int x = 35; x < 85; x++) {
+                        if (x < nScreenWidth && y < nScreenHeight) {
+                            int idx = y * nScreenWidth + x;
+                            if (localBuf[idx] != CHAR_EMPTY) {
+                                localColor[idx] = (localColor[idx] & 0xF0) | FOREGROUND_RED | FOREGROUND_INTENSITY;
+                            }
+                        }
+                    }
+                }
+                
+                if (input_space_edge.exchange(false)) {
+                    RequestPlayerReset();
+                    currentState = MAP_SELECT;
+                }
+                if (input_escape.exchange(false)) currentState = SYSTEM_HALT;
+            }
+            if (st == GAME_WIN) {
+                // Enhanced VICTORY screen with animation
+                static float victoryAnimTime = 0.0f;
+                victoryAnimTime += (float)frameDeltaTime;
+                
+                // Animated border effect
+                int animOffset = (int)(sinf(victoryAnimTime * 2.0f) * 2.0f);
+                
+                // Large victory box
+                KernelDrawBox(localBuf.data(), 30, 5, 60, 20);
+                
+                // Decorative top border
+                KernelDrawString(localBuf.data(), 35, 6, L"╔═══════════════════════════════════════════╗");
+                KernelDrawString(localBuf.data(), 35, 7, L"║                                           ║");
+                
+                // Large VICTORY text with animation (simplified to fit screen)
+                int titleY = 8;
+                KernelDrawString(localBuf.data(), 42 + animOffset, titleY,     L"╔╗  ╦ ╦╔═╗╔═╗╔╦╗╦ ╦╔═╗╦");
+                KernelDrawString(localBuf.data(), 42 + animOffset, titleY + 1, L"╠╩╗ ║║║╠═╣║   ║ ╠═╣║ ╦║");
+                KernelDrawString(localBuf.data(), 42 + animOffset, titleY + 2, L"╚═╝ ╚╩╝╩ ╩╚═╝ ╩ ╩ ╩╚═╝╩");
+                KernelDrawString(localBuf.data(), 48 + animOffset, titleY + 4, L"★ ★ ★ ★ ★");
+                
+                // Separator
+                KernelDrawString(localBuf.data(), 35, 14, L"║                                           ║");
+                KernelDrawString(localBuf.data(), 35, 15, L"╠═══════════════════════════════════════════╣");
+                KernelDrawString(localBuf.data(), 35, 16, L"║                                           ║");
+                
+                // Statistics section
+                int statY = 17;
+                KernelDrawString(localBuf.data(), 37, statY, L"╔═══════════════════════════════════════╗");
+                KernelDrawString(localBuf.data(), 37, statY + 1, L"║  RACE STATISTICS                     ║");
+                KernelDrawString(localBuf.data(), 37, statY + 2, L"╠═══════════════════════════════════════╣");
+                
+                // Calculate statistics
+                float avgSpeed = fTotalTime > 0.0f ? (fTotalTrackLength / fTotalTime) : 0.0f;
+                
+                // Display stats
+                KernelDrawString(localBuf.data(), 39, statY + 3, L"║  Total Distance: ");
+                swprintf_s(buf, L"%.0f units", fTotalTrackLength);
+                KernelDrawString(localBuf.data(), 58, statY + 3, buf);
+                KernelDrawString(localBuf.data(), 72, statY + 3, L"║");
+                
+                KernelDrawString(localBuf.data(), 39, statY + 4, L"║  Completion Time: ");
+                swprintf_s(buf, L"%.2f sec", fTotalTime);
+                KernelDrawString(localBuf.data(), 59, statY + 4, buf);
+                KernelDrawString(localBuf.data(), 72, statY + 4, L"║");
+                
+                KernelDrawString(localBuf.data(), 39, statY + 5, L"║  Average Speed: ");
+                swprintf_s(buf, L"%.1f km/h", avgSpeed);
+                KernelDrawString(localBuf.data(), 57, statY + 5, buf);
+                KernelDrawString(localBuf.data(), 72, statY + 5, L"║");
+                
+                // Performance rating
+                const wchar_t* rating;
+                if (fTotalTime < fTotalTrackLength / 30.0f) {
+                    rating = L"EXCELLENT!";
+                } else if (fTotalTime < fTotalTrackLength / 25.0f) {
+                    rating = L"GREAT!";
+                } else if (fTotalTime < fTotalTrackLength / 20.0f) {
+                    rating = L"GOOD!";
+                } else {
+                    rating = L"COMPLETED!";
+                }
+                
+                KernelDrawString(localBuf.data(), 39, statY + 6, L"║  Performance: ");
+                KernelDrawString(localBuf.data(), 56, statY + 6, rating);
+                KernelDrawString(localBuf.data(), 72, statY + 6, L"║");
+                
+                KernelDrawString(localBuf.data(), 37, statY + 7, L"╚═══════════════════════════════════════╝");
+                
+                // Instructions
+                KernelDrawString(localBuf.data(), 35, 22, L"║                                       ║");
+                KernelDrawString(localBuf.data(), 42, 23, L"[SPACE] Return  [ESC] Exit");
+                KernelDrawString(localBuf.data(), 35, 24, L"╚═══════════════════════════════════════╝");
+                
+                // Animated color effect - rainbow/gold shimmer (within bounds)
+                int boxX = 30, boxY = 5, boxW = 60, boxH = 20;
+                for (int y = boxY; y < boxY + boxH && y < nScreenHeight; y++) {
+                    for (int x = boxX; x < boxX + boxW && x < nScreenWidth; x++) {
+                        int idx = y * nScreenWidth + x;
+                        if (localBuf[idx] != CHAR_EMPTY) {
+                            // Create shimmer effect
+                            int colorPhase = (int)(victoryAnimTime * 3.0f + x + y) % 6;
+                            WORD colors[] = {
+                                FOREGROUND_GREEN | FOREGROUND_RED | FOREGROUND_INTENSITY, // Gold
+                                FOREGROUND_GREEN | FOREGROUND_RED | FOREGROUND_BLUE | FOREGROUND_INTENSITY, // White
+                                FOREGROUND_GREEN | FOREGROUND_INTENSITY, // Green
+                                FOREGROUND_GREEN | FOREGROUND_RED | FOREGROUND_INTENSITY, // Gold
+                                FOREGROUND_RED | FOREGROUND_INTENSITY, // Red
+                                FOREGROUND_GREEN | FOREGROUND_RED | FOREGROUND_INTENSITY // Gold
+                            };
+                            localColor[idx] = (localColor[idx] & 0xF0) | colors[colorPhase];
+                        }
+                    }
+                }
+                
+                if (input_space_edge.exchange(false)) {
+                    RequestPlayerReset();
+                    victoryAnimTime = 0.0f;
+                    currentState = MAP_SELECT;
+                }
+                if (input_escape.exchange(false)) currentState = SYSTEM_HALT;
+            }
+        }
+        else if (st == SYSTEM_HALT) {
+            running = false;
+        }
+
+        g_presenter.Present(localBuf.data(), localColor.data());
+
+        uint64_t nAllocs = t_nHeapAllocs - nAllocs0;
+        if (nFrame++ < RENDER_WARMUP_FRAMES) g_renderAllocStats.nWarmupAllocs += nAllocs;
+        else {
+            g_renderAllocStats.nSteadyAllocs += nAllocs;
+            g_renderAllocStats.nWorstFrame = max(g_renderAllocStats.nWorstFrame, nAllocs);
+        }
+        g_renderAllocStats.nFrames = nFrame;
+        if (g_renderFrameLimit && nFrame >= g_renderFrameLimit) {
+            running = false;
+            break;
+        }
+
+        auto end = clock::now();
+        chrono::duration<double, milli> renderElapsed = end - start;
+        double ms = renderElapsed.count();
+        if (!g_renderUnpaced && ms < frameMs) Sleep((DWORD)(frameMs - ms));
+    }
+}
+
+// =================================================================
+// Headless Simulation
+// =================================================================
+// Steps KernelStep in lockstep with a virtual clock (tick * DELTA_T).
+// No console, audio, input thread or sleeping: runs as fast as the CPU allows.
+
+struct SimResult {
+    uint64_t nTicks = 0; // Ticks simulated (virtual time = nTicks * DELTA_T)
+    KernelEvent event = EVT_NONE;
+    PlayerPCB pcb;       // Final car state
+};
+
+// Simulates one run on the currently loaded track.
+SimResult SimulateRun(const InputSource& source, uint64_t maxTicks) {
+    SimResult r;
+    KernelCursors cursors;
+    while (r.nTicks < maxTicks) {
+        KernelInput in = source(r.nTicks, r.pcb);
+        KernelEvent ev = KernelStep(r.pcb, in, cursors);
+        EndlessAdvance(cursors.track.nSection);
+        r.nTicks++;
+        if (ev != EVT_NONE) { r.event = ev; break; }
+    }
+    return r;
+}
+
+SimResult RunHeadless(int mapId, const InputSource& source, uint64_t maxTicks) {
+    LoadMap(mapId);
+    return SimulateRun(source, maxTicks);
+}
+
+const char* KernelEventName(KernelEvent ev) {
+    return ev == EVT_WIN ? "WIN" : ev == EVT_CRASH ? "CRASH" : "RUNNING";
+}
+
+// a.exe --headless <map 1-3> <ticks> [idle | accel | autopilot | <script file>]
+int HeadlessMain(int argc, char* argv[]) {
+    if (argc < 4) {
+        printf("usage: %s --headless <map 1-3> <ticks> [idle | accel | autopilot | <script file>]\n", argv[0]);
+        return 1;
+    }
+    int mapId = atoi(argv[2]);
+    uint64_t ticks = strtoull(argv[3], NULL, 10);
+    if (mapId < 1 || mapId > 3) { printf("unknown map %d\n", mapId); return 1; }
+
+    const char* inputName = argc > 4 ? argv[4] : "accel";
+    InputSource source;
+    if (strcmp(inputName, "idle") == 0) {
+        source = [](uint64_t, const PlayerPCB&) { return KernelInput(); };
+    } else if (strcmp(inputName, "accel") == 0) {
+        source = [](uint64_t, const PlayerPCB&) { KernelInput in; in.bAccel = true; return in; };
+    } else if (strcmp(inputName, "autopilot") == 0) {
+        source = AutopilotSource();
+    } else {
+        InputScript script;
+        if (!LoadInputScript(inputName, script)) { printf("cannot read input script %s\n", inputName); return 1; }
+        source = ScriptInputSource(script);
+    }
+
+    auto t0 = chrono::high_resolution_clock::now();
+    SimResult r = RunHeadless(mapId, source, ticks);
+    double wall = chrono::duration<double>(chrono::high_resolution_clock::now() - t0).count();
+    double virt = (double)r.nTicks * DELTA_T;
+
+    printf("map %d | %llu ticks (%.2f s virtual) | %s\n", mapId, (unsigned long long)r.nTicks, virt, KernelEventName(r.event));
+    printf("dist %.2f / %.0f  x %.3f  speed %.2f\n", TrackPosition(r.pcb.nOriginQ, r.pcb.fDistance), fTotalTrackLength, r.pcb.fX_Register, r.pcb.fSpeed);
+    if (r.event == EVT_CRASH) printf("impact at %.3f of the final tick\n", r.pcb.fImpactTime);
+    printf("wall %.3f ms (%.0fx real time)\n", wall * 1000.0, wall > 0.0 ? virt / wall : 0.0);
+    return r.event == EVT_CRASH ? 2 : 0;
+}
+
+// a.exe --sweep <map 1-3 | all> <autopilot | script file> NAME=lo:hi:steps ... [--threads N]
+// Races every combination of the given KPT ranges on each map, spread over
+// all cores with a StealingPool, and prints one table row per run.
+struct KernelParamField {
+    const char* name;
+    float KernelParams::*field;
+};
+
+const KernelParamField KERNEL_PARAM_FIELDS[] = {
+    { "MAX_SPEED", &KernelParams::fMaxSpeed },
+    { "ACCELERATION", &KernelParams::fAcceleration },
+    { "DECELERATION", &KernelParams::fDeceleration },
+    { "FRICTION", &KernelParams::fFriction },
+    { "LATERAL_FACTOR", &KernelParams::fLateralFactor },
+    { "STEER_COMPENSATION", &KernelParams::fSteerCompensation },
+    { "HEADING_TURN_SPEED", &KernelParams::fHeadingTurnSpeed },
+    { "HEADING_DRIFT_FACTOR", &KernelParams::fHeadingDriftFactor },
+};
+
+struct SweepAxis {
+    const KernelParamField* param;
+    float fLo, fHi;
+    int nSteps;
+    float Value(int k) const { return nSteps > 1 ? fLo + (fHi - fLo) * (float)k / (float)(nSteps - 1) : fLo; }
+};
+
+struct SweepRow {
+    KernelEvent event = EVT_NONE;
+    float fLapTime = 0.0f;   // Seconds, wins only
+    float fCrashDist = 0.0f; // Distance of the crash, crashes only
+    float fPeakX = 0.0f;     // Largest |fX_Register| seen
+};
+
+const uint64_t SWEEP_MAX_TICKS = (uint64_t)(PHYSICS_HZ * 300.0f);
+
+int SweepMain(int argc, char* argv[]) {
+    if (argc < 5) {
+        printf("usage: %s --sweep <map 1-3 | all> <autopilot | script file> NAME=lo:hi:steps ... [--threads N]\n", argv[0]);
+        printf("parameters:");
+        for (auto& f : KERNEL_PARAM_FIELDS) printf(" %s", f.name);
+        printf("\n");
+        return 1;
+    }
+    int mapLo = 1, mapHi = 3;
+    if (strcmp(argv[2], "all") != 0) mapLo = mapHi = atoi(argv[2]);
+    if (mapLo < 1 || mapHi > 3) { printf("unknown map %s\n", argv[2]); return 1; }
+
+    bool bAutopilot = strcmp(argv[3], "autopilot") == 0;
+    InputScript script;
+    if (!bAutopilot && !LoadInputScript(argv[3], script)) { printf("cannot read input script %s\n", argv[3]); return 1; }
+
+    int threads = (int)max(1u, thread::hardware_concurrency());
+    vector<SweepAxis> axes;
+    for (int i = 4; i < argc; ++i) {
+        if (strcmp(argv[i], "--threads") == 0 && i + 1 < argc) { threads = max(1, atoi(argv[++i])); continue; }
+        char name[64];
+        SweepAxis axis;
+        if (sscanf(argv[i], "%63[A-Z_]=%f:%f:%d", name, &axis.fLo, &axis.fHi, &axis.nSteps) != 4 || axis.nSteps < 1) {
+            printf("bad range %s (expected NAME=lo:hi:steps)\n", argv[i]);
+            return 1;
+        }
+        axis.param = nullptr;
+        for (auto& f : KERNEL_PARAM_FIELDS)
+            if (strcmp(f.name, name) == 0) axis.param = &f;
+        if (!axis.param) { printf("unknown parameter %s\n", name); return 1; }
+        axes.push_back(axis);
+    }
+
+    int combos = 1;
+    for (auto& a : axes) combos *= a.nSteps;
+    // Mixed-radix decode of a combination index, first axis varying slowest
+    auto paramsOf = [&](int c) {
+        KernelParams kp;
+        for (int a = (int)axes.size() - 1; a >= 0; --a) {
+            kp.*(axes[a].param->field) = axes[a].Value(c % axes[a].nSteps);
+            c /= axes[a].nSteps;
+        }
+        return kp;
+    };
+
+    StealingPool pool(threads);
+    printf("# %d combinations x %d maps on %d threads, %s driver\n", combos, mapHi - mapLo + 1, pool.Threads(),
+           bAutopilot ? "autopilot" : "scripted");
+    printf("map");
+    for (auto& a : axes) printf("\t%s", a.param->name);
+    printf("\tresult\tlap_s\tcrash_at\tpeak_x\n");
+
+    auto t0 = chrono::steady_clock::now();
+    uint64_t steals = 0;
+    for (int mapId = mapLo; mapId <= mapHi; ++mapId) {
+        LoadMap(mapId);
+        vector<SweepRow> rows(combos);
+        steals += pool.Run(combos, [&](int c) {
+            KernelParams kp = paramsOf(c);
+            FixedKernelConstants kq(kp);
+            InputSource source = bAutopilot ? AutopilotSource(kp) : ScriptInputSource(script);
+            PlayerPCB p;
+            KernelCursors cursors;
+            SweepRow& row = rows[c];
+            for (uint64_t t = 0; t < SWEEP_MAX_TICKS; ++t) {
+                row.event = KernelStep(p, source(t, p), cursors, kp, kq);
+                row.fPeakX = max(row.fPeakX, fabsf(p.fX_Register));
+                if (row.event == EVT_WIN) { row.fLapTime = (float)(t + 1) * DELTA_T; break; }
+                if (row.event == EVT_CRASH) { row.fCrashDist = (float)TrackPosition(p.nOriginQ, p.fDistance); break; }
+            }
+        });
+        for (int c = 0; c < combos; ++c) {
+            KernelParams kp = paramsOf(c);
+            const SweepRow& row = rows[c];
+            printf("%d", mapId);
+            for (auto& a : axes) printf("\t%g", kp.*(a.param->field));
+            printf("\t%s\t", KernelEventName(row.event));
+            if (row.event == EVT_WIN) printf("%.3f", row.fLapTime); else printf("-");
+            printf("\t");
+            if (row.event == EVT_CRASH) printf("%.1f", row.fCrashDist); else printf("-");
+            printf("\t%.3f\n", row.fPeakX);
+        }
+    }
+    double wall = chrono::duration<double>(chrono::steady_clock::now() - t0).count();
+    int runs = combos * (mapHi - mapLo + 1);
+    printf("# %d runs in %.2f s (%.0f runs/s, %llu steals)\n", runs, wall, wall > 0.0 ? runs / wall : 0.0,
+           (unsigned long long)steals);
+    return 0;
+}
+
+// a.exe --difficulty <map 1-3 | all> [runs] [seed]
+// Monte Carlo difficulty: thousands of autopilot runs, each with its own
+// human-like flaws, raced in parallel on the StealingPool.
+struct NoisyDriverTraits {
+    int nDelayTicks;     // Reaction delay: the driver acts on state this old
+    float fMistakeRate;  // Per-tick chance of a wrong steering input
+    float fTargetJitter; // Lateral aim error (road units)
+};
+
+struct DifficultyRun {
+    KernelEvent event = EVT_NONE;
+    float fTime = 0.0f;  // Seconds to the finish, wins only
+    int nCrashSegment = -1;
+};
+
+const int DIFFICULTY_MAX_DELAY = 96; // Ticks (0.4 s)
+
+DifficultyRun SimulateNoisyRun(uint64_t seed) {
+    std::mt19937 rng((uint32_t)(seed ^ (seed >> 32)));
+    std::uniform_real_distribution<float> uni(0.0f, 1.0f);
+    NoisyDriverTraits tr;
+    tr.nDelayTicks = (int)(PHYSICS_HZ * (0.10f + 0.25f * uni(rng))); // 100-350 ms
+    tr.fMistakeRate = 0.01f + 0.05f * uni(rng);
+    tr.fTargetJitter = 0.05f + 0.15f * uni(rng);
+
+    Autopilot driver;
+    PlayerPCB p;
+    KernelCursors cursors;
+    PlayerPCB seen[DIFFICULTY_MAX_DELAY]; // Ring of past states, the driver's view
+    float aimError = 0.0f;
+    DifficultyRun r;
+    for (uint64_t t = 0; t < SWEEP_MAX_TICKS; ++t) {
+        seen[t % DIFFICULTY_MAX_DELAY] = p;
+        const PlayerPCB& view = seen[(t + DIFFICULTY_MAX_DELAY - min<uint64_t>(t, tr.nDelayTicks)) % DIFFICULTY_MAX_DELAY];
+        // Aim drifts every half second
+        if (t % (uint64_t)(PHYSICS_HZ / 2) == 0) aimError = (uni(rng) * 2.0f - 1.0f) * tr.fTargetJitter;
+        PlayerPCB aimed = view;
+        aimed.fX_Register -= aimError;
+        KernelInput in = driver.Drive(aimed);
+        if (uni(rng) < tr.fMistakeRate) in.nSteer = (int)(rng() % 3) - 1;
+
+        r.event = KernelStep(p, in, cursors);
+        if (r.event == EVT_WIN) { r.fTime = (float)(t + 1) * DELTA_T; break; }
+        if (r.event == EVT_CRASH) {
+            TrackCursor c;
+            r.nCrashSegment = min(TrackSeek(c, p.fDistance, p.nOriginQ), (int)vecSegCurvature.size() - 1);
+            break;
+        }
+    }
+    return r;
+}
+
+int DifficultyMain(int argc, char* argv[]) {
+    if (argc < 3) {
+        printf("usage: %s --difficulty <map 1-3 | all> [runs] [seed]\n", argv[0]);
+        return 1;
+    }
+    int mapLo = 1, mapHi = 3;
+    if (strcmp(argv[2], "all") != 0) mapLo = mapHi = atoi(argv[2]);
+    if (mapLo < 1 || mapHi > 3) { printf("unknown map %s\n", argv[2]); return 1; }
+    int runs = argc > 3 ? max(1, atoi(argv[3])) : 2000;
+    uint64_t seed = argc > 4 ? strtoull(argv[4], NULL, 10) : 1;
+
+    StealingPool pool((int)max(1u, thread::hardware_concurrency()));
+    for (int mapId = mapLo; mapId <= mapHi; ++mapId) {
+        LoadMap(mapId);
+        auto t0 = chrono::steady_clock::now();
+        vector<DifficultyRun> results(runs);
+        pool.Run(runs, [&](int i) {
+            uint64_t h = HashBytes(FNV_OFFSET, &seed, sizeof(seed));
+            h = HashBytes(h, &i, sizeof(i));
+            results[i] = SimulateNoisyRun(h);
+        });
+        double wall = chrono::duration<double>(chrono::steady_clock::now() - t0).count();
+
+        int wins = 0;
+        vector<int> crashes(vecSegCurvature.size(), 0);
+        vector<float> times;
+        for (auto& r : results) {
+            if (r.event == EVT_WIN) { wins++; times.push_back(r.fTime); }
+            else if (r.nCrashSegment >= 0) crashes[r.nCrashSegment]++;
+        }
+        sort(times.begin(), times.end());
+
+        // Wilson 95% interval on the finish probability
+        double pHat = (double)wins / runs, z = 1.96, n = runs;
+        double centre = (pHat + z * z / (2 * n)) / (1 + z * z / n);
+        double half = z * sqrt(pHat * (1 - pHat) / n + z * z / (4 * n * n)) / (1 + z * z / n);
+        const char* rating = pHat >= 0.9 ? "EASY" : pHat >= 0.6 ? "MEDIUM" : pHat >= 0.3 ? "HARD" : "EXTREME";
+
+        printf("=== map %d: %d runs in %.2f s ===\n", mapId, runs, wall);
+        printf("finish probability %.1f%% (95%% CI %.1f-%.1f%%)  ->  %s\n", pHat * 100.0,
+               (centre - half) * 100.0, (centre + half) * 100.0, rating);
+        if (!times.empty()) {
+            auto pct = [&](double q) { return times[min(times.size() - 1, (size_t)(q * times.size()))]; };
+            double mean = 0.0;
+            for (float t : times) mean += t;
+            mean /= times.size();
+            printf("finish time  min %.2f  p10 %.2f  median %.2f  p90 %.2f  max %.2f  mean %.2f s\n",
+                   times.front(), pct(0.1), pct(0.5), pct(0.9), times.back(), mean);
+        }
+        int crashTotal = runs - wins;
+        printf("crashes by segment (%d total):\n", crashTotal);
+        for (size_t sgm = 0; sgm < vecSegCurvature.size(); ++sgm) {
+            int bar = crashTotal ? crashes[sgm] * 40 / crashTotal : 0;
+            printf("  seg %2zu  curv %+5.2f  obstacles %d  %5d  %s\n", sgm, vecSegCurvature[sgm],
+                   obstacleIndex.nSegBegin[sgm + 1] - obstacleIndex.nSegBegin[sgm], crashes[sgm], string(bar, '#').c_str());
+        }
+    }
+    return 0;
+}
+
+// a.exe --export-track <map 1-3> <file>
+// a.exe --export-track stress <segments> <obstacles> <file>
+// Writes a built-in or generated stress track as track source text.
+int ExportTrackMain(int argc, char* argv[]) {
+    bool bStress = argc > 2 && strcmp(argv[2], "stress") == 0;
+    if (argc < (bStress ? 6 : 4)) {
+        printf("usage: %s --export-track <map 1-3> <file>\n", argv[0]);
+        printf("       %s --export-track stress <segments> <obstacles> <file>\n", argv[0]);
+        return 1;
+    }
+    vector<TrackSegment> t;
+    if (bStress) {
+        BuildStressTrack(max(1, atoi(argv[3])), max(0, atoi(argv[4])), 1, t);
+    } else {
+        int mapId = atoi(argv[2]);
+        if (mapId < 1 || mapId > 3) { printf("unknown map %d\n", mapId); return 1; }
+        BuildTrackData(mapId, t);
+    }
+    const char* path = argv[bStress ? 5 : 3];
+    FILE* f = fopen(path, "w");
+    if (!f) { printf("cannot write %s\n", path); return 1; }
+    WriteTrackSource(f, t);
+    fclose(f);
+    return 0;
+}
+
+// a.exe --compile-track <file> [loads]
+// Compiles a track source into its cache file and times loading it back.
+int CompileTrackMain(int argc, char* argv[]) {
+    if (argc < 3) { printf("usage: %s --compile-track <file> [loads]\n", argv[0]); return 1; }
+    const char* path = argv[2];
+    int loads = argc > 3 ? max(1, atoi(argv[3])) : 100;
+    typedef chrono::high_resolution_clock clock;
+    auto us = [](clock::time_point t0) { return chrono::duration<double, micro>(clock::now() - t0).count(); };
+
+    string text;
+    if (!ReadWholeFile(path, text)) { printf("cannot read %s\n", path); return 1; }
+    auto t0 = clock::now();
+    uint64_t hash = HashBytes(FNV_OFFSET, text.data(), text.size());
+    double hashUs = us(t0);
+    char cache[64];
+    CompiledTrackName(hash, cache, sizeof(cache));
+
+    t0 = clock::now();
+    vector<TrackSegment> t;
+    int errorLine = 0;
+    if (!ParseTrackSource(text, t, errorLine)) { printf("%s:%d: cannot parse\n", path, errorLine); return 1; }
+    vecTrack.swap(t);
+    InstallTrack();
+    if (!WriteCompiledTrack(cache, hash)) { printf("cannot write %s\n", cache); return 1; }
+    double compileUs = us(t0);
+    printf("%s -> %s | %d segments, %d obstacles, %zu map points, length %.0f\n", path, cache,
+           (int)vecSegCurvature.size(), obstacleIndex.Size(), vecMapPointsCurrent.size(), fTotalTrackLength);
+
+    t0 = clock::now();
+    for (int i = 0; i < loads; ++i)
+        if (!LoadTrackFile(path)) { printf("cannot load %s\n", path); return 1; }
+    double sourceUs = us(t0) / loads;
+    t0 = clock::now();
+    for (int i = 0; i < loads; ++i)
+        if (!MapCompiledTrack(cache, hash)) { printf("cannot map %s\n", cache); return 1; }
+    double mapUs = us(t0) / loads;
+
+    printf("source %zu bytes, compiled %zu bytes\n", text.size(), g_trackFile.nSize);
+    printf("compile          : %10.1f us (hash %.1f us)\n", compileUs, hashUs);
+    printf("load via source  : %10.1f us (read, hash, map)\n", sourceUs);
+    printf("load compiled    : %10.1f us (map only)\n", mapUs);
+    return 0;
+}
+
+// a.exe --bench-broadphase [seed]
+// Per-tick cost of the obstacle queries on stress tracks of growing size,
+// 10 obstacles per segment. Every column should stay flat from 10 to 10k
+// segments; the minimap raster is built on the first frame and copied after.
+int BenchBroadphaseMain(int argc, char* argv[]) {
+    uint32_t seed = argc > 2 ? (uint32_t)strtoul(argv[2], NULL, 10) : 1;
+    const int TICKS = 200000, FRAMES = 20000, SEEKS = 200000, ROAD_ROWS = 15;
+    typedef chrono::high_resolution_clock clock;
+    auto ns = [](clock::time_point t0, int n) { return chrono::duration<double, nano>(clock::now() - t0).count() / n; };
+
+    printf("segments  obstacles     length  build ms  collide ns/tick  warn ns/tick  road ns/frame  minimap ns/frame  far seek ns\n");
+    for (int segments = 10; segments <= 10000; segments *= 10) {
+        auto b0 = clock::now();
+        BuildStressTrack(segments, segments * 10, seed, vecTrack);
+        InstallTrack();
+        double buildMs = ns(b0, 1) / 1e6;
+        const ObstacleIndex& oi = obstacleIndex;
+        // A weaving car at top speed, wrapping back to the start at the finish.
+        // Distances are from the start line (origin 0) throughout.
+        const float step = MAX_SPEED * DELTA_T;
+        auto pathX = [](float d) { return 0.8f * sinf(d * 0.05f); };
+        volatile float sink = 0.0f;
+
+        ObstacleCursor collision;
+        float d = 0.0f;
+        auto t0 = clock::now();
+        for (int t = 0; t < TICKS; ++t) {
+            float d1 = d + step >= fTotalTrackLength ? 0.0f : d + step;
+            sink = sink + SweptImpactTOI(d, pathX(d), d1, pathX(d1), true, 0, collision);
+            d = d1;
+        }
+        double collideNs = ns(t0, TICKS);
+
+        ObstacleCursor warning;
+        d = 0.0f;
+        t0 = clock::now();
+        for (int t = 0; t < TICKS; ++t) {
+            int next = ObstacleSeek(warning, d, 0);
+            if (next < oi.Size() && oi.Dist(next, 0) - d <= 50.0f) sink = sink + oi.fOffsetX[next];
+            d = d + step >= fTotalTrackLength ? 0.0f : d + step;
+        }
+        double warnNs = ns(t0, TICKS);
+
+        // Road rows at the renderer's perspective spacing, camera moving 4 ticks per frame
+        TrackCursor camera;
+        ObstacleCursor holes;
+        d = 0.0f;
+        int holeCount = 0;
+        t0 = clock::now();
+        for (int f = 0; f < FRAMES; ++f) {
+            int section = TrackSeek(camera, d, 0);
+            if (section < (int)vecSegCurvature.size()) {
+                for (int row = ROAD_ROWS - 1; row >= 0; --row) {
+                    float pers = (float)row / ROAD_ROWS;
+                    ForEachRoadHole(section, d - LocalQ(vecSegStartQ[section], 0) + 5.0f / (pers + 0.01f), holes, [&](int) { holeCount++; });
+                }
+            }
+            d = d + step * 4.0f >= fTotalTrackLength ? 0.0f : d + step * 4.0f;
+        }
+        double roadNs = ns(t0, FRAMES);
+        sink = sink + (float)holeCount;
+
+        vector<wchar_t> screen(nScreenWidth * nScreenHeight, L' ');
+        d = 0.0f;
+        t0 = clock::now();
+        for (int f = 0; f < FRAMES; ++f) {
+            DrawTrackView(screen.data(), nScreenWidth - 33, 1, 31, 15, vecMapPointsCurrent, d);
+            d = d + step * 4.0f >= fTotalTrackLength ? 0.0f : d + step * 4.0f;
+        }
+        double minimapNs = ns(t0, FRAMES);
+
+        // Cursors that jump anywhere on the track, as after a respawn or replay seek
+        mt19937 rng(seed);
+        uniform_real_distribution<float> anywhere(0.0f, fTotalTrackLength);
+        vector<float> targets(SEEKS);
+        for (auto& v : targets) v = anywhere(rng);
+        ObstacleCursor far;
+        t0 = clock::now();
+        for (int i = 0; i < SEEKS; ++i) sink = sink + (float)ObstacleSeek(far, targets[i], 0);
+        double seekNs = ns(t0, SEEKS);
+
+        printf("%8d  %9d  %9.0f  %8.1f  %15.1f  %12.1f  %13.1f  %16.1f  %11.1f\n", segments, oi.Size(), fTotalTrackLength,
+               buildMs, collideNs, warnNs, roadNs, minimapNs, seekNs);
+    }
+    return 0;
+}
+
+// a.exe --bench-batch <map 1-3> <cars> <ticks>
+// Throughput of BatchStep against KernelStep, plus a bit-for-bit comparison.
+int BenchBatchMain(int argc, char* argv[]) {
+    if (argc < 5) {
+        printf("usage: %s --bench-batch <map 1-3> <cars> <ticks>\n", argv[0]);
+        return 1;
+    }
+    if (g_fixedPhysics) { printf("BatchStep is float-only; run without --fixed\n"); return 1; }
+    int mapId = atoi(argv[2]);
+    int cars = max(1, atoi(argv[3]));
+    int ticks = max(1, atoi(argv[4]));
+    if (mapId < 1 || mapId > 3) { printf("unknown map %d\n", mapId); return 1; }
+    LoadMap(mapId);
+
+    // Scalar reference
+    vector<PlayerPCB> ref(cars);
+    vector<KernelCursors> refCursors(cars);
+    vector<uint8_t> refDone(cars, 0);
+    auto t0 = chrono::high_resolution_clock::now();
+    for (int t = 0; t < ticks; ++t) {
+        for (int i = 0; i < cars; ++i) {
+            if (refDone[i]) continue;
+            KernelInput in = BenchDriverInput(i, ref[i].fX_Register, ref[i].fHeadingAngle);
+            if (KernelStep(ref[i], in, refCursors[i]) != EVT_NONE) refDone[i] = 1;
+        }
+    }
+    double scalarSec = chrono::duration<double>(chrono::high_resolution_clock::now() - t0).count();
+
+    // Batch
+    BatchSim b;
+    b.Resize(cars);
+    double batchSec = 0.0;
+    for (int t = 0; t < ticks; ++t) {
+        for (int i = 0; i < cars; ++i) b.SetInput(i, BenchDriverInput(i, b.fX[i], b.fHeading[i]));
+        auto s0 = chrono::high_resolution_clock::now();
+        BatchStep(b);
+        batchSec += chrono::duration<double>(chrono::high_resolution_clock::now() - s0).count();
+    }
+
+    int mismatches = 0;
+    for (int i = 0; i < cars; ++i) {
+        PlayerPCB p = b.Get(i);
+        const PlayerPCB& r = ref[i];
+        if (memcmp(&p.fX_Register, &r.fX_Register, sizeof(float)) || memcmp(&p.fSpeed, &r.fSpeed, sizeof(float)) ||
+            memcmp(&p.fDistance, &r.fDistance, sizeof(float)) || memcmp(&p.fCurvature, &r.fCurvature, sizeof(float)) ||
+            memcmp(&p.fPlayerCurvature, &r.fPlayerCurvature, sizeof(float)) ||
+            memcmp(&p.fHeadingAngle, &r.fHeadingAngle, sizeof(float)) ||
+            p.nSteerState != r.nSteerState || p.bCrashed != r.bCrashed || p.nOriginQ != r.nOriginQ)
+            mismatches++;
+    }
+
+    double vt = (double)cars * ticks;
+    printf("map %d | %d cars x %d ticks | SIMD width %d\n", mapId, cars, ticks, BATCH_SIMD_WIDTH);
+    printf("scalar KernelStep : %8.2f M vehicle-ticks/s\n", scalarSec > 0.0 ? vt / scalarSec / 1e6 : 0.0);
+    printf("BatchStep         : %8.2f M vehicle-ticks/s\n", batchSec > 0.0 ? vt / batchSec / 1e6 : 0.0);
+    printf("bit-exact         : %s (%d / %d cars differ)\n", mismatches == 0 ? "yes" : "NO", mismatches, cars);
+    return mismatches == 0 ? 0 : 2;
+}
+
+// a.exe --replay <file> [--watch]
+// Re-simulates a recorded race headlessly and checks the trajectory hash;
+// --watch plays it back in the game instead.
+int ReplayMain(int argc, char* argv[]) {
+    if (argc < 3) {
+        printf("usage: %s --replay <file> [--watch]\n", argv[0]);
+        return 1;
+    }
+    ReplayHeader hdr;
+    InputScript script;
+    if (!LoadReplay(argv[2], hdr, script)) { printf("cannot read replay %s\n", argv[2]); return 1; }
+    if (hdr.nMapId < 1 || hdr.nMapId > 3) { printf("replay has unknown map %d\n", hdr.nMapId); return 1; }
+    if (hdr.nConstantsHash != BuildConstantsHash())
+        printf("warning: replay was recorded with different physics constants\n");
+    // Re-simulate with the recording's kernel and field
+    g_fixedPhysics = (hdr.nFlags & REPLAY_FLAG_FIXED) != 0;
+    g_opponentCount = (int)(hdr.nFlags >> REPLAY_OPPONENTS_SHIFT);
+    // and track; older replays leave --endless to the command line
+    if (hdr.nVersion >= 4) {
+        g_endlessTrack = (hdr.nFlags & REPLAY_FLAG_ENDLESS) != 0;
+        g_endlessSeed = hdr.nEndlessSeed;
+    }
+    // Another track would only show up as a trajectory mismatch (older
+    // replays do not say which track they ran on)
+    LoadMap(hdr.nMapId);
+    if (hdr.nVersion >= 3 && hdr.nTrackHash != g_trackHash) {
+        if (hdr.nTrackHash == 0)
+            printf("replay was recorded on built-in map %d; run it without --track\n", hdr.nMapId);
+        else
+            printf("replay was recorded on a track file with content hash %016llx (cached as track_%016llx.otb); "
+                   "run it with that file as --track\n", (unsigned long long)hdr.nTrackHash, (unsigned long long)hdr.nTrackHash);
+        return 1;
+    }
+    if (argc > 3 && strcmp(argv[3], "--watch") == 0) {
+        g_replayScript = script;
+        g_replayMapId = hdr.nMapId;
+        g_replayWatching.store(true);
+        return -1; // Continue into the game
+    }
+
+    InputSource source = ScriptInputSource(script);
+    SimResult r;
+    KernelCursors cursors;
+    OpponentField opponents;
+    opponents.Reset(g_opponentCount);
+    uint64_t hash = FNV_OFFSET;
+    while (r.nTicks < hdr.nTicks) {
+        KernelInput in = source(r.nTicks, r.pcb);
+        r.event = RaceStep(r.pcb, in, cursors, opponents);
+        hash = HashPCB(hash, r.pcb);
+        r.nTicks++;
+        if (r.event != EVT_NONE) break;
+    }
+
+    printf("map %d | %llu ticks | %s | %s physics\n", hdr.nMapId, (unsigned long long)r.nTicks,
+           KernelEventName(r.event), g_fixedPhysics ? "fixed-point" : "float");
+    printf("dist %.2f / %.0f  x %.3f  speed %.2f\n", TrackPosition(r.pcb.nOriginQ, r.pcb.fDistance), fTotalTrackLength, r.pcb.fX_Register, r.pcb.fSpeed);
+    printf("stream %u bytes (%.4f bytes/tick, %zu runs)\n", hdr.nPayloadBytes,
+           hdr.nTicks ? (double)hdr.nPayloadBytes / (double)hdr.nTicks : 0.0, script.size());
+    bool match = r.nTicks == hdr.nTicks && hash == hdr.nTrajectoryHash;
+    printf("trajectory: %s\n", match ? "bit-exact match" : "MISMATCH");
+    return match ? 0 : 2;
+}
+
+// Reference publisher with the old g_player_mutex locking scheme
+struct MutexPublisher {
+    std::mutex m;
+    PlayerPCB v;
+    void Publish(const PlayerPCB& p) { std::lock_guard<std::mutex> lk(m); v = p; }
+    PlayerPCB Read() { std::lock_guard<std::mutex> lk(m); return v; }
+};
+
+// One writer publishing as fast as it can against `readers` threads reading
+// in a tight loop. Reports writer rate and how long single publishes stall.
+template <typename Publisher>
+void RunContentionBench(const char* name, Publisher& pub, int readers, double seconds) {
+    using clock = chrono::steady_clock;
+    std::atomic<bool> stop(false);
+    std::atomic<uint64_t> reads(0);
+    vector<thread> pool;
+    for (int r = 0; r < readers; ++r) {
+        pool.emplace_back([&]() {
+            uint64_t n = 0;
+            float sink = 0.0f;
+            while (!stop.load(std::memory_order_relaxed)) { sink += pub.Read().fSpeed; n++; }
+            reads.fetch_add(n + (sink < 0.0f ? 1 : 0));
+        });
+    }
+
+    // Publish latency histogram in power-of-two nanosecond buckets
+    uint64_t buckets[40] = {};
+    uint64_t writes = 0;
+    double worstNs = 0.0;
+    PlayerPCB p;
+    auto start = clock::now();
+    auto end = start + chrono::duration_cast<clock::duration>(chrono::duration<double>(seconds));
+    for (auto now = start; now < end;) {
+        p.fDistance += 1.0f;
+        p.fSpeed = (float)(writes & 63);
+        pub.Publish(p);
+        auto after = clock::now();
+        double ns = chrono::duration<double, nano>(after - now).count();
+        worstNs = max(worstNs, ns);
+        int b = 0;
+        while (b < 39 && (double)(1ULL << b) < ns) b++;
+        buckets[b]++;
+        writes++;
+        now = after;
+    }
+    stop.store(true);
+    for (auto& t : pool) t.join();
+
+    uint64_t p99Target = writes - writes / 100, acc = 0;
+    int p99 = 0;
+    for (; p99 < 40; ++p99) { acc += buckets[p99]; if (acc >= p99Target) break; }
+    double elapsed = chrono::duration<double>(clock::now() - start).count();
+    printf("%-8s | writer %8.2f M publishes/s | p99 < %6llu ns | worst %9.0f ns | readers %8.2f M reads/s\n",
+           name, writes / elapsed / 1e6, 1ULL << p99, worstNs, reads.load() / elapsed / 1e6);
+}
+
+// a.exe --bench-snapshot [seconds] [readers]
+int BenchSnapshotMain(int argc, char* argv[]) {
+    double seconds = argc > 2 ? atof(argv[2]) : 2.0;
+    int readers = argc > 3 ? max(1, atoi(argv[3])) : 3;
+    printf("1 writer vs %d readers, %.1f s per scheme\n", readers, seconds);
+    MutexPublisher mutexPub;
+    RunContentionBench("mutex", mutexPub, readers, seconds);
+    SeqLock<PlayerPCB> seqPub;
+    RunContentionBench("seqlock", seqPub, readers, seconds);
+    return 0;
+}
+
+// a.exe --bench-pacing [seconds]
+// Tick jitter and CPU cost of the TickPacer against the old Sleep(0) loop.
+void PrintJitter(const char* name, const JitterStats& j, double cpuSec, double wallSec) {
+    printf("%-8s | %6llu ticks | late mean %7.1f us  sd %7.1f  p99 %7.1f  max %8.1f | CPU %5.1f%% of a core\n",
+           name, (unsigned long long)j.nTicks, j.MeanUs(), j.StdDevUs(), j.PercentileUs(0.99), j.fMaxUs,
+           wallSec > 0.0 ? 100.0 * cpuSec / wallSec : 0.0);
+}
+
+int BenchPacingMain(int argc, char* argv[]) {
+    double seconds = argc > 2 ? atof(argv[2]) : 3.0;
+    typedef chrono::steady_clock clock;
+    printf("%.0f Hz physics, %.1f s per loop\n", PHYSICS_HZ, seconds);
+
+    {
+        double cpu0 = ProcessCpuSeconds();
+        auto t0 = clock::now();
+        TickPacer pacer(PHYSICS_HZ);
+        auto end = t0 + chrono::duration_cast<clock::duration>(chrono::duration<double>(seconds));
+        while (clock::now() < end) pacer.WaitNext();
+        PrintJitter("pacer", pacer.stats, ProcessCpuSeconds() - cpu0, chrono::duration<double>(clock::now() - t0).count());
+    }
+    {
+        // Previous PhysicsThreadProc loop; lateness = when tick k ran minus start + k * dt
+        JitterStats j;
+        double cpu0 = ProcessCpuSeconds();
+        auto t0 = clock::now();
+        auto last = t0;
+        double accumulator = 0.0, dt = DELTA_T;
+        uint64_t k = 0;
+        auto end = t0 + chrono::duration_cast<clock::duration>(chrono::duration<double>(seconds));
+        while (clock::now() < end) {
+            auto now = clock::now();
+            accumulator += chrono::duration<double>(now - last).count();
+            last = now;
+            while (accumulator >= dt) {
+                k++;
+                j.Add(max(0.0, chrono::duration<double, micro>(now - t0).count() - (double)k * dt * 1e6));
+                accumulator -= dt;
+            }
+            Sleep(0);
+        }
+        PrintJitter("sleep(0)", j, ProcessCpuSeconds() - cpu0, chrono::duration<double>(clock::now() - t0).count());
+    }
+    return 0;
+}
+
+// a.exe --bench-render <map 1-3> [frames] [paced]
+// Runs the render loop, unpaced unless asked, against an autopilot race
+// stepped in real time (restarted on every finish or crash), and counts the
+// heap allocations the render thread makes. On a terminal the frames are
+// presented to /dev/null to measure what the cell diff sends.
+int BenchRenderMain(int argc, char* argv[]) {
+    if (argc < 3) {
+        printf("usage: %s --bench-render <map 1-3> [frames] [paced]\n", argv[0]);
+        return 1;
+    }
+    int mapId = atoi(argv[2]);
+    if (mapId < 1 || mapId > 3) { printf("unknown map %d\n", mapId); return 1; }
+    g_renderFrameLimit = argc > 3 ? max(1ULL, strtoull(argv[3], NULL, 10)) : 2000;
+    g_renderFrameLimit = max(g_renderFrameLimit, RENDER_WARMUP_FRAMES + 1);
+    g_renderUnpaced = !(argc > 4 && strcmp(argv[4], "paced") == 0);
+#ifndef _WIN32
+    g_presenter.fd = open("/dev/null", O_WRONLY);
+#endif
+
+    InitMaps();
+    LoadMap(mapId);
+    currentState = KERNEL_RUNNING;
+    auto t0 = chrono::steady_clock::now();
+    thread tRender(RenderThreadProc);
+
+    TickPacer pacer(PHYSICS_HZ);
+    PlayerPCB p;
+    KernelCursors cursors;
+    TrackCursor cameraCursor;
+    CameraState camera;
+    RenderFrame frame;
+    OpponentField opponents;
+    opponents.Reset(g_opponentCount);
+    Autopilot autopilot;
+    while (running.load()) {
+        int due = pacer.WaitNext();
+        for (int tick = 0; tick < due; ++tick) {
+            if (RaceStep(p, autopilot.Drive(p), cursors, opponents) != EVT_NONE) {
+                p.Reset();
+                cursors = KernelCursors();
+                cameraCursor.Reset();
+                camera = CameraState();
+                opponents.Reset(g_opponentCount);
+                autopilot.Reset();
+            }
+            opponents.Publish();
+            CameraStep(camera, p, cameraCursor);
+            frame.prev = frame.cur;
+            frame.camPrev = frame.camCur;
+            frame.cur = p;
+            frame.camCur = camera;
+            frame.nTick++;
+            frame.fTickTime = chrono::duration<double>(pacer.LastDeadline().time_since_epoch()).count();
+            g_renderFrame.Publish(frame);
+        }
+    }
+    tRender.join();
+    double sec = chrono::duration<double>(chrono::steady_clock::now() - t0).count();
+
+    const RenderAllocStats& st = g_renderAllocStats;
+    printf("map %d | %llu frames in %.2f s (%.0f fps%s) | %llu ticks\n", mapId, (unsigned long long)st.nFrames, sec,
+           st.nFrames / sec, g_renderUnpaced ? " unpaced" : "", (unsigned long long)frame.nTick);
+    printf("heap allocations: %llu in the first %llu frames, %llu in the other %llu (worst frame %llu)\n",
+           (unsigned long long)st.nWarmupAllocs, (unsigned long long)RENDER_WARMUP_FRAMES,
+           (unsigned long long)st.nSteadyAllocs, (unsigned long long)(st.nFrames - RENDER_WARMUP_FRAMES),
+           (unsigned long long)st.nWorstFrame);
+#ifndef _WIN32
+    const FramePresenter& pr = g_presenter;
+    if (pr.nFrames > 1) {
+        double later = (double)(pr.nBytes - pr.nFirstBytes) / (pr.nFrames - 1);
+        printf("terminal output: first frame %llu bytes, then %.0f bytes/frame (%.0f cells changed; %.1fx smaller)\n",
+               (unsigned long long)pr.nFirstBytes, later, (double)(pr.nCells - nScreenWidth * nScreenHeight) / (pr.nFrames - 1),
+               later > 0.0 ? pr.nFirstBytes / later : 0.0);
+    }
+#endif
+    return st.nSteadyAllocs == 0 ? 0 : 1;
+}
+
+// =================================================================
+// Main
+// =================================================================
+// Command line:
+//   a.exe                                   play the game
+//   a.exe --headless <map> <ticks> [input]  faster-than-real-time simulation
+//   a.exe --bench-batch <map> <cars> <ticks> SoA batch stepping throughput
+//   a.exe --bench-broadphase [seed]         obstacle query cost on 10-10k segment stress tracks
+//   a.exe --export-track <map|stress ...> <file>  write a track as source text
+//   a.exe --compile-track <file> [loads]    compile a track source and time loading it
+//   a.exe --replay <file> [--watch]         verify or watch a recorded race
+//   a.exe --bench-snapshot [sec] [readers]  player snapshot contention, mutex vs seqlock
+//   a.exe --bench-pacing [sec]              physics tick jitter and CPU cost
+//   a.exe --bench-render <map> [frames] [paced]  render loop heap allocations and terminal bytes per frame
+//   a.exe --sweep <map|all> <driver> NAME=lo:hi:steps ...  KPT parameter sweep
+//   a.exe --difficulty <map|all> [runs] [seed]  Monte Carlo track difficulty
+// Any mode also accepts --fixed to use the fixed-point physics kernel,
+// and the game accepts --opponents <N> (up to 256 AI cars; replays store
+// theirs), --autopilot (toggle in game with P) and --telemetry <file>
+// (game events as TSV). --track <file> races a track file in place of the
+// built-in maps in every mode; replays store the track's content hash and
+// refuse to run on another track. --endless [seed] races a procedural track
+// without a finish line in the game, --headless and --replay (no opponents;
+// replays store the seed and race it again).
+int main(int argc, char* argv[]) {
+    // Strip global options so the positional arguments of each mode stay put
+    int nArgs = 1;
+    for (int i = 1; i < argc; ++i) {
+        if (strcmp(argv[i], "--fixed") == 0) g_fixedPhysics = true;
+        else if (strcmp(argv[i], "--autopilot") == 0) g_autopilot.store(true);
+        else if (strcmp(argv[i], "--telemetry") == 0 && i + 1 < argc) g_telemetryPath = argv[++i];
+        else if (strcmp(argv[i], "--track") == 0 && i + 1 < argc) g_trackPath = argv[++i];
+        else if (strcmp(argv[i], "--endless") == 0) {
+            g_endlessTrack = true;
+            if (i + 1 < argc && isdigit((unsigned char)argv[i + 1][0])) g_endlessSeed = (uint32_t)strtoul(argv[++i], NULL, 10);
+        }
+        else if (strcmp(argv[i], "--opponents") == 0 && i + 1 < argc) g_opponentCount = max(0, min(MAX_OPPONENTS, atoi(argv[++i])));
+        else argv[nArgs++] = argv[i];
+    }
+    argc = nArgs;
+    if (g_endlessTrack) {
+        bool bSupported = argc == 1 || strcmp(argv[1], "--headless") == 0 || strcmp(argv[1], "--replay") == 0;
+        if (!bSupported || g_trackPath) {
+            printf("--endless works with the game, --headless and --replay, and not with --track\n");
+            return 1;
+        }
+        g_opponentCount = 0; // Opponents would fall behind the retired segments
+    }
+    // Compile or check the track up front; later loads come from its cache
+    if (g_trackPath && !LoadTrackFile(g_trackPath)) {
+        printf("cannot load track %s\n", g_trackPath);
+        return 1;
+    }
+
+    if (argc > 1 && strcmp(argv[1], "--headless") == 0) return HeadlessMain(argc, argv);
+    if (argc > 1 && strcmp(argv[1], "--bench-batch") == 0) return BenchBatchMain(argc, argv);
+    if (argc > 1 && strcmp(argv[1], "--bench-broadphase") == 0) return BenchBroadphaseMain(argc, argv);
+    if (argc > 1 && strcmp(argv[1], "--export-track") == 0) return ExportTrackMain(argc, argv);
+    if (argc > 1 && strcmp(argv[1], "--compile-track") == 0) return CompileTrackMain(argc, argv);
+    if (argc > 1 && strcmp(argv[1], "--bench-snapshot") == 0) return BenchSnapshotMain(argc, argv);
+    if (argc > 1 && strcmp(argv[1], "--bench-pacing") == 0) return BenchPacingMain(argc, argv);
+    if (argc > 1 && strcmp(argv[1], "--bench-render") == 0) return BenchRenderMain(argc, argv);
+    if (argc > 1 && strcmp(argv[1], "--sweep") == 0) return SweepMain(argc, argv);
+    if (argc > 1 && strcmp(argv[1], "--difficulty") == 0) return DifficultyMain(argc, argv);
+    if (argc > 1 && strcmp(argv[1], "--replay") == 0) {
+        int rc = ReplayMain(argc, argv);
+        if (rc >= 0) return rc;
+    }
+
+    std::locale::global(std::locale(""));
+#ifdef _WIN32
+    hConsole = GetStdHandle(STD_OUTPUT_HANDLE);
+    
+    // Lock console window size to prevent resizing
+    COORD size = { (short)nScreenWidth, (short)nScreenHeight };
+    SetConsoleScreenBufferSize(hConsole, size);
+    
+    // Set window size to match buffer size
+    SMALL_RECT rect = { 0, 0, (short)(nScreenWidth - 1), (short)(nScreenHeight - 1) };
+    SetConsoleWindowInfo(hConsole, TRUE, &rect);
+    
+    // Disable window resizing
+    HWND hwnd = GetConsoleWindow();
+    if (hwnd != NULL) {
+        LONG_PTR style = GetWindowLongPtr(hwnd, GWL_STYLE);
+        style &= ~(WS_THICKFRAME | WS_MAXIMIZEBOX);
+        SetWindowLongPtr(hwnd, GWL_STYLE, style);
+    }
+    
+    CONSOLE_CURSOR_INFO ci{1, false};
+    SetConsoleCursorInfo(hConsole, &ci);
+#else
+    TerminalBegin();
+#endif
+
+    InitMaps();
+    currentState = BOOT_MENU;
+    if (g_replayWatching.load()) {
+        LoadMap(g_replayMapId);
+        GhostOpen(g_replayMapId);
+        player.Reset();
+        currentState = KERNEL_RUNNING;
+    }
+
+    thread tInput(InputThreadProc);
+    thread tPhysics(PhysicsThreadProc);
+    thread tRender(RenderThreadProc);
+#ifdef _WIN32
+    thread tSound(SoundThreadProc);
+#endif
+    thread tTelemetry;
+    if (g_telemetryPath) tTelemetry = thread(TelemetryThreadProc);
+    thread tEndless;
+    if (g_endlessTrack) {
+        g_endless.bThreaded = true;
+        tEndless = thread(EndlessThreadProc);
+    }
+
+    tInput.join();
+    tPhysics.join();
+    tRender.join();
+#ifdef _WIN32
+    tSound.join();
+#endif
+    if (tTelemetry.joinable()) tTelemetry.join();
+    if (tEndless.joinable()) tEndless.join();
+
+    GhostClose();
+    GhostFlushPending();
+#ifndef _WIN32
+    TerminalRestore();
+#endif
+
+    return 0;
+}